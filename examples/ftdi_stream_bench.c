@@ -0,0 +1,210 @@
+/* ftdi_stream_bench.c
+
+   Measure the sustained streaming throughput of a FT2232H/FT232H in
+   synchronous FIFO mode and check the received data against a test
+   pattern, to qualify cables, hubs and host machines.
+
+   The device has to send the selected pattern, e.g. from a counter
+   in the FPGA or microcontroller attached to the FIFO.
+
+   This program is distributed under the GPL, version 2
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <ftdi.h>
+
+static int exitRequested = 0;
+static double duration = 10.0;
+static struct ftdi_stream_control *control;
+static struct ftdi_stream_stats stats;
+static uint64_t received = 0;
+
+static void
+sigintHandler(int signum)
+{
+    exitRequested = 1;
+}
+
+static void
+usage(const char *argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [options...]\n"
+            "Benchmark streaming reads from FT2232H/FT232H\n"
+            "[-P string] only look for product with given string\n"
+            "[-i A|B] interface to use, default A\n"
+            "[-p none|count8|count16|count32|lfsr] test pattern, default count8\n"
+            "[-t seconds] duration, default 10, 0 runs until ^C\n"
+            "[-n packets] packets per transfer, default 8\n"
+            "[-x transfers] transfers in flight, default 256\n"
+            "[-w] one callback per transfer instead of per packet\n"
+            "[-k] keep the bit mode set up by the device, don't switch to FIFO mode\n",
+            argv0);
+    exit(1);
+}
+
+static int
+parse_pattern(const char *name)
+{
+    static const char *names[] = { "none", "count8", "count16", "count32", "lfsr" };
+    int i;
+
+    for (i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++)
+        if (strcmp(name, names[i]) == 0)
+            return i;
+    return -1;
+}
+
+static int
+readCallback(uint8_t *buffer, int length, FTDIProgressInfo *progress, void *userdata)
+{
+    if (buffer)
+        received += length;
+    if (progress)
+    {
+        fprintf(stderr, "%8.2fs %10.3f MiB %8.3f MiB/s now %8.3f MiB/s avg %8llu errors %6llu overruns\n",
+                progress->totalTime,
+                progress->current.totalBytes / (1024.0 * 1024.0),
+                progress->windowRate / (1024.0 * 1024.0),
+                progress->totalTime > 0 ?
+                progress->current.totalBytes / progress->totalTime / (1024.0 * 1024.0) : 0.0,
+                (unsigned long long)stats.pattern.errors,
+                (unsigned long long)stats.overruns);
+        if (exitRequested || (duration > 0 && progress->totalTime >= duration))
+            ftdi_stream_stop(control);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct ftdi_context *ftdi;
+    struct ftdi_stream_config config;
+    enum ftdi_interface interface = INTERFACE_A;
+    char *descstring = NULL;
+    struct timeval start, end;
+    double seconds;
+    int err, c;
+
+    ftdi_stream_config_init(&config);
+    config.pattern = FTDI_PATTERN_COUNT8;
+
+    while ((c = getopt(argc, argv, "P:i:p:t:n:x:wk")) != -1)
+    {
+        switch (c)
+        {
+            case 'P':
+                descstring = optarg;
+                break;
+            case 'i':
+                if (optarg[0] == 'A' || optarg[0] == 'a')
+                    interface = INTERFACE_A;
+                else if (optarg[0] == 'B' || optarg[0] == 'b')
+                    interface = INTERFACE_B;
+                else
+                    usage(argv[0]);
+                break;
+            case 'p':
+                config.pattern = parse_pattern(optarg);
+                if (config.pattern < 0)
+                    usage(argv[0]);
+                break;
+            case 't':
+                duration = atof(optarg);
+                break;
+            case 'n':
+                config.packets_per_transfer = atoi(optarg);
+                break;
+            case 'x':
+                config.num_transfers = atoi(optarg);
+                break;
+            case 'w':
+                config.whole_transfers = 1;
+                break;
+            case 'k':
+                config.bitmode = FTDI_STREAM_KEEP_MODE;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind < argc)
+        usage(argv[0]);
+
+    if ((ftdi = ftdi_new()) == 0)
+    {
+        fprintf(stderr, "ftdi_new failed\n");
+        return EXIT_FAILURE;
+    }
+    if (ftdi_set_interface(ftdi, interface) < 0)
+    {
+        fprintf(stderr, "ftdi_set_interface failed\n");
+        ftdi_free(ftdi);
+        return EXIT_FAILURE;
+    }
+    if (ftdi_usb_open_desc(ftdi, 0x0403, 0x6010, descstring, NULL) < 0 &&
+        ftdi_usb_open_desc(ftdi, 0x0403, 0x6014, descstring, NULL) < 0)
+    {
+        fprintf(stderr, "Can't open ftdi device: %s\n", ftdi_get_error_string(ftdi));
+        ftdi_free(ftdi);
+        return EXIT_FAILURE;
+    }
+    if (ftdi_set_latency_timer(ftdi, 2) < 0)
+    {
+        fprintf(stderr, "Can't set latency, Error %s\n", ftdi_get_error_string(ftdi));
+        ftdi_usb_close(ftdi);
+        ftdi_free(ftdi);
+        return EXIT_FAILURE;
+    }
+
+    control = ftdi_stream_control_new();
+    config.stats = &stats;
+    config.control = control;
+    config.progress_interval = (duration > 0 && duration < 1.0) ? duration : 1.0;
+    config.rate_window = 1.0;
+    signal(SIGINT, sigintHandler);
+
+    gettimeofday(&start, NULL);
+    err = ftdi_stream_run(ftdi, &config, readCallback, NULL, NULL);
+    gettimeofday(&end, NULL);
+    seconds = (end.tv_sec - start.tv_sec) + 1e-6 * (end.tv_usec - start.tv_usec);
+
+    signal(SIGINT, SIG_DFL);
+    ftdi_set_bitmode(ftdi, 0xff, BITMODE_RESET);
+    ftdi_usb_close(ftdi);
+    ftdi_stream_control_free(control);
+    ftdi_free(ftdi);
+
+    if (err < 0)
+        fprintf(stderr, "Stream failed: %d\n", err);
+    else if (err == 1)
+        fprintf(stderr, "Stream stalled or could not be set up\n");
+
+    printf("bytes          %llu\n", (unsigned long long)received);
+    printf("seconds        %.3f\n", seconds);
+    printf("throughput     %.3f MiB/s (%.1f Mbit/s)\n",
+           received / seconds / (1024.0 * 1024.0),
+           received * 8.0 / seconds / 1e6);
+    if (config.pattern != FTDI_PATTERN_NONE)
+    {
+        printf("pattern errors %llu\n", (unsigned long long)stats.pattern.errors);
+        if (stats.pattern.errors)
+            printf("first error at %lld\n", (long long)stats.pattern.first_error);
+    }
+    printf("overruns       %llu\n", (unsigned long long)stats.overruns);
+    printf("line errors    %llu\n", (unsigned long long)stats.line_errors);
+    printf("transfers      %llu (%llu short, %llu empty)\n",
+           (unsigned long long)stats.transfers,
+           (unsigned long long)stats.short_transfers,
+           (unsigned long long)stats.empty_transfers);
+    printf("max gap        %.3f ms\n", stats.max_gap * 1000.0);
+
+    if (err != 0 || stats.pattern.errors || stats.overruns)
+        return 2;
+    return EXIT_SUCCESS;
+}
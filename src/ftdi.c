@@ -33,16 +33,13 @@
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
+#include <sys/time.h>
 
-#include "ftdi_i.h"
 #include "ftdi.h"
+#include "ftdi_i.h"
 #include "ftdi_version_i.h"
 
-#define ftdi_error_return(code, str) do {  \
-        ftdi->error_str = str;             \
-        return code;                       \
-   } while(0);
-
 #define ftdi_error_return_free_device_list(code, str, devs) do {    \
         libusb_free_device_list(devs,1);   \
         ftdi->error_str = str;             \
@@ -63,6 +60,7 @@ static void ftdi_usb_close_internal (struct ftdi_context *ftdi)
 {
     if (ftdi && ftdi->usb_dev)
     {
+        ftdi_readahead_stop(ftdi);
         libusb_close (ftdi->usb_dev);
         ftdi->usb_dev = NULL;
         if(ftdi->eeprom)
@@ -70,19 +68,49 @@ static void ftdi_usb_close_internal (struct ftdi_context *ftdi)
     }
 }
 
-/**
-    Initializes a ftdi_context.
+/* libusb context shared by all contexts set up with ftdi_init_shared(ftdi, NULL) */
+static struct libusb_context *ftdi_shared_usb_ctx = NULL;
+static unsigned int ftdi_shared_usb_ctx_refs = 0;
 
-    \param ftdi pointer to ftdi_context
+/**
+    Internal function to take a reference on the library managed libusb
+    context, creating it on first use.
+    \internal
+*/
+static int ftdi_shared_usb_ctx_ref(struct libusb_context **usb_ctx)
+{
+    if (ftdi_shared_usb_ctx_refs == 0)
+    {
+        if (libusb_init(&ftdi_shared_usb_ctx) < 0)
+            return -1;
+    }
+    ftdi_shared_usb_ctx_refs++;
+    *usb_ctx = ftdi_shared_usb_ctx;
+    return 0;
+}
 
-    \retval  0: all fine
-    \retval -1: couldn't allocate read buffer
-    \retval -2: couldn't allocate struct  buffer
-    \retval -3: libusb_init() failed
+/**
+    Internal function to drop a reference on the library managed libusb
+    context, exiting it with the last one.
+    \internal
+*/
+static void ftdi_shared_usb_ctx_unref(void)
+{
+    if (ftdi_shared_usb_ctx_refs == 0)
+        return;
+    if (--ftdi_shared_usb_ctx_refs == 0)
+    {
+        libusb_exit(ftdi_shared_usb_ctx);
+        ftdi_shared_usb_ctx = NULL;
+    }
+}
 
-    \remark This should be called before all functions
+/**
+    Internal function behind ftdi_init() and ftdi_init_shared().
+    \internal
 */
-int ftdi_init(struct ftdi_context *ftdi)
+static int ftdi_init_internal(struct ftdi_context *ftdi, struct libusb_context *usb_ctx,
+                              enum ftdi_usb_ctx_mode usb_ctx_mode)
 {
     struct ftdi_eeprom* eeprom = (struct ftdi_eeprom *)malloc(sizeof(struct ftdi_eeprom));
     ftdi->usb_ctx = NULL;
@@ -98,23 +126,99 @@ int ftdi_init(struct ftdi_context *ftdi)
     ftdi->readbuffer_offset = 0;
     ftdi->readbuffer_remaining = 0;
     ftdi->writebuffer_chunksize = 4096;
+    ftdi->writebuffer_pipeline = 1;
     ftdi->max_packet_size = 0;
     ftdi->error_str = NULL;
     ftdi->module_detach_mode = AUTO_DETACH_SIO_MODULE;
+    ftdi->readahead = NULL;
+    ftdi->transfer_pool = NULL;
+    ftdi->eeprom = NULL;
 
-    if (libusb_init(&ftdi->usb_ctx) < 0)
-        ftdi_error_return(-3, "libusb_init() failed");
+    ftdi->usb_ctx_mode = usb_ctx_mode;
+    if (usb_ctx_mode == USB_CTX_OWN)
+    {
+        if (libusb_init(&ftdi->usb_ctx) < 0)
+        {
+            free(eeprom);
+            ftdi_error_return(-3, "libusb_init() failed");
+        }
+    }
+    else if (usb_ctx_mode == USB_CTX_SHARED)
+    {
+        if (ftdi_shared_usb_ctx_ref(&ftdi->usb_ctx) < 0)
+        {
+            free(eeprom);
+            ftdi_error_return(-3, "libusb_init() failed");
+        }
+    }
+    else
+        ftdi->usb_ctx = usb_ctx;
 
     ftdi_set_interface(ftdi, INTERFACE_ANY);
     ftdi->bitbang_mode = 1; /* when bitbang is enabled this holds the number of the mode  */
 
+    // From here on ftdi_deinit() gives back the libusb context
     if (eeprom == 0)
+    {
+        ftdi_deinit(ftdi);
         ftdi_error_return(-2, "Can't malloc struct ftdi_eeprom");
+    }
     memset(eeprom, 0, sizeof(struct ftdi_eeprom));
     ftdi->eeprom = eeprom;
 
     /* All fine. Now allocate the readbuffer */
-    return ftdi_read_data_set_chunksize(ftdi, 4096);
+    if (ftdi_read_data_set_chunksize(ftdi, 4096) < 0)
+    {
+        ftdi_deinit(ftdi);
+        ftdi_error_return(-1, "out of memory for readbuffer");
+    }
+    return 0;
+}
+
+/**
+    Initializes a ftdi_context.
+
+    \param ftdi pointer to ftdi_context
+
+    \retval  0: all fine
+    \retval -1: couldn't allocate read buffer
+    \retval -2: couldn't allocate struct  buffer
+    \retval -3: libusb_init() failed
+
+    \remark This should be called before all functions
+*/
+int ftdi_init(struct ftdi_context *ftdi)
+{
+    return ftdi_init_internal(ftdi, NULL, USB_CTX_OWN);
+}
+
+/**
+    Initializes a ftdi_context on a libusb context shared with other
+    ftdi_contexts.
+
+    All contexts on one libusb context can be serviced by a single event
+    loop (see ftdi_handle_events()) and share libusb's threads and file
+    descriptors. If \a usb_ctx is NULL, a libusb context managed by
+    libftdi is used; it is created by the first such ftdi_context and
+    exited when the last one is deinitialized. A caller provided context
+    is never exited by libftdi and must outlive the ftdi_context.
+
+    \param ftdi pointer to ftdi_context
+    \param usb_ctx libusb context to use or NULL for the library managed one
+
+    \retval  0: all fine
+    \retval -1: couldn't allocate read buffer
+    \retval -2: couldn't allocate struct  buffer
+    \retval -3: libusb_init() failed
+
+    \remark The library managed context is not protected against
+    concurrent ftdi_init_shared() / ftdi_deinit() calls from several threads.
+*/
+int ftdi_init_shared(struct ftdi_context *ftdi, struct libusb_context *usb_ctx)
+{
+    if (usb_ctx == NULL)
+        return ftdi_init_internal(ftdi, NULL, USB_CTX_SHARED);
+    return ftdi_init_internal(ftdi, usb_ctx, USB_CTX_EXTERNAL);
 }
 
 /**
@@ -140,6 +244,32 @@ struct ftdi_context *ftdi_new(void)
     return ftdi;
 }
 
+/**
+    Allocate and initialize a new ftdi_context on a shared libusb context.
+    See ftdi_init_shared().
+
+    \param usb_ctx libusb context to use or NULL for the library managed one
+
+    \return a pointer to a new ftdi_context, or NULL on failure
+*/
+struct ftdi_context *ftdi_new_shared(struct libusb_context *usb_ctx)
+{
+    struct ftdi_context * ftdi = (struct ftdi_context *)malloc(sizeof(struct ftdi_context));
+
+    if (ftdi == NULL)
+    {
+        return NULL;
+    }
+
+    if (ftdi_init_shared(ftdi, usb_ctx) != 0)
+    {
+        free(ftdi);
+        return NULL;
+    }
+
+    return ftdi;
+}
+
 /**
     Open selected channels on a chip, otherwise use first channel.
 
@@ -217,6 +347,13 @@ void ftdi_deinit(struct ftdi_context *ftdi)
         ftdi->readbuffer = NULL;
     }
 
+    if (ftdi->transfer_pool != NULL)
+    {
+        ftdi_transfer_pool_set_size(ftdi, 0);
+        free(ftdi->transfer_pool);
+        ftdi->transfer_pool = NULL;
+    }
+
     if (ftdi->eeprom != NULL)
     {
         if (ftdi->eeprom->manufacturer != 0)
@@ -240,7 +377,10 @@ void ftdi_deinit(struct ftdi_context *ftdi)
 
     if (ftdi->usb_ctx)
     {
-        libusb_exit(ftdi->usb_ctx);
+        if (ftdi->usb_ctx_mode == USB_CTX_OWN)
+            libusb_exit(ftdi->usb_ctx);
+        else if (ftdi->usb_ctx_mode == USB_CTX_SHARED)
+            ftdi_shared_usb_ctx_unref();
         ftdi->usb_ctx = NULL;
     }
 }
@@ -902,6 +1042,8 @@ int ftdi_usb_reset(struct ftdi_context *ftdi)
 */
 int ftdi_usb_purge_rx_buffer(struct ftdi_context *ftdi)
 {
+    int i;
+
     if (ftdi == NULL || ftdi->usb_dev == NULL)
         ftdi_error_return(-2, "USB device unavailable");
 
@@ -913,6 +1055,16 @@ int ftdi_usb_purge_rx_buffer(struct ftdi_context *ftdi)
     // Invalidate data in the readbuffer
     ftdi->readbuffer_offset = 0;
     ftdi->readbuffer_remaining = 0;
+    if (ftdi->readahead)
+    {
+        struct ftdi_readahead *ra = ftdi->readahead;
+
+        // Transfers in flight may still deliver data from before the purge
+        for (i = 0; i < ra->num_transfers; i++)
+            if (ra->transfers[i]->user_data != NULL)
+                ra->stale[i] = 1;
+        ra->ring_count = 0;
+    }
 
     return 0;
 }
@@ -1355,185 +1507,962 @@ int ftdi_set_line_property2(struct ftdi_context *ftdi, enum ftdi_bits_type bits,
 }
 
 /**
-    Writes data in chunks (see ftdi_write_data_set_chunksize()) to the chip
-
-    \param ftdi pointer to ftdi_context
-    \param buf Buffer with the data
-    \param size Size of the buffer
-
-    \retval -666: USB device unavailable
-    \retval <0: error code from usb_bulk_write()
-    \retval >0: number of bytes written
+    Strip the two modem status bytes the chip puts in front of every
+    max_packet_size packet of a bulk read, e.g. of a transfer of the
+    asynchronous or streaming API.
+
+    The payload is gathered from \a src to \a dst in a single pass with
+    one memmove() per packet, so the C library's vectorized copy routines
+    do the actual work. \a dst may point into \a src for in-place
+    compaction as payload never moves to a higher address.
+
+    \param dst Buffer to store the payload in
+    \param dst_size Maximum number of payload bytes to store
+    \param src Raw data as received from the bulk endpoint
+    \param src_len Number of raw bytes in src
+    \param packet_size Maximum packet size of the endpoint
+    \param skip Number of payload bytes to drop before storing
+
+    \retval >=0: number of payload bytes stored in dst
 */
-int ftdi_write_data(struct ftdi_context *ftdi, unsigned char *buf, int size)
+int ftdi_compact_packets(unsigned char *dst, int dst_size,
+                         const unsigned char *src, int src_len,
+                         int packet_size, int skip)
 {
-    int offset = 0;
-    int actual_length;
-
-    if (ftdi == NULL || ftdi->usb_dev == NULL)
-        ftdi_error_return(-666, "USB device unavailable");
+    int stored = 0;
 
-    while (offset < size)
+    while (src_len > 2 && stored < dst_size)
     {
-        int write_size = ftdi->writebuffer_chunksize;
+        int payload = ((src_len < packet_size) ? src_len : packet_size) - 2;
 
-        if (offset+write_size > size)
-            write_size = size-offset;
+        if (skip >= payload)
+            skip -= payload;
+        else
+        {
+            int part_size = payload - skip;
 
-        if (libusb_bulk_transfer(ftdi->usb_dev, ftdi->in_ep, buf+offset, write_size, &actual_length, ftdi->usb_write_timeout) < 0)
-            ftdi_error_return(-1, "usb bulk write failed");
+            if (part_size > dst_size - stored)
+                part_size = dst_size - stored;
 
-        offset += actual_length;
+            memmove(dst + stored, src + 2 + skip, part_size);
+            stored += part_size;
+            skip = 0;
+        }
+
+        src += packet_size;
+        src_len -= packet_size;
     }
 
-    return offset;
+    return stored;
 }
 
-static void ftdi_read_data_cb(struct libusb_transfer *transfer)
-{
-    struct ftdi_transfer_control *tc = (struct ftdi_transfer_control *) transfer->user_data;
-    struct ftdi_context *ftdi = tc->ftdi;
-    int packet_size, actual_length, num_of_chunks, chunk_remains, i, ret;
+/**
+    Internal function to read the clock used for timeouts, progress and
+    statistics. A monotonic clock is used where available, so setting
+    the wall clock neither stretches or cuts short a timeout nor
+    disturbs the rates.
+    \internal
 
-    packet_size = ftdi->max_packet_size;
+    \param tv set to the current time
+*/
+void ftdi_now(struct timeval *tv)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
 
-    actual_length = transfer->actual_length;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+    {
+        tv->tv_sec = ts.tv_sec;
+        tv->tv_usec = ts.tv_nsec / 1000;
+        return;
+    }
+#endif
+    gettimeofday(tv, NULL);
+}
 
-    if (actual_length > 2)
+/**
+    Internal function to compute the point in time \a timeout
+    milliseconds from now.
+    \internal
+*/
+static void ftdi_deadline(struct timeval *deadline, int timeout)
+{
+    ftdi_now(deadline);
+    deadline->tv_sec += timeout / 1000;
+    deadline->tv_usec += (timeout % 1000) * 1000;
+    if (deadline->tv_usec >= 1000000)
     {
-        // skip FTDI status bytes.
-        // Maybe stored in the future to enable modem use
-        num_of_chunks = actual_length / packet_size;
-        chunk_remains = actual_length % packet_size;
-        //printf("actual_length = %X, num_of_chunks = %X, chunk_remains = %X, readbuffer_offset = %X\n", actual_length, num_of_chunks, chunk_remains, ftdi->readbuffer_offset);
+        deadline->tv_usec -= 1000000;
+        deadline->tv_sec++;
+    }
+}
 
-        ftdi->readbuffer_offset += 2;
-        actual_length -= 2;
+/**
+    Internal function to compute the time left until \a deadline.
+    \internal
 
-        if (actual_length > packet_size - 2)
-        {
-            for (i = 1; i < num_of_chunks; i++)
-                memmove (ftdi->readbuffer+ftdi->readbuffer_offset+(packet_size - 2)*i,
-                         ftdi->readbuffer+ftdi->readbuffer_offset+packet_size*i,
-                         packet_size - 2);
-            if (chunk_remains > 2)
-            {
-                memmove (ftdi->readbuffer+ftdi->readbuffer_offset+(packet_size - 2)*i,
-                         ftdi->readbuffer+ftdi->readbuffer_offset+packet_size*i,
-                         chunk_remains-2);
-                actual_length -= 2*num_of_chunks;
-            }
-            else
-                actual_length -= 2*(num_of_chunks-1)+chunk_remains;
-        }
+    \retval 0: deadline passed
+    \retval 1: time left stored in tv
+*/
+static int ftdi_deadline_remaining(const struct timeval *deadline, struct timeval *tv)
+{
+    struct timeval now;
 
-        if (actual_length > 0)
-        {
-            // data still fits in buf?
-            if (tc->offset + actual_length <= tc->size)
-            {
-                memcpy (tc->buf + tc->offset, ftdi->readbuffer + ftdi->readbuffer_offset, actual_length);
-                //printf("buf[0] = %X, buf[1] = %X\n", buf[0], buf[1]);
-                tc->offset += actual_length;
+    ftdi_now(&now);
+    tv->tv_sec = deadline->tv_sec - now.tv_sec;
+    tv->tv_usec = deadline->tv_usec - now.tv_usec;
+    if (tv->tv_usec < 0)
+    {
+        tv->tv_usec += 1000000;
+        tv->tv_sec--;
+    }
+    return tv->tv_sec >= 0;
+}
 
-                ftdi->readbuffer_offset = 0;
-                ftdi->readbuffer_remaining = 0;
+/**
+    Internal function to get the transfer pool of a context. The pool is
+    created with the default size on first use.
+    \internal
 
-                /* Did we read exactly the right amount of bytes? */
-                if (tc->offset == tc->size)
-                {
-                    //printf("read_data exact rem %d offset %d\n",
-                    //ftdi->readbuffer_remaining, offset);
-                    tc->completed = 1;
-                    return;
-                }
-            }
-            else
-            {
-                // only copy part of the data or size <= readbuffer_chunksize
-                int part_size = tc->size - tc->offset;
-                memcpy (tc->buf + tc->offset, ftdi->readbuffer + ftdi->readbuffer_offset, part_size);
-                tc->offset += part_size;
+    \retval NULL: out of memory
+*/
+static struct ftdi_transfer_pool *ftdi_transfer_pool(struct ftdi_context *ftdi)
+{
+    if (ftdi->transfer_pool == NULL)
+        ftdi_transfer_pool_set_size(ftdi, FTDI_TRANSFER_POOL_SIZE);
+    return ftdi->transfer_pool;
+}
 
-                ftdi->readbuffer_offset += part_size;
-                ftdi->readbuffer_remaining = actual_length - part_size;
+/**
+    Internal function to get a ftdi_transfer_control, recycled if possible.
+    \internal
+*/
+static struct ftdi_transfer_control *ftdi_transfer_control_get(struct ftdi_context *ftdi)
+{
+    struct ftdi_transfer_pool *pool = ftdi_transfer_pool(ftdi);
 
-                /* printf("Returning part: %d - size: %d - offset: %d - actual_length: %d - remaining: %d\n",
-                part_size, size, offset, actual_length, ftdi->readbuffer_remaining); */
-                tc->completed = 1;
-                return;
-            }
-        }
+    if (pool && pool->num_tcs > 0)
+    {
+        pool->stats.tc_hits++;
+        return pool->tcs[--pool->num_tcs];
     }
-    ret = libusb_submit_transfer (transfer);
-    if (ret < 0)
-        tc->completed = 1;
-}
 
+    if (pool)
+        pool->stats.tc_misses++;
+    return (struct ftdi_transfer_control *) malloc (sizeof (struct ftdi_transfer_control));
+}
 
-static void ftdi_write_data_cb(struct libusb_transfer *transfer)
+/**
+    Internal function to get a libusb_transfer, recycled if possible.
+    \internal
+*/
+static struct libusb_transfer *ftdi_transfer_get(struct ftdi_context *ftdi)
 {
-    struct ftdi_transfer_control *tc = (struct ftdi_transfer_control *) transfer->user_data;
-    struct ftdi_context *ftdi = tc->ftdi;
-
-    tc->offset += transfer->actual_length;
+    struct ftdi_transfer_pool *pool = ftdi_transfer_pool(ftdi);
 
-    if (tc->offset == tc->size)
+    if (pool && pool->num_transfers > 0)
     {
-        tc->completed = 1;
+        pool->stats.transfer_hits++;
+        return pool->transfers[--pool->num_transfers];
     }
+
+    if (pool)
+        pool->stats.transfer_misses++;
+    return libusb_alloc_transfer(0);
+}
+
+/**
+    Internal function to hand back a libusb_transfer to the pool.
+    \internal
+*/
+static void ftdi_transfer_put(struct ftdi_context *ftdi, struct libusb_transfer *transfer)
+{
+    struct ftdi_transfer_pool *pool = ftdi->transfer_pool;
+
+    if (pool && pool->num_transfers < pool->size)
+        pool->transfers[pool->num_transfers++] = transfer;
     else
-    {
-        int write_size = ftdi->writebuffer_chunksize;
-        int ret;
+        libusb_free_transfer(transfer);
+}
 
-        if (tc->offset + write_size > tc->size)
-            write_size = tc->size - tc->offset;
+/**
+    Internal function to hand back a ftdi_transfer_control and its
+    libusb_transfer to the pool.
+    \internal
+*/
+static void ftdi_transfer_control_put(struct ftdi_transfer_control *tc)
+{
+    struct ftdi_context *ftdi = tc->ftdi;
+    struct ftdi_transfer_pool *pool = ftdi->transfer_pool;
 
-        transfer->length = write_size;
-        transfer->buffer = tc->buf + tc->offset;
-        ret = libusb_submit_transfer (transfer);
-        if (ret < 0)
-            tc->completed = 1;
+    if (tc->transfer)
+    {
+        ftdi_transfer_put(ftdi, tc->transfer);
+        tc->transfer = NULL;
     }
-}
 
+    if (pool && pool->num_tcs < pool->size)
+        pool->tcs[pool->num_tcs++] = tc;
+    else
+        free(tc);
+}
 
 /**
-    Writes data to the chip. Does not wait for completion of the transfer
-    nor does it make sure that the transfer was successful.
+    Configure the number of idle objects kept for reuse by the
+    asynchronous API.
 
-    Use libusb 1.0 asynchronous API.
+    ftdi_write_data_submit() and ftdi_read_data_submit() take their
+    ftdi_transfer_control and libusb_transfer from per-context free lists,
+    ftdi_transfer_data_done() puts them back. Up to \a size objects of
+    each kind are kept, so steady state asynchronous I/O does not
+    allocate memory. Default is 8, 0 disables the pool.
 
     \param ftdi pointer to ftdi_context
-    \param buf Buffer with the data
-    \param size Size of the buffer
+    \param size Maximum number of idle objects of each kind
 
-    \retval NULL: Some error happens when submit transfer
-    \retval !NULL: Pointer to a ftdi_transfer_control
+    \retval  0: all fine
+    \retval -1: ftdi context invalid
+    \retval -2: out of memory
 */
-
-struct ftdi_transfer_control *ftdi_write_data_submit(struct ftdi_context *ftdi, unsigned char *buf, int size)
+int ftdi_transfer_pool_set_size(struct ftdi_context *ftdi, unsigned int size)
 {
-    struct ftdi_transfer_control *tc;
-    struct libusb_transfer *transfer;
-    int write_size, ret;
-
-    if (ftdi == NULL || ftdi->usb_dev == NULL)
-        return NULL;
+    struct ftdi_transfer_pool *pool;
 
-    tc = (struct ftdi_transfer_control *) malloc (sizeof (*tc));
-    if (!tc)
-        return NULL;
+    if (ftdi == NULL)
+        ftdi_error_return(-1, "ftdi context invalid");
 
-    transfer = libusb_alloc_transfer(0);
-    if (!transfer)
+    pool = ftdi->transfer_pool;
+    if (pool == NULL)
     {
-        free(tc);
-        return NULL;
+        pool = (struct ftdi_transfer_pool *)calloc(1, sizeof(*pool));
+        if (pool == NULL)
+            ftdi_error_return(-2, "out of memory for transfer pool");
+        ftdi->transfer_pool = pool;
     }
 
+    // Drop what doesn't fit anymore
+    while (pool->num_tcs > size)
+        free(pool->tcs[--pool->num_tcs]);
+    while (pool->num_transfers > size)
+        libusb_free_transfer(pool->transfers[--pool->num_transfers]);
+
+    if (size == 0)
+    {
+        free(pool->tcs);
+        free(pool->transfers);
+        pool->tcs = NULL;
+        pool->transfers = NULL;
+    }
+    else
+    {
+        struct ftdi_transfer_control **tcs;
+        struct libusb_transfer **transfers;
+
+        tcs = (struct ftdi_transfer_control **)realloc(pool->tcs, size * sizeof(*tcs));
+        if (tcs == NULL)
+            ftdi_error_return(-2, "out of memory for transfer pool");
+        pool->tcs = tcs;
+
+        transfers = (struct libusb_transfer **)realloc(pool->transfers, size * sizeof(*transfers));
+        if (transfers == NULL)
+            ftdi_error_return(-2, "out of memory for transfer pool");
+        pool->transfers = transfers;
+    }
+
+    pool->size = size;
+    return 0;
+}
+
+/**
+    Get the hit/miss counters of the transfer pool.
+
+    \param ftdi pointer to ftdi_context
+    \param stats Pointer to store the counters in
+
+    \retval  0: all fine
+    \retval -1: ftdi context invalid
+*/
+int ftdi_transfer_pool_get_stats(struct ftdi_context *ftdi, struct ftdi_transfer_pool_stats *stats)
+{
+    if (ftdi == NULL || stats == NULL)
+        ftdi_error_return(-1, "ftdi context invalid");
+
+    if (ftdi->transfer_pool)
+        *stats = ftdi->transfer_pool->stats;
+    else
+        memset(stats, 0, sizeof(*stats));
+    return 0;
+}
+
+/**
+    Internal function to get the result of a finished transfer.
+    \internal
+
+    \retval >= 0: Data size transferred
+    \retval   -1: error, timeout or cancelled
+*/
+static int ftdi_transfer_control_result(struct ftdi_transfer_control *tc)
+{
+    int status = tc->transfer ? tc->transfer->status : tc->status;
+
+    if (status != LIBUSB_TRANSFER_COMPLETED)
+        return -1;
+    return tc->offset;
+}
+
+/**
+    Internal function to mark a transfer as finished. Transfers with a
+    completion callback are handed to it and released afterwards.
+    \internal
+
+    \param tc pointer to ftdi_transfer_control
+*/
+static void ftdi_transfer_control_complete(struct ftdi_transfer_control *tc)
+{
+    tc->completed = 1;
+    if (tc->callback == NULL)
+        return;
+
+    tc->callback(tc, ftdi_transfer_control_result(tc), tc->userdata);
+    ftdi_transfer_control_put(tc);
+}
+
+/**
+    Internal function to store the payload of a completed read-ahead
+    transfer in the ring buffer.
+    \internal
+*/
+static void ftdi_readahead_store(struct ftdi_context *ftdi, struct libusb_transfer *transfer)
+{
+    struct ftdi_readahead *ra = ftdi->readahead;
+    unsigned int tail = (ra->ring_head + ra->ring_count) % ra->ring_size;
+    unsigned int linear = ra->ring_size - tail;
+    int stored;
+
+    if (linear > ra->ring_size - ra->ring_count)
+        linear = ra->ring_size - ra->ring_count;
+
+    stored = ftdi_compact_packets(ra->ring + tail, linear, transfer->buffer,
+                                  transfer->actual_length, ftdi->max_packet_size, 0);
+    // wrap around
+    stored += ftdi_compact_packets(ra->ring, ra->ring_size - ra->ring_count - stored,
+                                   transfer->buffer, transfer->actual_length,
+                                   ftdi->max_packet_size, stored);
+    ra->ring_count += stored;
+}
+
+/**
+    Internal function to take up to size bytes out of the read-ahead ring.
+    \internal
+
+    \retval number of bytes copied to buf
+*/
+static int ftdi_readahead_fetch(struct ftdi_readahead *ra, unsigned char *buf, int size)
+{
+    unsigned int part_size, copied = 0;
+
+    while (ra->ring_count > 0 && copied < (unsigned int)size)
+    {
+        part_size = ra->ring_size - ra->ring_head;
+        if (part_size > ra->ring_count)
+            part_size = ra->ring_count;
+        if (part_size > size - copied)
+            part_size = size - copied;
+
+        memcpy(buf + copied, ra->ring + ra->ring_head, part_size);
+        copied += part_size;
+        ra->ring_head = (ra->ring_head + part_size) % ra->ring_size;
+        ra->ring_count -= part_size;
+    }
+    return copied;
+}
+
+/**
+    Internal function to (re)submit parked read-ahead transfers as long as
+    the ring buffer has room for their payload.
+    \internal
+*/
+static void ftdi_readahead_kick(struct ftdi_context *ftdi)
+{
+    struct ftdi_readahead *ra = ftdi->readahead;
+    int i;
+
+    for (i = 0; i < ra->num_transfers && ra->parked > 0 && !ra->stopping && !ra->error; i++)
+    {
+        struct libusb_transfer *transfer = ra->transfers[i];
+
+        if (transfer->user_data != NULL)
+            continue;
+
+        // each transfer in flight may deliver up to transfer_size bytes
+        if (ra->ring_size - ra->ring_count < (unsigned int)(ra->in_flight + 1) * ra->transfer_size)
+            break;
+
+        transfer->user_data = ra;
+        if (libusb_submit_transfer(transfer) < 0)
+        {
+            transfer->user_data = NULL;
+            ra->error = LIBUSB_ERROR_IO;
+            break;
+        }
+        ra->parked--;
+        ra->in_flight++;
+    }
+}
+
+/**
+    Internal function to hand buffered read-ahead data to a pending
+    asynchronous read. The read ends with what it got once it times out.
+    \internal
+*/
+static void ftdi_readahead_feed_pending(struct ftdi_context *ftdi)
+{
+    struct ftdi_readahead *ra = ftdi->readahead;
+    struct ftdi_transfer_control *tc = ra->pending;
+    struct timeval left;
+
+    if (tc == NULL)
+        return;
+
+    tc->offset += ftdi_readahead_fetch(ra, tc->buf + tc->offset, tc->size - tc->offset);
+    if (tc->offset == tc->size || ra->error ||
+        !ftdi_deadline_remaining(&ra->pending_deadline, &left))
+    {
+        if (tc->offset < tc->size)
+            tc->status = ra->error ? LIBUSB_TRANSFER_ERROR : LIBUSB_TRANSFER_TIMED_OUT;
+        ra->pending = NULL;
+        ftdi_transfer_control_complete(tc);
+    }
+}
+
+/**
+    Internal function to free the read-ahead engine, none of its
+    transfers may be in flight.
+    \internal
+*/
+static void ftdi_readahead_free(struct ftdi_readahead *ra)
+{
+    int i;
+
+    if (ra->transfers)
+    {
+        for (i = 0; i < ra->num_transfers; i++)
+        {
+            if (ra->transfers[i] == NULL)
+                continue;
+            free(ra->transfers[i]->buffer);
+            libusb_free_transfer(ra->transfers[i]);
+        }
+        free(ra->transfers);
+    }
+    free(ra->stale);
+    free(ra->ring);
+    free(ra);
+}
+
+/**
+    Completion handler of the read-ahead transfers.
+    \internal
+
+    A NULL user_data marks a transfer as parked.
+*/
+static void ftdi_readahead_cb(struct libusb_transfer *transfer)
+{
+    struct ftdi_readahead *ra = (struct ftdi_readahead *) transfer->user_data;
+    struct ftdi_context *ftdi = ra->ftdi;
+    int i, stale = 0;
+
+    ra->in_flight--;
+    ra->completions++;
+    transfer->user_data = NULL;
+    ra->parked++;
+
+    for (i = 0; i < ra->num_transfers; i++)
+    {
+        if (ra->transfers[i] == transfer)
+        {
+            stale = ra->stale[i];
+            ra->stale[i] = 0;
+            break;
+        }
+    }
+
+    if (ra->stopping)
+    {
+        if (ra->orphaned && ra->in_flight == 0)
+            ftdi_readahead_free(ra);
+        return;
+    }
+
+    // a timed out transfer may still carry some packets
+    if (transfer->status == LIBUSB_TRANSFER_COMPLETED ||
+        transfer->status == LIBUSB_TRANSFER_TIMED_OUT)
+    {
+        if (!stale && transfer->actual_length > 0)
+            ftdi_readahead_store(ftdi, transfer);
+    }
+    else
+        ra->error = LIBUSB_ERROR_IO;
+
+    ftdi_readahead_feed_pending(ftdi);
+    ftdi_readahead_kick(ftdi);
+}
+
+/**
+    Internal function to wait until the next read-ahead transfer completes.
+    \internal
+
+    \retval  0: a transfer completed
+    \retval <0: libusb error or LIBUSB_ERROR_TIMEOUT
+*/
+static int ftdi_readahead_wait(struct ftdi_context *ftdi)
+{
+    struct ftdi_readahead *ra = ftdi->readahead;
+    unsigned int completions = ra->completions;
+    struct timeval deadline;
+
+    ftdi_deadline(&deadline, ftdi->usb_read_timeout);
+
+    while (ra->completions == completions)
+    {
+        struct timeval tv;
+        int ret;
+
+        if (ra->error)
+            return ra->error;
+        if (ra->in_flight == 0)
+            return LIBUSB_ERROR_IO;
+
+        if (!ftdi_deadline_remaining(&deadline, &tv))
+            return LIBUSB_ERROR_TIMEOUT;
+
+        ret = libusb_handle_events_timeout(ftdi->usb_ctx, &tv);
+        if (ret < 0 && ret != LIBUSB_ERROR_INTERRUPTED)
+            return ret;
+    }
+    return 0;
+}
+
+/**
+    Internal read path of ftdi_read_data() while read-ahead is active.
+    \internal
+*/
+static int ftdi_readahead_read_data(struct ftdi_context *ftdi, unsigned char *buf, int size)
+{
+    struct ftdi_readahead *ra = ftdi->readahead;
+    int offset, part_size, ret;
+
+    offset = ftdi_readahead_fetch(ra, buf, size);
+    ftdi_readahead_kick(ftdi);
+
+    while (offset < size)
+    {
+        ret = ftdi_readahead_wait(ftdi);
+        if (ret < 0)
+        {
+            if (offset > 0 || ret == LIBUSB_ERROR_TIMEOUT)
+                return offset;
+            ftdi_error_return(ret, "usb bulk read failed");
+        }
+
+        part_size = ftdi_readahead_fetch(ra, buf + offset, size - offset);
+        ftdi_readahead_kick(ftdi);
+
+        // no more data to read?
+        if (part_size == 0)
+            break;
+        offset += part_size;
+    }
+    return offset;
+}
+
+/**
+    Start the read-ahead engine.
+
+    Keeps \a num_transfers bulk-IN transfers of the current read chunk
+    size (see ftdi_read_data_set_chunksize()) queued all the time, so the
+    chip's FIFO gets emptied even while the application is busy. The
+    payload is collected in a ring buffer of \a ringsize bytes from which
+    ftdi_read_data() and ftdi_read_data_submit() take their data.
+
+    Transfers are only resubmitted while the ring buffer has room for
+    their payload, so nothing gets lost if the application falls behind.
+    ftdi_usb_purge_rx_buffer() empties the ring buffer and drops the
+    payload of the transfers that were in flight during the purge.
+    USB events are handled inside the read functions, the
+    ftdi_transfer_data_done() call of another transfer or any other
+    libusb event handling on ftdi->usb_ctx.
+
+    \param ftdi pointer to ftdi_context
+    \param num_transfers Number of transfers to keep queued
+    \param ringsize Size of the ring buffer. 0 selects
+           2 * num_transfers * read chunk size.
+
+    \retval  0: all fine
+    \retval -1: invalid number of transfers or ring buffer too small
+    \retval -2: out of memory
+    \retval -3: submitting the transfers failed
+    \retval -4: read-ahead already active
+    \retval -666: USB device unavailable
+*/
+int ftdi_readahead_start(struct ftdi_context *ftdi, int num_transfers, unsigned int ringsize)
+{
+    struct ftdi_readahead *ra;
+    int i;
+
+    if (ftdi == NULL || ftdi->usb_dev == NULL)
+        ftdi_error_return(-666, "USB device unavailable");
+
+    if (ftdi->readahead != NULL)
+        ftdi_error_return(-4, "read-ahead already active");
+
+    if (num_transfers < 1)
+        ftdi_error_return(-1, "invalid number of read-ahead transfers");
+
+    if (ringsize == 0)
+        ringsize = 2 * num_transfers * ftdi->readbuffer_chunksize;
+    if (ringsize < ftdi->readbuffer_chunksize)
+        ftdi_error_return(-1, "read-ahead ring buffer smaller than read chunk size");
+
+    ra = (struct ftdi_readahead *)calloc(1, sizeof(*ra));
+    if (ra == NULL)
+        ftdi_error_return(-2, "out of memory for read-ahead");
+
+    ra->ftdi = ftdi;
+    ra->num_transfers = num_transfers;
+    ra->transfer_size = ftdi->readbuffer_chunksize;
+    ra->ring_size = ringsize;
+    ra->ring = (unsigned char *)malloc(ringsize);
+    ra->transfers = (struct libusb_transfer **)calloc(num_transfers, sizeof(*ra->transfers));
+    ra->stale = (unsigned char *)calloc(num_transfers, sizeof(*ra->stale));
+    ftdi->readahead = ra;
+    if (ra->ring == NULL || ra->transfers == NULL || ra->stale == NULL)
+    {
+        ftdi_readahead_stop(ftdi);
+        ftdi_error_return(-2, "out of memory for read-ahead");
+    }
+
+    for (i = 0; i < num_transfers; i++)
+    {
+        struct libusb_transfer *transfer = libusb_alloc_transfer(0);
+        unsigned char *buffer = (unsigned char *)malloc(ra->transfer_size);
+
+        if (transfer == NULL || buffer == NULL)
+        {
+            if (transfer)
+                libusb_free_transfer(transfer);
+            free(buffer);
+            ftdi_readahead_stop(ftdi);
+            ftdi_error_return(-2, "out of memory for read-ahead");
+        }
+
+        libusb_fill_bulk_transfer(transfer, ftdi->usb_dev, ftdi->out_ep, buffer,
+                                  ra->transfer_size, ftdi_readahead_cb, NULL,
+                                  ftdi->usb_read_timeout);
+        ra->transfers[i] = transfer;
+        ra->parked++;
+    }
+
+    // Hand over what is left in the readbuffer
+    if (ftdi->readbuffer_remaining > 0)
+    {
+        if (ftdi->readbuffer_remaining > ra->ring_size)
+            ftdi->readbuffer_remaining = ra->ring_size;
+        memcpy(ra->ring, ftdi->readbuffer + ftdi->readbuffer_offset, ftdi->readbuffer_remaining);
+        ra->ring_count = ftdi->readbuffer_remaining;
+    }
+    ftdi->readbuffer_offset = 0;
+    ftdi->readbuffer_remaining = 0;
+
+    ftdi_readahead_kick(ftdi);
+    if (ra->error)
+    {
+        ftdi_readahead_stop(ftdi);
+        ftdi_error_return(-3, "submitting read-ahead transfers failed");
+    }
+
+    return 0;
+}
+
+/**
+    Stop the read-ahead engine.
+
+    Cancels the queued transfers and frees the ring buffer. Data still
+    in the ring buffer is discarded. Should event handling fail while
+    transfers are still in flight, these stay allocated until libusb
+    finishes them.
+
+    \param ftdi pointer to ftdi_context
+
+    \retval  0: all fine
+    \retval -1: ftdi context invalid
+*/
+int ftdi_readahead_stop(struct ftdi_context *ftdi)
+{
+    struct ftdi_readahead *ra;
+    int i;
+
+    if (ftdi == NULL)
+        ftdi_error_return(-1, "ftdi context invalid");
+
+    ra = ftdi->readahead;
+    if (ra == NULL)
+        return 0;
+
+    ra->stopping = 1;
+    if (ra->transfers)
+    {
+        for (i = 0; i < ra->num_transfers; i++)
+            if (ra->transfers[i] && ra->transfers[i]->user_data != NULL)
+                libusb_cancel_transfer(ra->transfers[i]);
+
+        while (ra->in_flight > 0)
+            if (libusb_handle_events(ftdi->usb_ctx) < 0)
+                break;
+    }
+
+    if (ra->pending)
+    {
+        struct ftdi_transfer_control *tc = ra->pending;
+
+        ra->pending = NULL;
+        tc->status = LIBUSB_TRANSFER_CANCELLED;
+        ftdi_transfer_control_complete(tc);
+    }
+
+    ftdi->readahead = NULL;
+    // Transfers libusb still owns are not freed, the last one frees ra
+    if (ra->in_flight > 0)
+        ra->orphaned = 1;
+    else
+        ftdi_readahead_free(ra);
+
+    return 0;
+}
+
+/**
+    Internal write path of ftdi_write_data() with more than one chunk
+    in flight.
+    \internal
+
+    Keeps up to writebuffer_pipeline chunks submitted via
+    ftdi_write_data_submit() and always waits for the oldest one.
+    Bulk transfers to the same endpoint complete in order.
+*/
+static int ftdi_write_data_pipelined(struct ftdi_context *ftdi, unsigned char *buf, int size)
+{
+    struct ftdi_transfer_control **tcs;
+    int depth = ftdi->writebuffer_pipeline;
+    int offset = 0, written = 0, head = 0, count = 0, failed = 0;
+
+    tcs = (struct ftdi_transfer_control **)calloc(depth, sizeof(*tcs));
+    if (tcs == NULL)
+        ftdi_error_return(-1, "out of memory for write pipeline");
+
+    do
+    {
+        int ret;
+
+        while (!failed && count < depth && offset < size)
+        {
+            int write_size = ftdi->writebuffer_chunksize;
+            struct ftdi_transfer_control *tc;
+
+            if (offset+write_size > size)
+                write_size = size-offset;
+
+            tc = ftdi_write_data_submit(ftdi, buf+offset, write_size);
+            if (tc == NULL)
+            {
+                failed = 1;
+                break;
+            }
+            tcs[(head+count) % depth] = tc;
+            count++;
+            offset += write_size;
+        }
+
+        if (count == 0)
+            break;
+
+        // wait for the oldest chunk, the others keep the bus busy
+        ret = ftdi_transfer_data_done(tcs[head]);
+        head = (head+1) % depth;
+        count--;
+
+        if (ret < 0)
+            failed = 1;
+        else
+            written += ret;
+    }
+    while (count > 0 || (!failed && offset < size));
+
+    free(tcs);
+
+    if (failed)
+        ftdi_error_return(-1, "usb bulk write failed");
+
+    return written;
+}
+
+/**
+    Writes data in chunks (see ftdi_write_data_set_chunksize()) to the chip
+
+    With a write pipeline configured (see ftdi_write_data_set_pipeline())
+    several chunks are in flight at once. The function still returns only
+    after all of them are acknowledged.
+
+    \param ftdi pointer to ftdi_context
+    \param buf Buffer with the data
+    \param size Size of the buffer
+
+    \retval -666: USB device unavailable
+    \retval <0: error code from usb_bulk_write()
+    \retval >0: number of bytes written
+*/
+int ftdi_write_data(struct ftdi_context *ftdi, unsigned char *buf, int size)
+{
+    int offset = 0;
+    int actual_length;
+
+    if (ftdi == NULL || ftdi->usb_dev == NULL)
+        ftdi_error_return(-666, "USB device unavailable");
+
+    if (ftdi->writebuffer_pipeline > 1 && size > ftdi->writebuffer_chunksize)
+        return ftdi_write_data_pipelined(ftdi, buf, size);
+
+    while (offset < size)
+    {
+        int write_size = ftdi->writebuffer_chunksize;
+
+        if (offset+write_size > size)
+            write_size = size-offset;
+
+        if (libusb_bulk_transfer(ftdi->usb_dev, ftdi->in_ep, buf+offset, write_size, &actual_length, ftdi->usb_write_timeout) < 0)
+            ftdi_error_return(-1, "usb bulk write failed");
+
+        offset += actual_length;
+    }
+
+    return offset;
+}
+
+static void ftdi_read_data_cb(struct libusb_transfer *transfer)
+{
+    struct ftdi_transfer_control *tc = (struct ftdi_transfer_control *) transfer->user_data;
+    struct ftdi_context *ftdi = tc->ftdi;
+    int packet_size, actual_length, part_size, ret;
+
+    packet_size = ftdi->max_packet_size;
+
+    actual_length = transfer->actual_length;
+
+    if (actual_length > 2)
+    {
+        // skip FTDI status bytes while copying the payload to buf.
+        // Maybe stored in the future to enable modem use
+        part_size = ftdi_compact_packets(tc->buf + tc->offset, tc->size - tc->offset,
+                                         ftdi->readbuffer, actual_length, packet_size, 0);
+        tc->offset += part_size;
+
+        if (tc->offset == tc->size)
+        {
+            // keep what didn't fit into buf for the next read
+            ftdi->readbuffer_offset = 0;
+            ftdi->readbuffer_remaining = ftdi_compact_packets(ftdi->readbuffer, ftdi->readbuffer_chunksize,
+                                         ftdi->readbuffer, actual_length,
+                                         packet_size, part_size);
+            ftdi_transfer_control_complete(tc);
+            return;
+        }
+    }
+
+    // error, timeout or cancelled
+    if (transfer->status != LIBUSB_TRANSFER_COMPLETED)
+    {
+        ftdi_transfer_control_complete(tc);
+        return;
+    }
+
+    ret = libusb_submit_transfer (transfer);
+    if (ret < 0)
+    {
+        transfer->status = LIBUSB_TRANSFER_ERROR;
+        ftdi_transfer_control_complete(tc);
+    }
+}
+
+
+static void ftdi_write_data_cb(struct libusb_transfer *transfer)
+{
+    struct ftdi_transfer_control *tc = (struct ftdi_transfer_control *) transfer->user_data;
+    struct ftdi_context *ftdi = tc->ftdi;
+
+    tc->offset += transfer->actual_length;
+
+    if (tc->offset == tc->size || transfer->status != LIBUSB_TRANSFER_COMPLETED)
+    {
+        // all written, or error, timeout or cancelled
+        ftdi_transfer_control_complete(tc);
+    }
+    else
+    {
+        int write_size = ftdi->writebuffer_chunksize;
+        int ret;
+
+        if (tc->offset + write_size > tc->size)
+            write_size = tc->size - tc->offset;
+
+        transfer->length = write_size;
+        transfer->buffer = tc->buf + tc->offset;
+        ret = libusb_submit_transfer (transfer);
+        if (ret < 0)
+        {
+            transfer->status = LIBUSB_TRANSFER_ERROR;
+            ftdi_transfer_control_complete(tc);
+        }
+    }
+}
+
+
+/**
+    Internal function to submit an asynchronous write.
+    \internal
+
+    \param ftdi pointer to ftdi_context
+    \param buf Buffer with the data
+    \param size Size of the buffer
+    \param callback Completion callback or NULL
+    \param userdata User data for the callback
+
+    \retval NULL: Some error happens when submit transfer
+    \retval !NULL: Pointer to a ftdi_transfer_control
+*/
+static struct ftdi_transfer_control *ftdi_write_data_submit_internal(struct ftdi_context *ftdi, unsigned char *buf, int size,
+                                                                     FTDITransferCallback *callback, void *userdata)
+{
+    struct ftdi_transfer_control *tc;
+    struct libusb_transfer *transfer;
+    int write_size, ret;
+
+    if (ftdi == NULL || ftdi->usb_dev == NULL)
+        return NULL;
+
+    tc = ftdi_transfer_control_get(ftdi);
+    if (!tc)
+        return NULL;
+
     tc->ftdi = ftdi;
+    tc->transfer = ftdi_transfer_get(ftdi);
+    if (!tc->transfer)
+    {
+        ftdi_transfer_control_put(tc);
+        return NULL;
+    }
+    transfer = tc->transfer;
+
+    tc->callback = callback;
+    tc->userdata = userdata;
     tc->completed = 0;
     tc->buf = buf;
     tc->size = size;
@@ -1552,30 +2481,78 @@ struct ftdi_transfer_control *ftdi_write_data_submit(struct ftdi_context *ftdi,
     ret = libusb_submit_transfer(transfer);
     if (ret < 0)
     {
-        libusb_free_transfer(transfer);
-        free(tc);
+        ftdi_transfer_control_put(tc);
         return NULL;
     }
-    tc->transfer = transfer;
 
-    return tc;
+    return tc;
+}
+
+/**
+    Writes data to the chip. Does not wait for completion of the transfer
+    nor does it make sure that the transfer was successful.
+
+    Use libusb 1.0 asynchronous API.
+
+    \param ftdi pointer to ftdi_context
+    \param buf Buffer with the data
+    \param size Size of the buffer
+
+    \retval NULL: Some error happens when submit transfer
+    \retval !NULL: Pointer to a ftdi_transfer_control
+*/
+
+struct ftdi_transfer_control *ftdi_write_data_submit(struct ftdi_context *ftdi, unsigned char *buf, int size)
+{
+    return ftdi_write_data_submit_internal(ftdi, buf, size, NULL, NULL);
+}
+
+/**
+    Writes data to the chip and calls \a callback when done.
+
+    Use libusb 1.0 asynchronous API. The callback runs from libusb event
+    handling once all data is written, an error occured or the transfer
+    timed out. The ftdi_transfer_control is released after the callback
+    returns, do not call ftdi_transfer_data_done() on it.
+
+    \param ftdi pointer to ftdi_context
+    \param buf Buffer with the data
+    \param size Size of the buffer
+    \param callback Completion callback
+    \param userdata User data handed to the callback
+
+    \retval  0: transfer submitted
+    \retval -1: submitting the transfer failed
+    \retval -666: USB device unavailable
+*/
+int ftdi_write_data_submit_cb(struct ftdi_context *ftdi, unsigned char *buf, int size,
+                              FTDITransferCallback *callback, void *userdata)
+{
+    if (ftdi == NULL || ftdi->usb_dev == NULL)
+        ftdi_error_return(-666, "USB device unavailable");
+
+    if (ftdi_write_data_submit_internal(ftdi, buf, size, callback, userdata) == NULL)
+        ftdi_error_return(-1, "submitting usb bulk write failed");
+
+    return 0;
 }
 
 /**
-    Reads data from the chip. Does not wait for completion of the transfer
-    nor does it make sure that the transfer was successful.
-
-    Use libusb 1.0 asynchronous API.
+    Internal function to submit an asynchronous read.
+    \internal
 
     \param ftdi pointer to ftdi_context
-    \param buf Buffer with the data
+    \param buf Buffer to store data in
     \param size Size of the buffer
+    \param callback Completion callback or NULL
+    \param userdata User data for the callback
 
     \retval NULL: Some error happens when submit transfer
-    \retval !NULL: Pointer to a ftdi_transfer_control
+    \retval !NULL: Pointer to a ftdi_transfer_control, which is already
+            released if the callback ran during submission
 */
-
-struct ftdi_transfer_control *ftdi_read_data_submit(struct ftdi_context *ftdi, unsigned char *buf, int size)
+static struct ftdi_transfer_control *ftdi_read_data_submit_internal(struct ftdi_context *ftdi, unsigned char *buf, int size,
+                                                                    FTDITransferCallback *callback, void *userdata)
 {
     struct ftdi_transfer_control *tc;
     struct libusb_transfer *transfer;
@@ -1584,13 +2561,36 @@ struct ftdi_transfer_control *ftdi_read_data_submit(struct ftdi_context *ftdi, u
     if (ftdi == NULL || ftdi->usb_dev == NULL)
         return NULL;
 
-    tc = (struct ftdi_transfer_control *) malloc (sizeof (*tc));
+    tc = ftdi_transfer_control_get(ftdi);
     if (!tc)
         return NULL;
 
     tc->ftdi = ftdi;
     tc->buf = buf;
     tc->size = size;
+    tc->transfer = NULL;
+    tc->callback = callback;
+    tc->userdata = userdata;
+    tc->status = LIBUSB_TRANSFER_COMPLETED;
+
+    if (ftdi->readahead)
+    {
+        struct ftdi_readahead *ra = ftdi->readahead;
+
+        if (ra->pending != NULL)
+        {
+            ftdi_transfer_control_put(tc);
+            return NULL;
+        }
+
+        tc->completed = 0;
+        tc->offset = 0;
+        ra->pending = tc;
+        ftdi_deadline(&ra->pending_deadline, ftdi->usb_read_timeout);
+        ftdi_readahead_feed_pending(ftdi);
+        ftdi_readahead_kick(ftdi);
+        return tc;
+    }
 
     if (size <= ftdi->readbuffer_remaining)
     {
@@ -1602,9 +2602,8 @@ struct ftdi_transfer_control *ftdi_read_data_submit(struct ftdi_context *ftdi, u
 
         /* printf("Returning bytes from buffer: %d - remaining: %d\n", size, ftdi->readbuffer_remaining); */
 
-        tc->completed = 1;
         tc->offset = size;
-        tc->transfer = NULL;
+        ftdi_transfer_control_complete(tc);
         return tc;
     }
 
@@ -1618,12 +2617,13 @@ struct ftdi_transfer_control *ftdi_read_data_submit(struct ftdi_context *ftdi, u
     else
         tc->offset = 0;
 
-    transfer = libusb_alloc_transfer(0);
+    transfer = ftdi_transfer_get(ftdi);
     if (!transfer)
     {
-        free (tc);
+        ftdi_transfer_control_put(tc);
         return NULL;
     }
+    tc->transfer = transfer;
 
     ftdi->readbuffer_remaining = 0;
     ftdi->readbuffer_offset = 0;
@@ -1634,20 +2634,127 @@ struct ftdi_transfer_control *ftdi_read_data_submit(struct ftdi_context *ftdi, u
     ret = libusb_submit_transfer(transfer);
     if (ret < 0)
     {
-        libusb_free_transfer(transfer);
-        free (tc);
+        ftdi_transfer_control_put(tc);
         return NULL;
     }
-    tc->transfer = transfer;
 
     return tc;
 }
 
+/**
+    Reads data from the chip. Does not wait for completion of the transfer
+    nor does it make sure that the transfer was successful.
+
+    Use libusb 1.0 asynchronous API.
+
+    With read-ahead active (see ftdi_readahead_start()) the transfer is
+    served from the read-ahead ring buffer. Only one such read may be
+    pending at a time. Like a plain read it fails once usb_read_timeout
+    passes before all data arrived, the data received so far stays in
+    buf.
+
+    \param ftdi pointer to ftdi_context
+    \param buf Buffer with the data
+    \param size Size of the buffer
+
+    \retval NULL: Some error happens when submit transfer
+    \retval !NULL: Pointer to a ftdi_transfer_control
+*/
+
+struct ftdi_transfer_control *ftdi_read_data_submit(struct ftdi_context *ftdi, unsigned char *buf, int size)
+{
+    return ftdi_read_data_submit_internal(ftdi, buf, size, NULL, NULL);
+}
+
+/**
+    Reads data from the chip and calls \a callback when done.
+
+    Use libusb 1.0 asynchronous API. The callback runs from libusb event
+    handling once \a size bytes arrived, an error occured or the transfer
+    timed out. If the data is already buffered, the callback runs before
+    this function returns. The ftdi_transfer_control is released after
+    the callback returns, do not call ftdi_transfer_data_done() on it.
+
+    \param ftdi pointer to ftdi_context
+    \param buf Buffer to store data in
+    \param size Size of the buffer
+    \param callback Completion callback
+    \param userdata User data handed to the callback
+
+    \retval  0: transfer submitted or already completed
+    \retval -1: submitting the transfer failed
+    \retval -666: USB device unavailable
+*/
+int ftdi_read_data_submit_cb(struct ftdi_context *ftdi, unsigned char *buf, int size,
+                             FTDITransferCallback *callback, void *userdata)
+{
+    if (ftdi == NULL || ftdi->usb_dev == NULL)
+        ftdi_error_return(-666, "USB device unavailable");
+
+    if (ftdi_read_data_submit_internal(ftdi, buf, size, callback, userdata) == NULL)
+        ftdi_error_return(-1, "submitting usb bulk read failed");
+
+    return 0;
+}
+
+/**
+    Internal completion callback of a transfer abandoned by
+    ftdi_transfer_data_done(). ftdi_transfer_control_complete() releases
+    it after this returns.
+    \internal
+*/
+static void ftdi_transfer_control_orphaned(struct ftdi_transfer_control *tc, int result, void *userdata)
+{
+}
+
+/**
+    Internal function to give up on a submitted transfer and release it,
+    e.g. a read whose request was never written.
+    \internal
+
+    A read served by the read-ahead engine is taken off it, a transfer of
+    its own gets cancelled. Should it stay in flight anyway, it is
+    released once libusb finishes it.
+
+    \param tc pointer to ftdi_transfer_control
+*/
+void ftdi_transfer_data_drop(struct ftdi_transfer_control *tc)
+{
+    struct ftdi_context *ftdi = tc->ftdi;
+
+    if (!tc->completed)
+    {
+        if (tc->transfer == NULL)
+        {
+            if (ftdi->readahead && ftdi->readahead->pending == tc)
+                ftdi->readahead->pending = NULL;
+        }
+        else
+        {
+            libusb_cancel_transfer(tc->transfer);
+            while (!tc->completed)
+                if (libusb_handle_events(ftdi->usb_ctx) < 0)
+                    break;
+            // still in flight? Release it from its completion callback
+            if (!tc->completed)
+            {
+                tc->callback = ftdi_transfer_control_orphaned;
+                return;
+            }
+        }
+    }
+    ftdi_transfer_control_put(tc);
+}
+
 /**
     Wait for completion of the transfer.
 
     Use libusb 1.0 asynchronous API.
 
+    If event handling fails, the transfer gets cancelled. Should it stay
+    in flight anyway, it is released once libusb finishes it, so its
+    buffer and the ftdi_context must stay valid until then.
+
     \param tc pointer to ftdi_transfer_control
 
     \retval < 0: Some error happens
@@ -1660,36 +2767,264 @@ int ftdi_transfer_data_done(struct ftdi_transfer_control *tc)
 
     while (!tc->completed)
     {
-        ret = libusb_handle_events(tc->ftdi->usb_ctx);
+        struct ftdi_readahead *ra = tc->ftdi->readahead;
+
+        if (tc->transfer == NULL && ra && ra->pending == tc)
+        {
+            struct timeval tv;
+
+            // the read-ahead transfers keep running, wait for the deadline
+            if (!ftdi_deadline_remaining(&ra->pending_deadline, &tv))
+            {
+                ftdi_readahead_feed_pending(tc->ftdi);
+                continue;
+            }
+            ret = libusb_handle_events_timeout(tc->ftdi->usb_ctx, &tv);
+        }
+        else
+            ret = libusb_handle_events(tc->ftdi->usb_ctx);
         if (ret < 0)
         {
             if (ret == LIBUSB_ERROR_INTERRUPTED)
                 continue;
-            libusb_cancel_transfer(tc->transfer);
-            while (!tc->completed)
-                if (libusb_handle_events(tc->ftdi->usb_ctx) < 0)
-                    break;
-            libusb_free_transfer(tc->transfer);
-            free (tc);
+            ftdi_transfer_data_drop(tc);
             return ret;
         }
     }
 
-    ret = tc->offset;
     /**
      * tc->transfer could be NULL if "(size <= ftdi->readbuffer_remaining)"
-     * at ftdi_read_data_submit(). Therefore, we need to check it here.
+     * at ftdi_read_data_submit() or the data came from the read-ahead
+     * engine, tc->status tells the outcome then.
      **/
-    if (tc->transfer)
+    ret = ftdi_transfer_control_result(tc);
+    ftdi_transfer_control_put(tc);
+    return ret;
+}
+
+/**
+    Internal function behind ftdi_transfer_data_done_any() and
+    ftdi_transfer_data_done_all().
+    \internal
+
+    All pending transfers share one event loop on their common libusb
+    context.
+*/
+static int ftdi_transfer_data_wait(struct ftdi_transfer_control **tcs, int count,
+                                   int timeout, int all)
+{
+    struct timeval deadline;
+
+    if (tcs == NULL || count < 1)
+        return -3;
+
+    if (timeout >= 0)
+        ftdi_deadline(&deadline, timeout);
+
+    for (;;)
     {
-        if (tc->transfer->status != LIBUSB_TRANSFER_COMPLETED)
-            ret = -1;
-        libusb_free_transfer(tc->transfer);
+        struct libusb_context *ctx = NULL;
+        struct timeval tv = { 1, 0 };
+        int *completed = NULL;
+        int i, valid = 0, pending = 0, first_done = -1, ret;
+
+        for (i = 0; i < count; i++)
+        {
+            if (tcs[i] == NULL)
+                continue;
+            valid++;
+            if (tcs[i]->completed)
+            {
+                if (first_done < 0)
+                    first_done = i;
+            }
+            else
+            {
+                pending++;
+                if (ctx == NULL)
+                {
+                    ctx = tcs[i]->ftdi->usb_ctx;
+                    completed = &tcs[i]->completed;
+                }
+                else if (ctx != tcs[i]->ftdi->usb_ctx)
+                    return -4;
+            }
+        }
+
+        if (valid == 0)
+            return -3;
+        if (!all && first_done >= 0)
+            return first_done;
+        if (pending == 0)
+            return 0;
+
+        if (timeout >= 0 && !ftdi_deadline_remaining(&deadline, &tv))
+            return -1;
+
+        ret = libusb_handle_events_timeout_completed(ctx, &tv, completed);
+        if (ret < 0 && ret != LIBUSB_ERROR_INTERRUPTED)
+            return -2;
     }
-    free(tc);
+}
+
+/**
+    Wait until any of several transfers completes.
+
+    The transfers may belong to different devices as long as these share
+    one libusb context, see ftdi_init_shared(). Finish the returned
+    transfer with ftdi_transfer_data_done(), which then does not block.
+    NULL entries in \a tcs are skipped, so finished transfers can be
+    cleared from the array.
+
+    \param tcs Array of pointers to ftdi_transfer_control
+    \param count Number of entries in tcs
+    \param timeout Timeout in milliseconds, < 0 waits forever
+
+    \retval >= 0: Index of a completed transfer
+    \retval -1: timeout
+    \retval -2: libusb event handling failed
+    \retval -3: no transfer given
+    \retval -4: transfers on different libusb contexts
+*/
+int ftdi_transfer_data_done_any(struct ftdi_transfer_control **tcs, int count, int timeout)
+{
+    return ftdi_transfer_data_wait(tcs, count, timeout, 0);
+}
+
+/**
+    Wait until all of several transfers completed.
+
+    The transfers may belong to different devices as long as these share
+    one libusb context, see ftdi_init_shared(). Finish them with
+    ftdi_transfer_data_done(), which then does not block. NULL entries
+    in \a tcs are skipped.
+
+    \param tcs Array of pointers to ftdi_transfer_control
+    \param count Number of entries in tcs
+    \param timeout Timeout in milliseconds, < 0 waits forever
+
+    \retval  0: all transfers completed
+    \retval -1: timeout
+    \retval -2: libusb event handling failed
+    \retval -3: no transfer given
+    \retval -4: transfers on different libusb contexts
+*/
+int ftdi_transfer_data_done_all(struct ftdi_transfer_control **tcs, int count, int timeout)
+{
+    return ftdi_transfer_data_wait(tcs, count, timeout, 1);
+}
+
+/**
+    Get the file descriptors libusb wants to be polled for the context.
+
+    Together with ftdi_get_next_timeout() and ftdi_handle_events() this
+    lets an application drive asynchronous transfers from its own
+    poll()/epoll() loop. Release the list with ftdi_free_pollfds().
+    Not available on every platform (e.g. Windows).
+
+    \param ftdi pointer to ftdi_context
+
+    \retval NULL-terminated list of pollfds, NULL on error
+*/
+const struct libusb_pollfd **ftdi_get_pollfds(struct ftdi_context *ftdi)
+{
+    const struct libusb_pollfd **fds;
+
+    if (ftdi == NULL || ftdi->usb_ctx == NULL)
+        return NULL;
+
+    fds = libusb_get_pollfds(ftdi->usb_ctx);
+    if (fds == NULL)
+        ftdi->error_str = "libusb_get_pollfds() failed";
+    return fds;
+}
+
+/**
+    Free a list returned by ftdi_get_pollfds().
+
+    \param fds list of pollfds, may be NULL
+*/
+void ftdi_free_pollfds(const struct libusb_pollfd **fds)
+{
+    free((void *)fds);
+}
+
+/**
+    Register callbacks invoked when libusb adds or removes a file
+    descriptor that must be polled for the context.
+
+    \param ftdi pointer to ftdi_context
+    \param added_cb called for every new file descriptor, may be NULL
+    \param removed_cb called for every removed file descriptor, may be NULL
+    \param user_data passed to the callbacks
+
+    \retval  0: all fine
+    \retval -1: invalid ftdi context
+*/
+int ftdi_set_pollfd_notifiers(struct ftdi_context *ftdi,
+                              libusb_pollfd_added_cb added_cb,
+                              libusb_pollfd_removed_cb removed_cb,
+                              void *user_data)
+{
+    if (ftdi == NULL || ftdi->usb_ctx == NULL)
+        ftdi_error_return(-1, "invalid ftdi context");
+
+    libusb_set_pollfd_notifiers(ftdi->usb_ctx, added_cb, removed_cb, user_data);
+    return 0;
+}
+
+/**
+    Get the time until libusb needs ftdi_handle_events() to be called
+    even if none of the polled file descriptors became ready.
+
+    \param ftdi pointer to ftdi_context
+    \param tv set to the time left if a timeout is pending
+
+    \retval  1: a timeout is pending, tv is set
+    \retval  0: no timeout is pending
+    \retval -1: invalid ftdi context
+    \retval -2: libusb_get_next_timeout() failed
+*/
+int ftdi_get_next_timeout(struct ftdi_context *ftdi, struct timeval *tv)
+{
+    int ret;
+
+    if (ftdi == NULL || ftdi->usb_ctx == NULL || tv == NULL)
+        ftdi_error_return(-1, "invalid ftdi context");
+
+    ret = libusb_get_next_timeout(ftdi->usb_ctx, tv);
+    if (ret < 0)
+        ftdi_error_return(-2, "libusb_get_next_timeout() failed");
     return ret;
 }
 
+/**
+    Process pending libusb events without blocking.
+
+    Completes asynchronous transfers and runs their callbacks. Call it
+    when one of the file descriptors from ftdi_get_pollfds() becomes
+    ready or the timeout from ftdi_get_next_timeout() expires.
+
+    \param ftdi pointer to ftdi_context
+
+    \retval  0: all fine
+    \retval -1: invalid ftdi context
+    \retval -2: libusb event handling failed
+*/
+int ftdi_handle_events(struct ftdi_context *ftdi)
+{
+    struct timeval tv = { 0, 0 };
+    int ret;
+
+    if (ftdi == NULL || ftdi->usb_ctx == NULL)
+        ftdi_error_return(-1, "invalid ftdi context");
+
+    ret = libusb_handle_events_timeout(ftdi->usb_ctx, &tv);
+    if (ret < 0 && ret != LIBUSB_ERROR_INTERRUPTED)
+        ftdi_error_return(-2, "libusb_handle_events_timeout() failed");
+    return 0;
+}
+
 /**
     Configure write buffer chunk size.
     Default is 4096.
@@ -1727,11 +3062,59 @@ int ftdi_write_data_get_chunksize(struct ftdi_context *ftdi, unsigned int *chunk
     return 0;
 }
 
+/**
+    Configure the number of write chunks ftdi_write_data() keeps in flight.
+    Default is 1, every chunk is acknowledged before the next one is sent.
+
+    \param ftdi pointer to ftdi_context
+    \param transfers Number of outstanding bulk-OUT transfers
+
+    \retval 0: all fine
+    \retval -1: ftdi context invalid
+    \retval -2: invalid number of transfers
+*/
+int ftdi_write_data_set_pipeline(struct ftdi_context *ftdi, unsigned int transfers)
+{
+    if (ftdi == NULL)
+        ftdi_error_return(-1, "ftdi context invalid");
+
+    if (transfers < 1)
+        ftdi_error_return(-2, "invalid number of write transfers");
+
+    ftdi->writebuffer_pipeline = transfers;
+    return 0;
+}
+
+/**
+    Get the number of write chunks ftdi_write_data() keeps in flight.
+
+    \param ftdi pointer to ftdi_context
+    \param transfers Pointer to store the number of transfers in
+
+    \retval 0: all fine
+    \retval -1: ftdi context invalid
+*/
+int ftdi_write_data_get_pipeline(struct ftdi_context *ftdi, unsigned int *transfers)
+{
+    if (ftdi == NULL)
+        ftdi_error_return(-1, "ftdi context invalid");
+
+    *transfers = ftdi->writebuffer_pipeline;
+    return 0;
+}
+
 /**
     Reads data in chunks (see ftdi_read_data_set_chunksize()) from the chip.
 
     Automatically strips the two modem status bytes transfered during every read.
 
+    As long as at least one chunk fits into the remaining space of \a buf,
+    the data is transferred directly into \a buf. The internal read buffer
+    is only used for the tail.
+
+    With read-ahead active (see ftdi_readahead_start()) the data is taken
+    from the read-ahead ring buffer instead.
+
     \param ftdi pointer to ftdi_context
     \param buf Buffer to store data in
     \param size Size of the buffer
@@ -1744,7 +3127,7 @@ int ftdi_write_data_get_chunksize(struct ftdi_context *ftdi, unsigned int *chunk
 */
 int ftdi_read_data(struct ftdi_context *ftdi, unsigned char *buf, int size)
 {
-    int offset = 0, ret, i, num_of_chunks, chunk_remains;
+    int offset = 0, ret, part_size;
     int packet_size = ftdi->max_packet_size;
     int actual_length = 1;
 
@@ -1755,6 +3138,9 @@ int ftdi_read_data(struct ftdi_context *ftdi, unsigned char *buf, int size)
     if (packet_size == 0)
         ftdi_error_return(-1, "max_packet_size is bogus (zero)");
 
+    if (ftdi->readahead)
+        return ftdi_readahead_read_data(ftdi, buf, size);
+
     // everything we want is still in the readbuffer?
     if (size <= ftdi->readbuffer_remaining)
     {
@@ -1781,74 +3167,49 @@ int ftdi_read_data(struct ftdi_context *ftdi, unsigned char *buf, int size)
     {
         ftdi->readbuffer_remaining = 0;
         ftdi->readbuffer_offset = 0;
-        /* returns how much received */
-        ret = libusb_bulk_transfer (ftdi->usb_dev, ftdi->out_ep, ftdi->readbuffer, ftdi->readbuffer_chunksize, &actual_length, ftdi->usb_read_timeout);
-        if (ret < 0)
-            ftdi_error_return(ret, "usb bulk read failed");
 
-        if (actual_length > 2)
+        // room for a whole chunk? Then read straight into buf and strip
+        // the status bytes in place, the payload is always shorter.
+        if (size - offset >= ftdi->readbuffer_chunksize)
         {
-            // skip FTDI status bytes.
-            // Maybe stored in the future to enable modem use
-            num_of_chunks = actual_length / packet_size;
-            chunk_remains = actual_length % packet_size;
-            //printf("actual_length = %X, num_of_chunks = %X, chunk_remains = %X, readbuffer_offset = %X\n", actual_length, num_of_chunks, chunk_remains, ftdi->readbuffer_offset);
+            ret = libusb_bulk_transfer (ftdi->usb_dev, ftdi->out_ep, buf + offset, ftdi->readbuffer_chunksize, &actual_length, ftdi->usb_read_timeout);
+            if (ret < 0)
+                ftdi_error_return(ret, "usb bulk read failed");
 
-            ftdi->readbuffer_offset += 2;
-            actual_length -= 2;
+            if (actual_length <= 2)
+                return offset;
 
-            if (actual_length > packet_size - 2)
-            {
-                for (i = 1; i < num_of_chunks; i++)
-                    memmove (ftdi->readbuffer+ftdi->readbuffer_offset+(packet_size - 2)*i,
-                             ftdi->readbuffer+ftdi->readbuffer_offset+packet_size*i,
-                             packet_size - 2);
-                if (chunk_remains > 2)
-                {
-                    memmove (ftdi->readbuffer+ftdi->readbuffer_offset+(packet_size - 2)*i,
-                             ftdi->readbuffer+ftdi->readbuffer_offset+packet_size*i,
-                             chunk_remains-2);
-                    actual_length -= 2*num_of_chunks;
-                }
-                else
-                    actual_length -= 2*(num_of_chunks-1)+chunk_remains;
-            }
+            offset += ftdi_compact_packets(buf + offset, size - offset,
+                                           buf + offset, actual_length, packet_size, 0);
+            continue;
         }
-        else if (actual_length <= 2)
+
+        /* returns how much received */
+        ret = libusb_bulk_transfer (ftdi->usb_dev, ftdi->out_ep, ftdi->readbuffer, ftdi->readbuffer_chunksize, &actual_length, ftdi->usb_read_timeout);
+        if (ret < 0)
+            ftdi_error_return(ret, "usb bulk read failed");
+
+        if (actual_length <= 2)
         {
             // no more data to read?
             return offset;
         }
-        if (actual_length > 0)
-        {
-            // data still fits in buf?
-            if (offset+actual_length <= size)
-            {
-                memcpy (buf+offset, ftdi->readbuffer+ftdi->readbuffer_offset, actual_length);
-                //printf("buf[0] = %X, buf[1] = %X\n", buf[0], buf[1]);
-                offset += actual_length;
-
-                /* Did we read exactly the right amount of bytes? */
-                if (offset == size)
-                    //printf("read_data exact rem %d offset %d\n",
-                    //ftdi->readbuffer_remaining, offset);
-                    return offset;
-            }
-            else
-            {
-                // only copy part of the data or size <= readbuffer_chunksize
-                int part_size = size-offset;
-                memcpy (buf+offset, ftdi->readbuffer+ftdi->readbuffer_offset, part_size);
 
-                ftdi->readbuffer_offset += part_size;
-                ftdi->readbuffer_remaining = actual_length-part_size;
-                offset += part_size;
-
-                /* printf("Returning part: %d - size: %d - offset: %d - actual_length: %d - remaining: %d\n",
-                part_size, size, offset, actual_length, ftdi->readbuffer_remaining); */
+        // skip FTDI status bytes while copying the payload to buf.
+        // Maybe stored in the future to enable modem use
+        part_size = ftdi_compact_packets(buf + offset, size - offset,
+                                         ftdi->readbuffer, actual_length, packet_size, 0);
+        offset += part_size;
 
-                return offset;
-            }
+        /* Did we fill buf? Keep what didn't fit for the next call */
+        if (offset == size)
+        {
+            ftdi->readbuffer_remaining = ftdi_compact_packets(ftdi->readbuffer, ftdi->readbuffer_chunksize,
+                                         ftdi->readbuffer, actual_length,
+                                         packet_size, part_size);
+            /* printf("Returning part: %d - size: %d - offset: %d - actual_length: %d - remaining: %d\n",
+            part_size, size, offset, actual_length, ftdi->readbuffer_remaining); */
+            return offset;
         }
     }
     // never reached
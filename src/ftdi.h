@@ -62,6 +62,14 @@ enum ftdi_module_detach_mode
     DONT_DETACH_SIO_MODULE = 1
 };
 
+/** Ownership of the libusb context used by a ftdi_context */
+enum ftdi_usb_ctx_mode
+{
+    USB_CTX_OWN = 0,        /* created by ftdi_init(), exited by ftdi_deinit() */
+    USB_CTX_EXTERNAL = 1,   /* provided by the caller, never exited by libftdi */
+    USB_CTX_SHARED = 2      /* library managed, reference counted */
+};
+
 /* Shifting commands IN MPSSE Mode*/
 #define MPSSE_WRITE_NEG 0x01   /* Write TDI/DO on negative TCK/SK edge*/
 #define MPSSE_BITMODE   0x02   /* Write bits, not bytes */
@@ -100,6 +108,7 @@ enum ftdi_module_detach_mode
 #define DRIVE_OPEN_COLLECTOR 0x9e
 /* Value Low */
 /* Value HIGH */ /*rate is 12000000/((1+value)*2) */
+/* 12 MHz base only, ftdi_mpsse_plan_clock() knows the H type chips */
 #define DIV_VALUE(rate) (rate > 6000000)?0:((6000000/rate -1) > 0xffff)? 0xffff: (6000000/rate -1)
 
 /* Commands in MPSSE and Host Emulation Mode */
@@ -178,6 +187,34 @@ enum ftdi_module_detach_mode
     #define DEPRECATED(func) func
 #endif
 
+/**
+    \brief Usage counters of the transfer pool, see ftdi_transfer_pool_get_stats()
+*/
+struct ftdi_transfer_pool_stats
+{
+    /** ftdi_transfer_control taken from the pool */
+    unsigned long tc_hits;
+    /** ftdi_transfer_control allocated with malloc() */
+    unsigned long tc_misses;
+    /** libusb_transfer taken from the pool */
+    unsigned long transfer_hits;
+    /** libusb_transfer allocated with libusb_alloc_transfer() */
+    unsigned long transfer_misses;
+};
+
+struct ftdi_transfer_control;
+
+/**
+    Completion callback of an asynchronous transfer,
+    see ftdi_write_data_submit_cb() and ftdi_read_data_submit_cb()
+
+    \param tc the finished transfer, released after the callback returns
+    \param result number of bytes transferred or < 0 on error/timeout
+    \param userdata user data given at submit time
+*/
+typedef void (FTDITransferCallback)(struct ftdi_transfer_control *tc, int result,
+                                    void *userdata);
+
 struct ftdi_transfer_control
 {
     int completed;
@@ -186,6 +223,13 @@ struct ftdi_transfer_control
     int offset;
     struct ftdi_context *ftdi;
     struct libusb_transfer *transfer;
+    /** Completion callback, NULL when waited for with ftdi_transfer_data_done() */
+    FTDITransferCallback *callback;
+    /** user data for the completion callback */
+    void *userdata;
+    /** enum libusb_transfer_status of a read without its own transfer,
+        i.e. one served by the read-ahead engine */
+    int status;
 };
 
 /**
@@ -222,6 +266,8 @@ struct ftdi_context
     unsigned int readbuffer_chunksize;
     /** write buffer chunk size */
     unsigned int writebuffer_chunksize;
+    /** number of write chunks ftdi_write_data() keeps in flight */
+    unsigned int writebuffer_pipeline;
     /** maximum packet size. Needed for filtering modem status bytes every n packets. */
     unsigned int max_packet_size;
 
@@ -246,6 +292,15 @@ struct ftdi_context
 
     /** Defines behavior in case a kernel module is already attached to the device */
     enum ftdi_module_detach_mode module_detach_mode;
+
+    /** Read-ahead engine state, NULL if read-ahead is off */
+    struct ftdi_readahead *readahead;
+
+    /** Recycled objects of the asynchronous API */
+    struct ftdi_transfer_pool *transfer_pool;
+
+    /** Ownership of usb_ctx */
+    enum ftdi_usb_ctx_mode usb_ctx_mode;
 };
 
 /**
@@ -390,6 +445,15 @@ struct size_and_time
         struct timeval time;
 };
 
+/**
+    \brief Progress of a stream, handed to the callback and the producer
+
+    The time stamps come from CLOCK_MONOTONIC where available (before,
+    gettimeofday()), so they can only be compared with each other, not
+    with the wall clock. windowRate was appended at the end, code
+    compiled against older headers still finds the other members at
+    their old offsets.
+*/
 typedef struct
 {
     struct size_and_time first;
@@ -398,11 +462,324 @@ typedef struct
     double totalTime;
     double totalRate;
     double currentRate;
+    /** rate over the last ftdi_stream_config.rate_window seconds */
+    double windowRate;
 } FTDIProgressInfo;
 
 typedef int (FTDIStreamCallback)(uint8_t *buffer, int length,
                                  FTDIProgressInfo *progress, void *userdata);
 
+typedef int (FTDIStreamProducer)(uint8_t *buffer, int length,
+                                 FTDIProgressInfo *progress, void *userdata);
+
+/**
+    \brief Statistics of a stream ring buffer, see ftdi_stream_ring_get_stats()
+*/
+struct ftdi_stream_ring_stats
+{
+    /** bytes stored in the ring */
+    uint64_t bytes_written;
+    /** bytes dropped because the ring was full */
+    uint64_t bytes_dropped;
+    /** number of dropped blocks */
+    uint64_t overflows;
+    /** highest fill level seen, in bytes */
+    size_t high_water;
+};
+
+struct ftdi_stream_ring;
+struct ftdi_stream_control;
+struct ftdi_stream_group;
+
+/**
+    \brief Configuration of ftdi_file_sink_open(), see ftdi_file_sink_config_init()
+*/
+struct ftdi_file_sink_config
+{
+    /** size of each buffer, rounded up to whole pages */
+    size_t buffer_size;
+    /** number of buffers, at least 2 */
+    int num_buffers;
+    /** open the file with O_DIRECT where available */
+    int direct;
+    /** bytes to reserve on disk up front, 0 for none */
+    uint64_t preallocate;
+};
+
+/**
+    \brief Statistics of a file sink, see ftdi_file_sink_get_stats()
+*/
+struct ftdi_file_sink_stats
+{
+    /** bytes passed to the sink */
+    uint64_t bytes_received;
+    /** bytes written to the file */
+    uint64_t bytes_written;
+    /** bytes dropped because no buffer was free */
+    uint64_t bytes_dropped;
+    /** number of times data was dropped */
+    uint64_t overflows;
+    /** accepted bytes not yet written to the file */
+    uint64_t lag;
+    /** highest lag seen */
+    uint64_t max_lag;
+    /** bytes reserved on disk by ftdi_file_sink_config.preallocate,
+        0 if the file system could not preallocate */
+    uint64_t preallocated;
+};
+
+struct ftdi_file_sink;
+
+/**
+    \brief Header data and totals of a capture file, see ftdi_capture_get_info()
+*/
+struct ftdi_capture_info
+{
+    /** chip type of the recorded device, enum ftdi_chip_type */
+    int type;
+    /** bit mode of the recording, enum ftdi_mpsse_mode */
+    int bitmode;
+    /** USB packet size of the recorded device */
+    int packet_size;
+    /** host time the recording started, microseconds since the epoch */
+    uint64_t start_time;
+    /** number of chunks */
+    int64_t num_chunks;
+    /** number of recorded bytes */
+    uint64_t total_bytes;
+};
+
+/**
+    \brief One chunk of a capture file, see ftdi_capture_get_chunk()
+*/
+struct ftdi_capture_chunk
+{
+    /** host time the data arrived, microseconds since the epoch */
+    uint64_t timestamp;
+    /** position of the first byte in the recorded stream */
+    uint64_t offset;
+    /** number of bytes */
+    size_t length;
+    /** the data, valid until the reader is closed */
+    const unsigned char *data;
+};
+
+struct ftdi_capture_writer;
+struct ftdi_capture_reader;
+
+/** Test patterns checked by ftdi_stream_run(), see ftdi_stream_config.pattern */
+enum ftdi_stream_pattern
+{
+    FTDI_PATTERN_NONE = 0,
+    /** incrementing 8 bit counter */
+    FTDI_PATTERN_COUNT8 = 1,
+    /** incrementing 16 bit counter, little endian */
+    FTDI_PATTERN_COUNT16 = 2,
+    /** incrementing 32 bit counter, little endian */
+    FTDI_PATTERN_COUNT32 = 3,
+    /** 8 bit LFSR x^8 + x^6 + x^5 + x^4 + 1, see ftdi_pattern_next_byte() */
+    FTDI_PATTERN_LFSR = 4
+};
+
+/**
+    \brief Results of a pattern check, see ftdi_pattern_get_stats()
+*/
+struct ftdi_pattern_stats
+{
+    /** bytes checked */
+    uint64_t bytes;
+    /** values not following their predecessor */
+    uint64_t errors;
+    /** stream offset of the first error, -1 if none */
+    int64_t first_error;
+};
+
+struct ftdi_pattern_checker;
+struct ftdi_mpsse_queue;
+
+/**
+    \brief Clock settings of ftdi_mpsse_plan_clock()
+*/
+struct ftdi_mpsse_clock
+{
+    /** resulting clock in Hz */
+    double frequency;
+    /** TCK_DIVISOR value */
+    unsigned short divisor;
+    /** divide by 5 prescaler of H type chips, 12 MHz instead of 60 MHz base;
+        0 on the FT2232C/D, which has no prescaler to set */
+    int div5;
+    /** three phase clocking */
+    int three_phase;
+    /** commands setting the clock, to send as they are */
+    unsigned char commands[5];
+    int num_commands;
+};
+
+/**
+    \brief Configuration of ftdi_spi_new(), see ftdi_spi_config_init()
+*/
+struct ftdi_spi_config
+{
+    /** SPI mode 0 to 3, CPOL is bit 1, CPHA bit 0 */
+    int mode;
+    /** shift the least significant bit first */
+    int lsb_first;
+    /** low byte pins used as chip selects, active low, not SK/DO/DI */
+    unsigned char cs_pins;
+    /** levels and directions of the other low byte pins */
+    unsigned char gpio_value;
+    unsigned char gpio_direction;
+    /** TCK_DIVISOR value, see ftdi_spi_new() */
+    unsigned short divisor;
+    /** clock in Hz instead of divisor, see ftdi_mpsse_plan_clock(); 0 for divisor */
+    int frequency;
+    /** bytes per bulk write of ftdi_spi_transfer(), at most 65536 */
+    int chunk_size;
+    /** bulk writes in flight during ftdi_spi_transfer() */
+    int num_writes;
+    /** bulk reads kept in flight by the read-ahead engine, 1 for none */
+    int num_reads;
+};
+
+/** Flags of ftdi_spi_transfer() and ftdi_spi_queue() */
+#define FTDI_SPI_START 0x01     /* assert chip select before the data */
+#define FTDI_SPI_END   0x02     /* release chip select after the data */
+#define FTDI_SPI_WHOLE (FTDI_SPI_START | FTDI_SPI_END)
+
+struct ftdi_spi;
+
+/**
+    \brief Configuration of ftdi_i2c_new(), see ftdi_i2c_config_init()
+*/
+struct ftdi_i2c_config
+{
+    /** SCL frequency in Hz, rounded down to what the chip can do */
+    int frequency;
+    /** use three phase clocking on H type chips */
+    int three_phase;
+    /** levels and directions of the low byte pins above SCL/SDA */
+    unsigned char gpio_value;
+    unsigned char gpio_direction;
+};
+
+/** Flag of ftdi_i2c_msg: read from the slave instead of writing */
+#define FTDI_I2C_READ 0x01
+
+/**
+    \brief One message of an I2C transaction, see ftdi_i2c_queue()
+*/
+struct ftdi_i2c_msg
+{
+    /** 7 bit slave address */
+    unsigned char addr;
+    /** FTDI_I2C_READ or 0 */
+    int flags;
+    /** number of bytes */
+    int length;
+    /** data to write or buffer for the data read */
+    unsigned char *buf;
+};
+
+struct ftdi_i2c;
+
+/** TAP controller states of ftdi_jtag */
+enum ftdi_jtag_state
+{
+    FTDI_JTAG_RESET = 0,
+    FTDI_JTAG_IDLE,
+    FTDI_JTAG_DRSELECT,
+    FTDI_JTAG_DRCAPTURE,
+    FTDI_JTAG_DRSHIFT,
+    FTDI_JTAG_DREXIT1,
+    FTDI_JTAG_DRPAUSE,
+    FTDI_JTAG_DREXIT2,
+    FTDI_JTAG_DRUPDATE,
+    FTDI_JTAG_IRSELECT,
+    FTDI_JTAG_IRCAPTURE,
+    FTDI_JTAG_IRSHIFT,
+    FTDI_JTAG_IREXIT1,
+    FTDI_JTAG_IRPAUSE,
+    FTDI_JTAG_IREXIT2,
+    FTDI_JTAG_IRUPDATE
+};
+
+/**
+    \brief Configuration of ftdi_jtag_new(), see ftdi_jtag_config_init()
+*/
+struct ftdi_jtag_config
+{
+    /** TCK_DIVISOR value, see ftdi_jtag_new() */
+    unsigned short divisor;
+    /** TCK in Hz instead of divisor, see ftdi_mpsse_plan_clock(); 0 for divisor */
+    int frequency;
+    /** levels and directions of the low byte pins above TMS */
+    unsigned char gpio_value;
+    unsigned char gpio_direction;
+};
+
+struct ftdi_jtag;
+
+/**
+    \brief Transfer statistics of ftdi_stream_run(), see ftdi_stream_config.stats
+*/
+struct ftdi_stream_stats
+{
+    /** completed read transfers */
+    uint64_t transfers;
+    /** read transfers shorter than requested */
+    uint64_t short_transfers;
+    /** read transfers without any payload */
+    uint64_t empty_transfers;
+    /** packets with the overrun bit set in the line status byte */
+    uint64_t overruns;
+    /** packets with parity, framing, break or FIFO error bits set */
+    uint64_t line_errors;
+    /** completed write transfers */
+    uint64_t write_transfers;
+    /** time of the last read completion, monotonic clock */
+    struct timeval last_completion;
+    /** longest time between two read completions, in seconds */
+    double max_gap;
+    /** mean time between two read completions, in seconds */
+    double mean_gap;
+    /** longest time from a read completion to its resubmission, in seconds */
+    double max_resubmit;
+    /** results of checking ftdi_stream_config.pattern */
+    struct ftdi_pattern_stats pattern;
+};
+
+/** Value of ftdi_stream_config.bitmode leaving the configured mode alone */
+#define FTDI_STREAM_KEEP_MODE (-1)
+
+/**
+    \brief Configuration of ftdi_stream_run(), see ftdi_stream_config_init()
+*/
+struct ftdi_stream_config
+{
+    /** ftdi_mpsse_mode to switch to, or FTDI_STREAM_KEEP_MODE */
+    int bitmode;
+    /** pin direction mask passed to ftdi_set_bitmode() */
+    unsigned char bitmask;
+    /** USB packets per transfer */
+    int packets_per_transfer;
+    /** transfers in flight per direction */
+    int num_transfers;
+    /** call the read callback once per transfer instead of once per packet */
+    int whole_transfers;
+    /** updated while the stream runs, may be NULL */
+    struct ftdi_stream_stats *stats;
+    /** seconds between progress reports, <= 0 disables them */
+    double progress_interval;
+    /** seconds covered by FTDIProgressInfo.windowRate */
+    double rate_window;
+    /** pause, resume and stop the running stream, may be NULL */
+    struct ftdi_stream_control *control;
+    /** enum ftdi_stream_pattern to check the received data against,
+        the results are reported in stats */
+    int pattern;
+};
+
 /**
  * Provide libftdi version information
  * major: Library major version
@@ -427,7 +804,9 @@ extern "C"
 #endif
 
     int ftdi_init(struct ftdi_context *ftdi);
+    int ftdi_init_shared(struct ftdi_context *ftdi, struct libusb_context *usb_ctx);
     struct ftdi_context *ftdi_new(void);
+    struct ftdi_context *ftdi_new_shared(struct libusb_context *usb_ctx);
     int ftdi_set_interface(struct ftdi_context *ftdi, enum ftdi_interface interface);
 
     void ftdi_deinit(struct ftdi_context *ftdi);
@@ -469,18 +848,176 @@ extern "C"
     int ftdi_read_data(struct ftdi_context *ftdi, unsigned char *buf, int size);
     int ftdi_read_data_set_chunksize(struct ftdi_context *ftdi, unsigned int chunksize);
     int ftdi_read_data_get_chunksize(struct ftdi_context *ftdi, unsigned int *chunksize);
+    int ftdi_compact_packets(unsigned char *dst, int dst_size,
+                             const unsigned char *src, int src_len,
+                             int packet_size, int skip);
+    int ftdi_readahead_start(struct ftdi_context *ftdi, int num_transfers, unsigned int ringsize);
+    int ftdi_readahead_stop(struct ftdi_context *ftdi);
 
     int ftdi_write_data(struct ftdi_context *ftdi, unsigned char *buf, int size);
     int ftdi_write_data_set_chunksize(struct ftdi_context *ftdi, unsigned int chunksize);
     int ftdi_write_data_get_chunksize(struct ftdi_context *ftdi, unsigned int *chunksize);
-
+    int ftdi_write_data_set_pipeline(struct ftdi_context *ftdi, unsigned int transfers);
+    int ftdi_write_data_get_pipeline(struct ftdi_context *ftdi, unsigned int *transfers);
+
+    void ftdi_stream_config_init(struct ftdi_stream_config *config);
+    int ftdi_stream_run(struct ftdi_context *ftdi, const struct ftdi_stream_config *config,
+                        FTDIStreamCallback *callback, FTDIStreamProducer *producer,
+                        void *userdata);
+    struct ftdi_stream_control *ftdi_stream_control_new(void);
+    void ftdi_stream_control_free(struct ftdi_stream_control *control);
+    int ftdi_stream_pause(struct ftdi_stream_control *control);
+    int ftdi_stream_resume(struct ftdi_stream_control *control);
+    int ftdi_stream_stop(struct ftdi_stream_control *control);
+    void ftdi_file_sink_config_init(struct ftdi_file_sink_config *config);
+    struct ftdi_file_sink *ftdi_file_sink_open(const char *path,
+                                               const struct ftdi_file_sink_config *config);
+    int ftdi_file_sink_callback(uint8_t *buffer, int length,
+                                FTDIProgressInfo *progress, void *userdata);
+    void ftdi_file_sink_get_stats(struct ftdi_file_sink *sink,
+                                  struct ftdi_file_sink_stats *stats);
+    int ftdi_file_sink_close(struct ftdi_file_sink *sink);
+    struct ftdi_mpsse_queue *ftdi_mpsse_queue_new(struct ftdi_context *ftdi);
+    void ftdi_mpsse_queue_free(struct ftdi_mpsse_queue *queue);
+    int ftdi_mpsse_queue_raw(struct ftdi_mpsse_queue *queue, const unsigned char *command,
+                             int length, unsigned char *reply, int reply_length);
+    int ftdi_mpsse_set_bits_low(struct ftdi_mpsse_queue *queue,
+                                unsigned char value, unsigned char direction);
+    int ftdi_mpsse_set_bits_high(struct ftdi_mpsse_queue *queue,
+                                 unsigned char value, unsigned char direction);
+    int ftdi_mpsse_get_bits_low(struct ftdi_mpsse_queue *queue, unsigned char *value);
+    int ftdi_mpsse_get_bits_high(struct ftdi_mpsse_queue *queue, unsigned char *value);
+    int ftdi_mpsse_set_divisor(struct ftdi_mpsse_queue *queue, unsigned short divisor);
+    int ftdi_mpsse_plan_clock(enum ftdi_chip_type type, int frequency, int three_phase,
+                              struct ftdi_mpsse_clock *clock);
+    int ftdi_mpsse_set_clock(struct ftdi_mpsse_queue *queue, int frequency, int three_phase,
+                             struct ftdi_mpsse_clock *clock);
+    int ftdi_mpsse_loopback(struct ftdi_mpsse_queue *queue, int enable);
+    int ftdi_mpsse_shift_bytes(struct ftdi_mpsse_queue *queue, unsigned char mode,
+                               const unsigned char *out, unsigned char *in, int length);
+    int ftdi_mpsse_shift_bits(struct ftdi_mpsse_queue *queue, unsigned char mode,
+                              const unsigned char *out, unsigned char *in, int bits);
+    int ftdi_mpsse_write_tms(struct ftdi_mpsse_queue *queue, unsigned char mode,
+                             unsigned char tms, int bits, int tdi, unsigned char *in);
+    int ftdi_mpsse_queue_commands(struct ftdi_mpsse_queue *queue,
+                                  const unsigned char **commands);
+    int ftdi_mpsse_queue_reply_length(struct ftdi_mpsse_queue *queue);
+    void ftdi_mpsse_queue_clear(struct ftdi_mpsse_queue *queue);
+    int ftdi_mpsse_queue_flush(struct ftdi_mpsse_queue *queue);
+    void ftdi_spi_config_init(struct ftdi_spi_config *config);
+    struct ftdi_spi *ftdi_spi_new(struct ftdi_context *ftdi, const struct ftdi_spi_config *config);
+    void ftdi_spi_free(struct ftdi_spi *spi);
+    int ftdi_spi_transfer(struct ftdi_spi *spi, unsigned char cs, const unsigned char *out,
+                          unsigned char *in, int length, int flags);
+    int ftdi_spi_queue(struct ftdi_spi *spi, unsigned char cs, const unsigned char *out,
+                       unsigned char *in, int length, int flags);
+    int ftdi_spi_flush(struct ftdi_spi *spi);
+    struct ftdi_mpsse_queue *ftdi_spi_get_queue(struct ftdi_spi *spi);
+    void ftdi_i2c_config_init(struct ftdi_i2c_config *config);
+    struct ftdi_i2c *ftdi_i2c_new(struct ftdi_context *ftdi, const struct ftdi_i2c_config *config);
+    void ftdi_i2c_free(struct ftdi_i2c *i2c);
+    int ftdi_i2c_queue(struct ftdi_i2c *i2c, const struct ftdi_i2c_msg *msgs, int num);
+    int ftdi_i2c_flush(struct ftdi_i2c *i2c);
+    int ftdi_i2c_get_nack(struct ftdi_i2c *i2c, int transaction, int *msg, int *byte);
+    int ftdi_i2c_transfer(struct ftdi_i2c *i2c, const struct ftdi_i2c_msg *msgs, int num,
+                          int *msg, int *byte);
+    struct ftdi_mpsse_queue *ftdi_i2c_get_queue(struct ftdi_i2c *i2c);
+    int ftdi_jtag_next_state(int state, int tms);
+    int ftdi_jtag_tms_path(int from, int to, unsigned char *tms);
+    void ftdi_jtag_config_init(struct ftdi_jtag_config *config);
+    struct ftdi_jtag *ftdi_jtag_new(struct ftdi_context *ftdi, const struct ftdi_jtag_config *config);
+    void ftdi_jtag_free(struct ftdi_jtag *jtag);
+    int ftdi_jtag_get_state(struct ftdi_jtag *jtag);
+    struct ftdi_mpsse_queue *ftdi_jtag_get_queue(struct ftdi_jtag *jtag);
+    int ftdi_jtag_reset(struct ftdi_jtag *jtag);
+    int ftdi_jtag_goto(struct ftdi_jtag *jtag, int state);
+    int ftdi_jtag_run_test(struct ftdi_jtag *jtag, int cycles);
+    int ftdi_jtag_scan_ir(struct ftdi_jtag *jtag, int bits, const unsigned char *out,
+                          unsigned char *in, int end_state);
+    int ftdi_jtag_scan_dr(struct ftdi_jtag *jtag, int bits, const unsigned char *out,
+                          unsigned char *in, int end_state);
+    int ftdi_jtag_flush(struct ftdi_jtag *jtag);
+    struct ftdi_pattern_checker *ftdi_pattern_checker_new(int pattern);
+    void ftdi_pattern_checker_free(struct ftdi_pattern_checker *checker);
+    int ftdi_pattern_check(struct ftdi_pattern_checker *checker,
+                           const uint8_t *buffer, int length);
+    void ftdi_pattern_get_stats(struct ftdi_pattern_checker *checker,
+                                struct ftdi_pattern_stats *stats);
+    uint8_t ftdi_pattern_next_byte(int pattern, uint8_t value);
+    int ftdi_pattern_fill(int pattern, uint8_t *buffer, int length, uint32_t *value);
+    struct ftdi_capture_writer *ftdi_capture_open_write(const char *path,
+                                                        struct ftdi_context *ftdi,
+                                                        int bitmode, size_t chunk_size);
+    int ftdi_capture_write(struct ftdi_capture_writer *writer,
+                           const unsigned char *data, size_t length, uint64_t timestamp);
+    int ftdi_capture_callback(uint8_t *buffer, int length,
+                              FTDIProgressInfo *progress, void *userdata);
+    int ftdi_capture_close_write(struct ftdi_capture_writer *writer);
+    struct ftdi_capture_reader *ftdi_capture_open_read(const char *path);
+    void ftdi_capture_close_read(struct ftdi_capture_reader *reader);
+    void ftdi_capture_get_info(struct ftdi_capture_reader *reader,
+                               struct ftdi_capture_info *info);
+    int ftdi_capture_get_chunk(struct ftdi_capture_reader *reader, int64_t index,
+                               struct ftdi_capture_chunk *chunk);
+    int64_t ftdi_capture_find_time(struct ftdi_capture_reader *reader, uint64_t timestamp);
+    int64_t ftdi_capture_find_offset(struct ftdi_capture_reader *reader, uint64_t offset);
+    struct ftdi_stream_group *ftdi_stream_group_new(void);
+    void ftdi_stream_group_free(struct ftdi_stream_group *group);
+    int ftdi_stream_group_add(struct ftdi_stream_group *group, struct ftdi_context *ftdi,
+                              const struct ftdi_stream_config *config,
+                              FTDIStreamCallback *callback, FTDIStreamProducer *producer,
+                              void *userdata);
+    int ftdi_stream_group_run(struct ftdi_stream_group *group,
+                              FTDIStreamCallback *report, double reportInterval,
+                              void *userdata);
+    int ftdi_stream_group_result(struct ftdi_stream_group *group, int index);
     int ftdi_readstream(struct ftdi_context *ftdi, FTDIStreamCallback *callback,
                         void *userdata, int packetsPerTransfer, int numTransfers);
+    int ftdi_readstream_whole(struct ftdi_context *ftdi, FTDIStreamCallback *callback,
+                              void *userdata, int packetsPerTransfer, int numTransfers);
+    int ftdi_writestream(struct ftdi_context *ftdi, FTDIStreamProducer *producer,
+                         void *userdata, int packetsPerTransfer, int numTransfers);
+    int ftdi_readwritestream(struct ftdi_context *ftdi, FTDIStreamCallback *callback,
+                             FTDIStreamProducer *producer, void *userdata,
+                             int packetsPerTransfer, int numTransfers);
+
+    struct ftdi_stream_ring *ftdi_stream_ring_new(size_t size);
+    void ftdi_stream_ring_free(struct ftdi_stream_ring *ring);
+    size_t ftdi_stream_ring_size(struct ftdi_stream_ring *ring);
+    size_t ftdi_stream_ring_write(struct ftdi_stream_ring *ring,
+                                  const unsigned char *data, size_t length);
+    size_t ftdi_stream_ring_fill(struct ftdi_stream_ring *ring);
+    size_t ftdi_stream_ring_peek(struct ftdi_stream_ring *ring, const unsigned char **data);
+    void ftdi_stream_ring_consume(struct ftdi_stream_ring *ring, size_t length);
+    size_t ftdi_stream_ring_read(struct ftdi_stream_ring *ring,
+                                 unsigned char *data, size_t length);
+    void ftdi_stream_ring_stop(struct ftdi_stream_ring *ring);
+    void ftdi_stream_ring_get_stats(struct ftdi_stream_ring *ring,
+                                    struct ftdi_stream_ring_stats *stats);
+    int ftdi_stream_ring_sink(uint8_t *buffer, int length,
+                              FTDIProgressInfo *progress, void *userdata);
     struct ftdi_transfer_control *ftdi_write_data_submit(struct ftdi_context *ftdi, unsigned char *buf, int size);
     void ftdi_async_complete(struct ftdi_context *ftdi, int wait_for_more);
 
     struct ftdi_transfer_control *ftdi_read_data_submit(struct ftdi_context *ftdi, unsigned char *buf, int size);
+    int ftdi_write_data_submit_cb(struct ftdi_context *ftdi, unsigned char *buf, int size,
+                                  FTDITransferCallback *callback, void *userdata);
+    int ftdi_read_data_submit_cb(struct ftdi_context *ftdi, unsigned char *buf, int size,
+                                 FTDITransferCallback *callback, void *userdata);
     int ftdi_transfer_data_done(struct ftdi_transfer_control *tc);
+    int ftdi_transfer_data_done_any(struct ftdi_transfer_control **tcs, int count, int timeout);
+    int ftdi_transfer_data_done_all(struct ftdi_transfer_control **tcs, int count, int timeout);
+
+    const struct libusb_pollfd **ftdi_get_pollfds(struct ftdi_context *ftdi);
+    void ftdi_free_pollfds(const struct libusb_pollfd **fds);
+    int ftdi_set_pollfd_notifiers(struct ftdi_context *ftdi,
+                                  libusb_pollfd_added_cb added_cb,
+                                  libusb_pollfd_removed_cb removed_cb,
+                                  void *user_data);
+    int ftdi_get_next_timeout(struct ftdi_context *ftdi, struct timeval *tv);
+    int ftdi_handle_events(struct ftdi_context *ftdi);
+    int ftdi_transfer_pool_set_size(struct ftdi_context *ftdi, unsigned int size);
+    int ftdi_transfer_pool_get_stats(struct ftdi_context *ftdi, struct ftdi_transfer_pool_stats *stats);
 
     int ftdi_set_bitmode(struct ftdi_context *ftdi, unsigned char bitmask, unsigned char mode);
     int ftdi_disable_bitbang(struct ftdi_context *ftdi);
@@ -0,0 +1,660 @@
+/***************************************************************************
+                          ftdi_capture.c  -  description
+                             -------------------
+    copyright            : (C) 2011 by the libftdi developers
+    email                : opensource@intra2net.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation;             *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * Capture container for stream recordings. All numbers are little endian.
+ *
+ *   file header   "FTDICAP\0", version, header size, chip type, bit mode,
+ *                 packet size, start time (us since the epoch)
+ *   chunk         "CHNK", payload length, host time (us), stream offset,
+ *                 payload
+ *   index block   "INDX", entry count, file position of the previous
+ *                 index block, entries of (time, offset, chunk position)
+ *                 for the chunks since the previous index block
+ *   trailer       "FTDIIDX\0", position of the last index block,
+ *                 number of chunks, number of payload bytes
+ *
+ * An index block is written every FTDI_CAPTURE_INDEX_INTERVAL chunks and
+ * on close, followed by the trailer. A reader follows the chain of index
+ * blocks from the trailer; a file without trailer (e.g. after a crash)
+ * is indexed by scanning its chunks.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "ftdi.h"
+
+#define FTDI_CAPTURE_VERSION        1
+#define FTDI_CAPTURE_HEADER_SIZE    64
+#define FTDI_CAPTURE_CHUNK_SIZE     24
+#define FTDI_CAPTURE_INDEX_SIZE     16
+#define FTDI_CAPTURE_ENTRY_SIZE     24
+#define FTDI_CAPTURE_TRAILER_SIZE   32
+#define FTDI_CAPTURE_INDEX_INTERVAL 1024
+
+static const char ftdi_capture_magic[8] = "FTDICAP";
+static const char ftdi_capture_trailer_magic[8] = "FTDIIDX";
+#define FTDI_CAPTURE_CHUNK_MAGIC    0x4b4e4843  /* "CHNK" */
+#define FTDI_CAPTURE_INDEX_MAGIC    0x58444e49  /* "INDX" */
+
+/* One index entry, kept in memory by writer and reader */
+struct ftdi_capture_entry
+{
+    uint64_t timestamp;
+    uint64_t offset;
+    uint64_t position;
+};
+
+struct ftdi_capture_writer
+{
+    FILE *file;
+    /** file position of the next write */
+    uint64_t position;
+    /** stream offset of the next payload byte */
+    uint64_t offset;
+    uint64_t num_chunks;
+    uint64_t last_index;
+    /** chunks not yet covered by an index block */
+    struct ftdi_capture_entry entries[FTDI_CAPTURE_INDEX_INTERVAL];
+    int num_entries;
+    /** data collected by ftdi_capture_callback() */
+    unsigned char *pending;
+    size_t pending_size;
+    size_t pending_length;
+    uint64_t pending_timestamp;
+    int error;
+};
+
+struct ftdi_capture_reader
+{
+    int fd;
+    const unsigned char *map;
+    uint64_t size;
+    struct ftdi_capture_info info;
+    struct ftdi_capture_entry *entries;
+    uint64_t num_entries;
+};
+
+static void put_le32(unsigned char *p, uint32_t v)
+{
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static void put_le64(unsigned char *p, uint64_t v)
+{
+    put_le32(p, (uint32_t)v);
+    put_le32(p + 4, (uint32_t)(v >> 32));
+}
+
+static uint32_t get_le32(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get_le64(const unsigned char *p)
+{
+    return get_le32(p) | ((uint64_t)get_le32(p + 4) << 32);
+}
+
+static uint64_t ftdi_capture_now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static int ftdi_capture_put(struct ftdi_capture_writer *writer,
+                            const void *data, size_t length)
+{
+    if (writer->error)
+        return writer->error;
+    if (length && fwrite(data, 1, length, writer->file) != length)
+    {
+        writer->error = errno ? -errno : -EIO;
+        return writer->error;
+    }
+    writer->position += length;
+    return 0;
+}
+
+/* Write an index block for the chunks since the previous one */
+static int ftdi_capture_put_index(struct ftdi_capture_writer *writer)
+{
+    unsigned char header[FTDI_CAPTURE_INDEX_SIZE];
+    uint64_t position = writer->position;
+    int i;
+
+    if (writer->num_entries == 0)
+        return writer->error;
+
+    put_le32(header, FTDI_CAPTURE_INDEX_MAGIC);
+    put_le32(header + 4, writer->num_entries);
+    put_le64(header + 8, writer->last_index);
+    ftdi_capture_put(writer, header, sizeof(header));
+    for (i = 0; i < writer->num_entries; i++)
+    {
+        unsigned char entry[FTDI_CAPTURE_ENTRY_SIZE];
+
+        put_le64(entry, writer->entries[i].timestamp);
+        put_le64(entry + 8, writer->entries[i].offset);
+        put_le64(entry + 16, writer->entries[i].position);
+        ftdi_capture_put(writer, entry, sizeof(entry));
+    }
+    writer->last_index = position;
+    writer->num_entries = 0;
+    return writer->error;
+}
+
+/**
+    Create a capture file
+
+    The header records the chip type and packet size of the device and
+    the bit mode the data is captured in.
+
+    \param path file to create, an existing file is truncated
+    \param ftdi pointer to the ftdi_context of the device
+    \param bitmode ftdi_mpsse_mode of the capture
+    \param chunk_size bytes ftdi_capture_callback() collects per chunk,
+           0 for 64 KiB, at most 4 GiB - 1
+
+    \retval pointer to the new writer, NULL on error with errno set
+*/
+struct ftdi_capture_writer *ftdi_capture_open_write(const char *path,
+                                                    struct ftdi_context *ftdi,
+                                                    int bitmode, size_t chunk_size)
+{
+    struct ftdi_capture_writer *writer;
+    unsigned char header[FTDI_CAPTURE_HEADER_SIZE];
+
+    if (path == NULL || ftdi == NULL || chunk_size > UINT32_MAX)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (chunk_size == 0)
+        chunk_size = 65536;
+
+    writer = (struct ftdi_capture_writer *)calloc(1, sizeof(struct ftdi_capture_writer));
+    if (writer == NULL)
+        return NULL;
+    writer->pending = (unsigned char *)malloc(chunk_size);
+    writer->pending_size = chunk_size;
+    writer->file = fopen(path, "wb");
+    if (writer->pending == NULL || writer->file == NULL)
+    {
+        if (writer->file)
+            fclose(writer->file);
+        free(writer->pending);
+        free(writer);
+        return NULL;
+    }
+
+    memset(header, 0, sizeof(header));
+    memcpy(header, ftdi_capture_magic, 8);
+    put_le32(header + 8, FTDI_CAPTURE_VERSION);
+    put_le32(header + 12, FTDI_CAPTURE_HEADER_SIZE);
+    put_le32(header + 16, ftdi->type);
+    put_le32(header + 20, bitmode);
+    put_le32(header + 24, ftdi->max_packet_size);
+    put_le64(header + 32, ftdi_capture_now());
+    if (ftdi_capture_put(writer, header, sizeof(header)) < 0)
+    {
+        fclose(writer->file);
+        free(writer->pending);
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+/**
+    Append a chunk to a capture file
+
+    \param writer capture writer
+    \param data payload of the chunk
+    \param length size of the payload, at most 4 GiB - 1
+    \param timestamp host time of the data in microseconds since the
+           epoch, 0 for now
+
+    \retval  0: all fine
+    \retval -EINVAL: invalid arguments or a chunk too large for the
+             file format, nothing is written
+    \retval <0: negative errno of a failed write
+*/
+int ftdi_capture_write(struct ftdi_capture_writer *writer,
+                       const unsigned char *data, size_t length, uint64_t timestamp)
+{
+    unsigned char header[FTDI_CAPTURE_CHUNK_SIZE];
+    struct ftdi_capture_entry *entry;
+
+    if (writer == NULL || (data == NULL && length) || length > UINT32_MAX)
+        return -EINVAL;
+    if (length == 0)
+        return writer->error;
+    if (timestamp == 0)
+        timestamp = ftdi_capture_now();
+
+    entry = &writer->entries[writer->num_entries++];
+    entry->timestamp = timestamp;
+    entry->offset = writer->offset;
+    entry->position = writer->position;
+
+    put_le32(header, FTDI_CAPTURE_CHUNK_MAGIC);
+    put_le32(header + 4, (uint32_t)length);
+    put_le64(header + 8, timestamp);
+    put_le64(header + 16, writer->offset);
+    ftdi_capture_put(writer, header, sizeof(header));
+    ftdi_capture_put(writer, data, length);
+    writer->offset += length;
+    writer->num_chunks++;
+
+    if (writer->num_entries == FTDI_CAPTURE_INDEX_INTERVAL)
+        ftdi_capture_put_index(writer);
+    return writer->error;
+}
+
+/* Write the data collected by ftdi_capture_callback() as one chunk */
+static int ftdi_capture_flush_pending(struct ftdi_capture_writer *writer)
+{
+    int ret = 0;
+
+    if (writer->pending_length)
+        ret = ftdi_capture_write(writer, writer->pending, writer->pending_length,
+                                 writer->pending_timestamp);
+    writer->pending_length = 0;
+    return ret;
+}
+
+/**
+    Stream callback recording the received data into a capture file
+
+    Pass it to ftdi_readstream() or ftdi_stream_run() with the writer
+    as userdata. Received blocks are collected into chunks of the size
+    given to ftdi_capture_open_write(); each chunk carries the time its
+    first block arrived. The stream ends when writing failed.
+
+    Writing happens in the stream callback; for high rates run a writer
+    on a separate thread, e.g. fed from ftdi_stream_ring_sink().
+
+    \param buffer received data, NULL for progress reports
+    \param length size of the received data
+    \param progress progress report, ignored
+    \param userdata the ftdi_capture_writer
+
+    \retval 0: continue streaming
+    \retval 1: writing failed
+*/
+int ftdi_capture_callback(uint8_t *buffer, int length,
+                          FTDIProgressInfo *progress, void *userdata)
+{
+    struct ftdi_capture_writer *writer = (struct ftdi_capture_writer *)userdata;
+
+    (void)progress;
+    while (buffer != NULL && length > 0 && !writer->error)
+    {
+        size_t n = writer->pending_size - writer->pending_length;
+
+        if (n > (size_t)length)
+            n = length;
+        if (writer->pending_length == 0)
+            writer->pending_timestamp = ftdi_capture_now();
+        memcpy(writer->pending + writer->pending_length, buffer, n);
+        writer->pending_length += n;
+        buffer += n;
+        length -= n;
+
+        if (writer->pending_length == writer->pending_size)
+            ftdi_capture_flush_pending(writer);
+    }
+    return writer->error ? 1 : 0;
+}
+
+/**
+    Finish and close a capture file
+
+    Writes any data collected by ftdi_capture_callback(), the final index
+    block and the trailer.
+
+    \param writer capture writer, freed by this call
+
+    \retval  0: all fine
+    \retval <0: negative errno of a failed write
+*/
+int ftdi_capture_close_write(struct ftdi_capture_writer *writer)
+{
+    unsigned char trailer[FTDI_CAPTURE_TRAILER_SIZE];
+    int ret;
+
+    if (writer == NULL)
+        return -EINVAL;
+
+    ftdi_capture_flush_pending(writer);
+    ftdi_capture_put_index(writer);
+
+    memcpy(trailer, ftdi_capture_trailer_magic, 8);
+    put_le64(trailer + 8, writer->last_index);
+    put_le64(trailer + 16, writer->num_chunks);
+    put_le64(trailer + 24, writer->offset);
+    ftdi_capture_put(writer, trailer, sizeof(trailer));
+
+    ret = writer->error;
+    if (fclose(writer->file) != 0 && !ret)
+        ret = errno ? -errno : -EIO;
+    free(writer->pending);
+    free(writer);
+    return ret;
+}
+
+/* Build the index from the chain of index blocks, 0 if it is unusable */
+static int ftdi_capture_load_index(struct ftdi_capture_reader *reader)
+{
+    const unsigned char *trailer;
+    uint64_t position, count, filled;
+
+    if (reader->size < FTDI_CAPTURE_HEADER_SIZE + FTDI_CAPTURE_TRAILER_SIZE)
+        return 0;
+    trailer = reader->map + reader->size - FTDI_CAPTURE_TRAILER_SIZE;
+    if (memcmp(trailer, ftdi_capture_trailer_magic, 8) != 0)
+        return 0;
+
+    position = get_le64(trailer + 8);
+    count = get_le64(trailer + 16);
+    if (count > reader->size / FTDI_CAPTURE_CHUNK_SIZE)
+        return 0;
+
+    reader->entries = (struct ftdi_capture_entry *)calloc(count ? count : 1,
+                                                          sizeof(struct ftdi_capture_entry));
+    if (reader->entries == NULL)
+        return 0;
+
+    /* Index blocks are chained backwards, fill the entries from the end */
+    filled = 0;
+    while (filled < count)
+    {
+        const unsigned char *block;
+        uint32_t n, i;
+
+        if (position < FTDI_CAPTURE_HEADER_SIZE ||
+            position > reader->size - FTDI_CAPTURE_INDEX_SIZE)
+            return 0;
+        block = reader->map + position;
+        n = get_le32(block + 4);
+        if (get_le32(block) != FTDI_CAPTURE_INDEX_MAGIC || n > count - filled ||
+            position + FTDI_CAPTURE_INDEX_SIZE + (uint64_t)n * FTDI_CAPTURE_ENTRY_SIZE > reader->size)
+            return 0;
+
+        for (i = 0; i < n; i++)
+        {
+            const unsigned char *e = block + FTDI_CAPTURE_INDEX_SIZE + i * FTDI_CAPTURE_ENTRY_SIZE;
+            struct ftdi_capture_entry *entry = &reader->entries[count - filled - n + i];
+
+            entry->timestamp = get_le64(e);
+            entry->offset = get_le64(e + 8);
+            entry->position = get_le64(e + 16);
+        }
+        filled += n;
+        position = get_le64(block + 8);
+    }
+    reader->num_entries = count;
+    reader->info.total_bytes = get_le64(trailer + 24);
+    return 1;
+}
+
+/* Build the index by walking all chunks of a file without trailer */
+static int ftdi_capture_scan_index(struct ftdi_capture_reader *reader)
+{
+    uint64_t position = FTDI_CAPTURE_HEADER_SIZE;
+    uint64_t capacity = 0;
+
+    free(reader->entries);
+    reader->entries = NULL;
+    reader->num_entries = 0;
+    reader->info.total_bytes = 0;
+
+    while (position + FTDI_CAPTURE_CHUNK_SIZE <= reader->size)
+    {
+        const unsigned char *p = reader->map + position;
+        uint32_t magic = get_le32(p);
+        uint32_t length = get_le32(p + 4);
+
+        if (magic == FTDI_CAPTURE_INDEX_MAGIC)
+        {
+            position += FTDI_CAPTURE_INDEX_SIZE + (uint64_t)length * FTDI_CAPTURE_ENTRY_SIZE;
+            continue;
+        }
+        if (magic != FTDI_CAPTURE_CHUNK_MAGIC ||
+            position + FTDI_CAPTURE_CHUNK_SIZE + length > reader->size)
+            break;
+
+        if (reader->num_entries == capacity)
+        {
+            struct ftdi_capture_entry *entries;
+
+            capacity = capacity ? 2 * capacity : 1024;
+            entries = (struct ftdi_capture_entry *)realloc(reader->entries,
+                                                           capacity * sizeof(*entries));
+            if (entries == NULL)
+                return -1;
+            reader->entries = entries;
+        }
+        reader->entries[reader->num_entries].timestamp = get_le64(p + 8);
+        reader->entries[reader->num_entries].offset = get_le64(p + 16);
+        reader->entries[reader->num_entries].position = position;
+        reader->num_entries++;
+        reader->info.total_bytes = get_le64(p + 16) + length;
+
+        position += FTDI_CAPTURE_CHUNK_SIZE + length;
+    }
+    return 0;
+}
+
+/**
+    Open a capture file for random access
+
+    The file is mapped into memory; chunk payloads are returned as
+    pointers into the mapping. The chunk index is read from the index
+    blocks, or rebuilt by scanning the file if it was not closed
+    properly.
+
+    \param path capture file
+
+    \retval pointer to the new reader, NULL on error with errno set
+*/
+struct ftdi_capture_reader *ftdi_capture_open_read(const char *path)
+{
+    struct ftdi_capture_reader *reader;
+    struct stat st;
+    void *map;
+
+    reader = (struct ftdi_capture_reader *)calloc(1, sizeof(struct ftdi_capture_reader));
+    if (reader == NULL)
+        return NULL;
+
+    reader->fd = open(path, O_RDONLY);
+    if (reader->fd < 0)
+        goto fail;
+    if (fstat(reader->fd, &st) < 0)
+        goto fail;
+    if ((uint64_t)st.st_size < FTDI_CAPTURE_HEADER_SIZE)
+    {
+        errno = EINVAL;
+        goto fail;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, reader->fd, 0);
+    if (map == MAP_FAILED)
+        goto fail;
+    reader->map = (const unsigned char *)map;
+    reader->size = st.st_size;
+
+    if (memcmp(reader->map, ftdi_capture_magic, 8) != 0 ||
+        get_le32(reader->map + 8) != FTDI_CAPTURE_VERSION)
+    {
+        errno = EINVAL;
+        goto fail;
+    }
+    reader->info.type = get_le32(reader->map + 16);
+    reader->info.bitmode = get_le32(reader->map + 20);
+    reader->info.packet_size = get_le32(reader->map + 24);
+    reader->info.start_time = get_le64(reader->map + 32);
+
+    if (!ftdi_capture_load_index(reader) && ftdi_capture_scan_index(reader) < 0)
+    {
+        errno = ENOMEM;
+        goto fail;
+    }
+    reader->info.num_chunks = reader->num_entries;
+    return reader;
+
+fail:
+    if (reader->map)
+        munmap((void *)reader->map, reader->size);
+    if (reader->fd >= 0)
+        close(reader->fd);
+    free(reader->entries);
+    free(reader);
+    return NULL;
+}
+
+/**
+    Close a capture file opened with ftdi_capture_open_read()
+
+    \param reader capture reader, may be NULL
+*/
+void ftdi_capture_close_read(struct ftdi_capture_reader *reader)
+{
+    if (reader == NULL)
+        return;
+    munmap((void *)reader->map, reader->size);
+    close(reader->fd);
+    free(reader->entries);
+    free(reader);
+}
+
+/**
+    Get the header data and totals of a capture file
+
+    \param reader capture reader
+    \param info filled with the capture information
+*/
+void ftdi_capture_get_info(struct ftdi_capture_reader *reader, struct ftdi_capture_info *info)
+{
+    *info = reader->info;
+}
+
+/**
+    Get one chunk of a capture file
+
+    \param reader capture reader
+    \param index chunk number, 0 .. num_chunks - 1
+    \param chunk filled with the chunk; data points into the mapping
+
+    \retval  0: all fine
+    \retval -1: invalid index
+    \retval -2: chunk damaged
+*/
+int ftdi_capture_get_chunk(struct ftdi_capture_reader *reader, int64_t index,
+                           struct ftdi_capture_chunk *chunk)
+{
+    const unsigned char *p;
+    uint64_t position;
+    uint32_t length;
+
+    if (reader == NULL || index < 0 || (uint64_t)index >= reader->num_entries)
+        return -1;
+
+    position = reader->entries[index].position;
+    if (position > reader->size - FTDI_CAPTURE_CHUNK_SIZE)
+        return -2;
+    p = reader->map + position;
+    length = get_le32(p + 4);
+    if (get_le32(p) != FTDI_CAPTURE_CHUNK_MAGIC ||
+        position + FTDI_CAPTURE_CHUNK_SIZE + length > reader->size)
+        return -2;
+
+    chunk->timestamp = get_le64(p + 8);
+    chunk->offset = get_le64(p + 16);
+    chunk->length = length;
+    chunk->data = p + FTDI_CAPTURE_CHUNK_SIZE;
+    return 0;
+}
+
+/**
+    Find the chunk covering a point in time
+
+    Binary search over the index.
+
+    \param reader capture reader
+    \param timestamp host time in microseconds since the epoch
+
+    \retval >=0: index of the last chunk that started at or before timestamp
+    \retval -1: timestamp lies before the first chunk or the file is empty
+*/
+int64_t ftdi_capture_find_time(struct ftdi_capture_reader *reader, uint64_t timestamp)
+{
+    int64_t lo = 0, hi = reader->num_entries;
+
+    /* first entry later than timestamp */
+    while (lo < hi)
+    {
+        int64_t mid = lo + (hi - lo) / 2;
+
+        if (reader->entries[mid].timestamp <= timestamp)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo - 1;
+}
+
+/**
+    Find the chunk containing a byte of the recorded stream
+
+    Binary search over the index.
+
+    \param reader capture reader
+    \param offset position in the recorded stream, counted from 0
+
+    \retval >=0: index of the chunk containing offset
+    \retval -1: offset lies beyond the recorded data
+*/
+int64_t ftdi_capture_find_offset(struct ftdi_capture_reader *reader, uint64_t offset)
+{
+    int64_t lo = 0, hi = reader->num_entries;
+
+    if (offset >= reader->info.total_bytes)
+        return -1;
+
+    while (lo < hi)
+    {
+        int64_t mid = lo + (hi - lo) / 2;
+
+        if (reader->entries[mid].offset <= offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo - 1;
+}
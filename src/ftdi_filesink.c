@@ -0,0 +1,433 @@
+/***************************************************************************
+                          ftdi_filesink.c  -  description
+                             -------------------
+    copyright            : (C) 2011 by the libftdi developers
+    email                : opensource@intra2net.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation;             *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * Stream sink writing the received data to a file. The stream callback
+ * only copies into large page aligned buffers; full buffers are handed
+ * to a writer thread, so disk latency never stalls USB servicing. When
+ * the writer falls behind and no buffer is free, data is dropped and
+ * counted instead of blocking the callback.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     /* O_DIRECT */
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "ftdi.h"
+
+struct ftdi_file_sink
+{
+    int fd;
+    int direct;
+    size_t buffer_size;
+    int num_buffers;
+    /** page aligned buffers, num_buffers of buffer_size bytes */
+    unsigned char **buffers;
+    /** bytes stored in each buffer */
+    size_t *fill;
+    /** buffer filled by the stream callback, -1 if none is free */
+    int current;
+    /** full buffers in write order, a queue of num_buffers entries */
+    int *queue;
+    int queue_head;
+    int queue_count;
+    /** free buffers, a stack of num_buffers entries */
+    int *free_list;
+    int num_free;
+    int closing;
+    int error;
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    struct ftdi_file_sink_stats stats;
+};
+
+/* Writer thread: write full buffers in order until closing. After a
+ * failed write the file ends there, later buffers are only recycled so
+ * the file never has a gap in the data */
+static void *
+ftdi_file_sink_writer(void *arg)
+{
+    struct ftdi_file_sink *sink = (struct ftdi_file_sink *)arg;
+
+    pthread_mutex_lock(&sink->lock);
+    for (;;)
+    {
+        int index, err = 0;
+        size_t done = 0, length;
+
+        while (sink->queue_count == 0 && !sink->closing)
+            pthread_cond_wait(&sink->wakeup, &sink->lock);
+        if (sink->queue_count == 0)
+            break;
+
+        index = sink->queue[sink->queue_head];
+        sink->queue_head = (sink->queue_head + 1) % sink->num_buffers;
+        sink->queue_count--;
+        length = sink->error ? 0 : sink->fill[index];
+        pthread_mutex_unlock(&sink->lock);
+
+        /* With O_DIRECT only whole pages go out, the tail is written
+         * by ftdi_file_sink_close() after clearing the flag */
+        while (done < length)
+        {
+            ssize_t n = write(sink->fd, sink->buffers[index] + done, length - done);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                err = -errno;
+                break;
+            }
+            done += n;
+        }
+
+        pthread_mutex_lock(&sink->lock);
+        if (err && !sink->error)
+            sink->error = err;
+        sink->stats.bytes_written += done;
+        sink->fill[index] = 0;
+        sink->free_list[sink->num_free++] = index;
+        pthread_cond_broadcast(&sink->wakeup);
+    }
+    pthread_mutex_unlock(&sink->lock);
+    return NULL;
+}
+
+/**
+    Set a file sink configuration to the defaults: two 4 MiB buffers,
+    buffered I/O, no preallocation.
+
+    \param config configuration to initialize
+*/
+void
+ftdi_file_sink_config_init(struct ftdi_file_sink_config *config)
+{
+    config->buffer_size = 4 << 20;
+    config->num_buffers = 2;
+    config->direct = 0;
+    config->preallocate = 0;
+}
+
+/**
+    Create a file and start the writer thread of a file sink
+
+    Use ftdi_file_sink_callback() with the sink as userdata as stream
+    callback. With config->direct the file is opened with O_DIRECT
+    where available, bypassing the page cache; file systems rejecting
+    it, e.g. tmpfs, get buffered I/O instead. config->preallocate
+    reserves that many bytes on disk up front; the file is truncated
+    to the data actually written on close. If the disk lacks the space,
+    opening fails with errno ENOSPC or EFBIG; on file systems without
+    preallocation the sink works without it, see
+    ftdi_file_sink_stats.preallocated.
+
+    \param path file to create, an existing file is truncated
+    \param config sink configuration, NULL for the defaults
+
+    \retval pointer to the new sink, NULL on error with errno set
+*/
+struct ftdi_file_sink *
+ftdi_file_sink_open(const char *path, const struct ftdi_file_sink_config *config)
+{
+    struct ftdi_file_sink_config defaults;
+    struct ftdi_file_sink *sink;
+    long page = sysconf(_SC_PAGESIZE);
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    int i;
+
+    if (config == NULL)
+    {
+        ftdi_file_sink_config_init(&defaults);
+        config = &defaults;
+    }
+    if (path == NULL || config->buffer_size == 0 || config->num_buffers < 2)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (page <= 0)
+        page = 4096;
+
+    sink = (struct ftdi_file_sink *)calloc(1, sizeof(struct ftdi_file_sink));
+    if (sink == NULL)
+        return NULL;
+
+    sink->buffer_size = (config->buffer_size + page - 1) / page * page;
+    sink->num_buffers = config->num_buffers;
+    sink->buffers = (unsigned char **)calloc(sink->num_buffers, sizeof(*sink->buffers));
+    sink->fill = (size_t *)calloc(sink->num_buffers, sizeof(*sink->fill));
+    sink->queue = (int *)calloc(sink->num_buffers, sizeof(*sink->queue));
+    sink->free_list = (int *)calloc(sink->num_buffers, sizeof(*sink->free_list));
+    if (!sink->buffers || !sink->fill || !sink->queue || !sink->free_list)
+        goto fail;
+
+    for (i = 0; i < sink->num_buffers; i++)
+    {
+        void *buffer;
+
+        if (posix_memalign(&buffer, page, sink->buffer_size))
+            goto fail;
+        sink->buffers[i] = (unsigned char *)buffer;
+    }
+    /* buffer 0 is filled first, the others wait on the free list */
+    sink->current = 0;
+    for (i = sink->num_buffers - 1; i > 0; i--)
+        sink->free_list[sink->num_free++] = i;
+
+#ifdef O_DIRECT
+    if (config->direct)
+    {
+        flags |= O_DIRECT;
+        sink->direct = 1;
+    }
+#endif
+    sink->fd = open(path, flags, 0666);
+#ifdef O_DIRECT
+    if (sink->fd < 0 && errno == EINVAL && sink->direct)
+    {
+        sink->direct = 0;
+        sink->fd = open(path, flags & ~O_DIRECT, 0666);
+    }
+#endif
+    if (sink->fd < 0)
+        goto fail;
+
+    /* Running out of space fails right away, a file system that cannot
+     * preallocate only costs the speed up */
+    if (config->preallocate > 0)
+    {
+        int err = posix_fallocate(sink->fd, 0, config->preallocate);
+
+        if (err == ENOSPC || err == EFBIG)
+        {
+            close(sink->fd);
+            unlink(path);
+            errno = err;
+            goto fail;
+        }
+        if (err == 0)
+            sink->stats.preallocated = config->preallocate;
+    }
+
+    pthread_mutex_init(&sink->lock, NULL);
+    pthread_cond_init(&sink->wakeup, NULL);
+    if (pthread_create(&sink->writer, NULL, ftdi_file_sink_writer, sink))
+    {
+        pthread_cond_destroy(&sink->wakeup);
+        pthread_mutex_destroy(&sink->lock);
+        close(sink->fd);
+        unlink(path);
+        goto fail;
+    }
+    return sink;
+
+fail:
+    if (sink->buffers)
+    {
+        for (i = 0; i < sink->num_buffers; i++)
+            free(sink->buffers[i]);
+    }
+    free(sink->buffers);
+    free(sink->fill);
+    free(sink->queue);
+    free(sink->free_list);
+    free(sink);
+    return NULL;
+}
+
+/* Queue the current buffer for writing and take the next free one,
+ * called with the lock held */
+static void
+ftdi_file_sink_queue_current(struct ftdi_file_sink *sink)
+{
+    int tail = (sink->queue_head + sink->queue_count) % sink->num_buffers;
+
+    sink->queue[tail] = sink->current;
+    sink->queue_count++;
+    sink->current = sink->num_free ? sink->free_list[--sink->num_free] : -1;
+    pthread_cond_broadcast(&sink->wakeup);
+}
+
+/**
+    Stream callback storing the received data through a file sink.
+
+    Pass it to ftdi_readstream() or ftdi_stream_run() with the sink as
+    userdata. The data is only copied; when all buffers wait for the
+    writer, it is dropped and counted in the statistics. The stream
+    ends when writing to the file failed.
+
+    \param buffer received data, NULL for progress reports
+    \param length size of the received data
+    \param progress progress report, ignored
+    \param userdata the ftdi_file_sink
+
+    \retval 0: continue streaming
+    \retval 1: writing to the file failed
+*/
+int
+ftdi_file_sink_callback(uint8_t *buffer, int length,
+                        FTDIProgressInfo *progress, void *userdata)
+{
+    struct ftdi_file_sink *sink = (struct ftdi_file_sink *)userdata;
+    uint64_t lag;
+    int ret;
+
+    (void)progress;
+    pthread_mutex_lock(&sink->lock);
+    if (buffer == NULL)
+        length = 0;
+    sink->stats.bytes_received += length;
+    while (length > 0)
+    {
+        size_t room, n;
+
+        if (sink->current < 0)
+        {
+            if (sink->num_free == 0)
+            {
+                sink->stats.bytes_dropped += length;
+                sink->stats.overflows++;
+                break;
+            }
+            sink->current = sink->free_list[--sink->num_free];
+        }
+
+        room = sink->buffer_size - sink->fill[sink->current];
+        n = (size_t)length < room ? (size_t)length : room;
+        memcpy(sink->buffers[sink->current] + sink->fill[sink->current], buffer, n);
+        sink->fill[sink->current] += n;
+        buffer += n;
+        length -= n;
+
+        if (sink->fill[sink->current] == sink->buffer_size)
+            ftdi_file_sink_queue_current(sink);
+    }
+
+    lag = sink->stats.bytes_received - sink->stats.bytes_dropped - sink->stats.bytes_written;
+    if (lag > sink->stats.max_lag)
+        sink->stats.max_lag = lag;
+    ret = sink->error ? 1 : 0;
+    pthread_mutex_unlock(&sink->lock);
+    return ret;
+}
+
+/**
+    Get the statistics of a file sink. May be called from any thread.
+
+    \param sink file sink
+    \param stats filled with the current statistics; lag is the amount
+           of accepted data not yet written to the file
+*/
+void
+ftdi_file_sink_get_stats(struct ftdi_file_sink *sink, struct ftdi_file_sink_stats *stats)
+{
+    pthread_mutex_lock(&sink->lock);
+    *stats = sink->stats;
+    stats->lag = sink->stats.bytes_received - sink->stats.bytes_dropped -
+                 sink->stats.bytes_written;
+    pthread_mutex_unlock(&sink->lock);
+}
+
+/**
+    Flush and close a file sink
+
+    Writes the remaining data, stops the writer thread and closes the
+    file. The stream using the sink must have ended. After a failed
+    write the file holds the data up to the failure only.
+
+    \param sink file sink, freed by this call
+
+    \retval 0: all data written
+    \retval <0: negative errno of the first failed write
+*/
+int
+ftdi_file_sink_close(struct ftdi_file_sink *sink)
+{
+    size_t tail = 0;
+    int tail_index;
+    int ret, i;
+
+    if (sink == NULL)
+        return -EINVAL;
+
+    /* With O_DIRECT only whole pages are queued, the tail goes out
+     * after the writer is done and the flag is cleared */
+    pthread_mutex_lock(&sink->lock);
+    tail_index = sink->current;
+    if (tail_index >= 0 && sink->fill[tail_index] > 0)
+    {
+        tail = sink->fill[tail_index];
+        if (!sink->direct)
+        {
+            ftdi_file_sink_queue_current(sink);
+            tail = 0;
+        }
+    }
+    sink->closing = 1;
+    pthread_cond_broadcast(&sink->wakeup);
+    pthread_mutex_unlock(&sink->lock);
+
+    pthread_join(sink->writer, NULL);
+
+    if (tail > 0 && !sink->error)
+    {
+        size_t done = 0;
+
+#ifdef O_DIRECT
+        fcntl(sink->fd, F_SETFL, fcntl(sink->fd, F_GETFL) & ~O_DIRECT);
+#endif
+        while (done < tail)
+        {
+            ssize_t n = write(sink->fd, sink->buffers[tail_index] + done, tail - done);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                sink->error = -errno;
+                break;
+            }
+            done += n;
+        }
+        sink->stats.bytes_written += done;
+    }
+
+    /* Drop preallocated space beyond the data */
+    if (ftruncate(sink->fd, sink->stats.bytes_written) < 0 && !sink->error)
+        sink->error = -errno;
+    if (close(sink->fd) < 0 && !sink->error)
+        sink->error = -errno;
+
+    ret = sink->error;
+    pthread_cond_destroy(&sink->wakeup);
+    pthread_mutex_destroy(&sink->lock);
+    for (i = 0; i < sink->num_buffers; i++)
+        free(sink->buffers[i]);
+    free(sink->buffers);
+    free(sink->fill);
+    free(sink->queue);
+    free(sink->free_list);
+    free(sink);
+    return ret;
+}
@@ -128,3 +128,156 @@ struct ftdi_eeprom
     unsigned char buf[FTDI_MAX_EEPROM_SIZE];
 };
 
+
+/**
+    \brief Read-ahead state, see ftdi_readahead_start()
+*/
+struct ftdi_readahead
+{
+    /** context the engine reads for */
+    struct ftdi_context *ftdi;
+    /** bulk-IN transfers owned by the read-ahead engine */
+    struct libusb_transfer **transfers;
+    /** per transfer: submitted before the last RX purge, payload gets dropped */
+    unsigned char *stale;
+    /** number of transfers */
+    int num_transfers;
+    /** raw size of a single transfer */
+    int transfer_size;
+    /** transfers currently submitted to libusb */
+    int in_flight;
+    /** transfers not resubmitted because the ring is full */
+    int parked;
+    /** counts every completed transfer, even empty ones */
+    unsigned int completions;
+    /** sticky libusb error of a failed transfer */
+    int error;
+    /** set while the transfers get cancelled */
+    int stopping;
+    /** stopped with transfers still in flight, the last one frees the engine */
+    int orphaned;
+
+    /** ring buffer with the payload, status bytes already stripped */
+    unsigned char *ring;
+    /** size of the ring buffer */
+    unsigned int ring_size;
+    /** read position in the ring buffer */
+    unsigned int ring_head;
+    /** number of payload bytes in the ring buffer */
+    unsigned int ring_count;
+
+    /** asynchronous read waiting for data, see ftdi_read_data_submit() */
+    struct ftdi_transfer_control *pending;
+    /** when the pending read times out, usb_read_timeout after its submission */
+    struct timeval pending_deadline;
+};
+
+/* Default number of idle objects kept by the transfer pool */
+#define FTDI_TRANSFER_POOL_SIZE 8
+
+/**
+    \brief Free lists of the asynchronous API, see ftdi_transfer_pool_set_size()
+*/
+struct ftdi_transfer_pool
+{
+    /** idle transfer controls */
+    struct ftdi_transfer_control **tcs;
+    /** number of idle transfer controls */
+    unsigned int num_tcs;
+    /** idle libusb transfers */
+    struct libusb_transfer **transfers;
+    /** number of idle libusb transfers */
+    unsigned int num_transfers;
+    /** maximum number of idle objects of each kind */
+    unsigned int size;
+    /** hit/miss counters */
+    struct ftdi_transfer_pool_stats stats;
+};
+
+/**
+    \brief Single producer / single consumer ring, see ftdi_stream_ring_new()
+*/
+struct ftdi_stream_ring
+{
+    /** storage, size bytes */
+    unsigned char *buffer;
+    /** capacity, a power of two */
+    size_t size;
+    /** total bytes written, only changed by the producer */
+    size_t head;
+    /** total bytes read, only changed by the consumer */
+    size_t tail;
+    /** set by ftdi_stream_ring_stop() */
+    int stop;
+    /** counters, only changed by the producer */
+    struct ftdi_stream_ring_stats stats;
+};
+
+/**
+    \brief Run control of a stream, see ftdi_stream_control_new()
+*/
+struct ftdi_stream_control
+{
+    /** set by ftdi_stream_pause(), cleared by ftdi_stream_resume() */
+    int paused;
+    /** set by ftdi_stream_stop(), cleared when a stream stopped because of it */
+    int stop;
+};
+
+/* Internal helpers shared between the source files */
+#define ftdi_error_return(code, str) do {  \
+        ftdi->error_str = str;             \
+        return code;                       \
+   } while(0);
+
+/* Keeps helpers shared between the source files out of the shared library's ABI */
+#if defined(__GNUC__) && !defined(_WIN32)
+#define FTDI_INTERNAL __attribute__((visibility("hidden")))
+#else
+#define FTDI_INTERNAL
+#endif
+
+/* Samples kept for the rolling window rate, spread over one window */
+#define FTDI_STREAM_RATE_SAMPLES 16
+
+/**
+    \brief Byte count samples behind FTDIProgressInfo.windowRate
+*/
+typedef struct
+{
+    struct size_and_time samples[FTDI_STREAM_RATE_SAMPLES];
+    int next;
+    int count;
+} FTDIRateWindow;
+
+/**
+    \brief Fill level of an MPSSE command queue, see ftdi_mpsse_queue_mark()
+*/
+struct ftdi_mpsse_mark
+{
+    int num_commands;
+    int num_replies;
+    int reply_length;
+};
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+FTDI_INTERNAL void ftdi_now(struct timeval *tv);
+FTDI_INTERNAL void ftdi_stream_sample_rate(FTDIRateWindow *w, const FTDIProgressInfo *progress,
+                                           const struct timeval *now, double window);
+FTDI_INTERNAL double ftdi_stream_window_rate(const FTDIRateWindow *w, const FTDIProgressInfo *progress,
+                                             const struct timeval *now, double window);
+FTDI_INTERNAL void ftdi_stream_update_progress(FTDIProgressInfo *progress, const FTDIRateWindow *w,
+                                               const struct timeval *now, double window);
+FTDI_INTERNAL void ftdi_transfer_data_drop(struct ftdi_transfer_control *tc);
+FTDI_INTERNAL void ftdi_mpsse_queue_mark(struct ftdi_mpsse_queue *queue,
+                                         struct ftdi_mpsse_mark *mark);
+FTDI_INTERNAL void ftdi_mpsse_queue_rollback(struct ftdi_mpsse_queue *queue,
+                                             const struct ftdi_mpsse_mark *mark);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,486 @@
+/***************************************************************************
+                          ftdi_i2c.c  -  description
+                             -------------------
+    copyright            : (C) 2011 by the libftdi developers
+    email                : opensource@intra2net.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation;             *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * I2C master on MPSSE. SCL is SK (ADBUS0), SDA is DO (ADBUS1) wired to
+ * DI (ADBUS2). SDA is released for a high level by switching it to an
+ * input, on the FT232H the pins are made open drain instead.
+ *
+ * Whole transactions are encoded into an MPSSE command queue: start,
+ * address, data bytes, repeated starts and stop, with every ACK bit
+ * read back in the same reply. Nothing branches on an ACK while the
+ * commands run, so after a NACK the remaining bytes are still clocked;
+ * the position of the first NACK is reported after the flush.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ftdi.h"
+#include "ftdi_i.h"
+
+#define FTDI_I2C_SCL 0x01
+#define FTDI_I2C_SDA 0x02
+#define FTDI_I2C_SDA_IN 0x04
+
+/* SET_BITS_LOW repeats to hold start and stop conditions */
+#define FTDI_I2C_HOLD 4
+
+/* ACK slots per block, blocks never move as reply destinations */
+#define FTDI_I2C_ACK_BLOCK 256
+
+struct ftdi_i2c_ack
+{
+    /** ACK bit as returned by the chip, bit 0 is SDA */
+    unsigned char value;
+    /** message and byte it belongs to, byte -1 for the address */
+    int msg;
+    int byte;
+};
+
+struct ftdi_i2c_transaction
+{
+    int first_ack;
+    int num_acks;
+};
+
+struct ftdi_i2c
+{
+    struct ftdi_context *ftdi;
+    struct ftdi_i2c_config config;
+    struct ftdi_mpsse_queue *queue;
+    /** SDA is open drain, FT232H only */
+    int open_drain;
+    struct ftdi_i2c_ack **acks;
+    int num_ack_blocks;
+    int num_acks;
+    struct ftdi_i2c_transaction *transactions;
+    int num_transactions;
+    int transactions_size;
+    /** results are valid, the next ftdi_i2c_queue() starts a new batch */
+    int flushed;
+};
+
+/**
+    Set an I2C configuration to the defaults: 100 kHz, three phase
+    clocking, other low byte pins inputs.
+
+    \param config configuration to initialize
+*/
+void ftdi_i2c_config_init(struct ftdi_i2c_config *config)
+{
+    config->frequency = 100000;
+    config->three_phase = 1;
+    config->gpio_value = 0;
+    config->gpio_direction = 0;
+}
+
+static int ftdi_i2c_is_h_type(struct ftdi_context *ftdi)
+{
+    return ftdi->type == TYPE_2232H || ftdi->type == TYPE_4232H || ftdi->type == TYPE_232H;
+}
+
+/* Queue one level of SCL and SDA, SDA high is released unless open drain */
+static int ftdi_i2c_pins(struct ftdi_i2c *i2c, int scl, int sda, int repeat)
+{
+    unsigned char value = (i2c->config.gpio_value & ~(FTDI_I2C_SCL | FTDI_I2C_SDA | FTDI_I2C_SDA_IN)) |
+                          (scl ? FTDI_I2C_SCL : 0) | (sda ? FTDI_I2C_SDA : 0);
+    unsigned char direction = (i2c->config.gpio_direction & ~(FTDI_I2C_SCL | FTDI_I2C_SDA | FTDI_I2C_SDA_IN)) |
+                              FTDI_I2C_SCL | ((sda && !i2c->open_drain) ? 0 : FTDI_I2C_SDA);
+    int ret = 0;
+
+    while (repeat-- > 0 && !ret)
+        ret = ftdi_mpsse_set_bits_low(i2c->queue, value, direction);
+    return ret;
+}
+
+/**
+    Set up an I2C master on an opened device
+
+    Switches the interface to MPSSE mode and programs the clock. On H
+    type chips three phase clocking keeps SDA valid around both SCL
+    edges, as I2C requires; it reduces the clock to 2/3. On the FT232H
+    SCL and SDA are switched to open drain.
+
+    \param ftdi pointer to ftdi_context of an opened device
+    \param config I2C configuration, NULL for the defaults
+
+    \retval pointer to the new I2C master, NULL on error; the reason is
+            in ftdi_get_error_string() when ftdi is not NULL
+*/
+struct ftdi_i2c *ftdi_i2c_new(struct ftdi_context *ftdi, const struct ftdi_i2c_config *config)
+{
+    struct ftdi_i2c *i2c;
+    int h_type;
+
+    if (ftdi == NULL)
+        return NULL;
+    if (ftdi->usb_dev == NULL)
+    {
+        ftdi->error_str = "USB device unavailable";
+        return NULL;
+    }
+
+    i2c = (struct ftdi_i2c *)calloc(1, sizeof(struct ftdi_i2c));
+    if (i2c == NULL || (i2c->queue = ftdi_mpsse_queue_new(ftdi)) == NULL)
+    {
+        free(i2c);
+        ftdi->error_str = "out of memory";
+        return NULL;
+    }
+    i2c->ftdi = ftdi;
+    if (config)
+        i2c->config = *config;
+    else
+        ftdi_i2c_config_init(&i2c->config);
+
+    if (i2c->config.frequency <= 0)
+    {
+        ftdi_i2c_free(i2c);
+        ftdi->error_str = "invalid I2C configuration";
+        return NULL;
+    }
+
+    h_type = ftdi_i2c_is_h_type(ftdi);
+    i2c->open_drain = (ftdi->type == TYPE_232H);
+
+    if (ftdi_set_bitmode(ftdi, 0, BITMODE_RESET) < 0 ||
+        ftdi_set_bitmode(ftdi, 0, BITMODE_MPSSE) < 0 ||
+        ftdi_usb_purge_buffers(ftdi) < 0)
+    {
+        ftdi_i2c_free(i2c);
+        return NULL;
+    }
+
+    if (h_type)
+    {
+        unsigned char setup = DIS_ADAPTIVE;
+        if (ftdi_mpsse_queue_raw(i2c->queue, &setup, 1, NULL, 0) < 0)
+            goto no_mem;
+    }
+    if (i2c->open_drain)
+    {
+        unsigned char od[3] = { DRIVE_OPEN_COLLECTOR, FTDI_I2C_SCL | FTDI_I2C_SDA, 0 };
+        if (ftdi_mpsse_queue_raw(i2c->queue, od, sizeof(od), NULL, 0) < 0)
+            goto no_mem;
+    }
+    if (ftdi_mpsse_loopback(i2c->queue, 0) < 0)
+        goto no_mem;
+    if (ftdi_mpsse_set_clock(i2c->queue, i2c->config.frequency, i2c->config.three_phase, NULL) < 0)
+    {
+        ftdi_i2c_free(i2c);
+        ftdi->error_str = "I2C needs an MPSSE capable chip";
+        return NULL;
+    }
+    if (ftdi_i2c_pins(i2c, 1, 1, 1) < 0)
+        goto no_mem;
+    if (ftdi_mpsse_queue_flush(i2c->queue) < 0)
+    {
+        ftdi_i2c_free(i2c);
+        return NULL;
+    }
+    return i2c;
+
+no_mem:
+    ftdi_i2c_free(i2c);
+    ftdi->error_str = "out of memory";
+    return NULL;
+}
+
+/**
+    Free an I2C master, the device stays in MPSSE mode
+
+    \param i2c I2C master, may be NULL
+*/
+void ftdi_i2c_free(struct ftdi_i2c *i2c)
+{
+    int i;
+
+    if (i2c == NULL)
+        return;
+    for (i = 0; i < i2c->num_ack_blocks; i++)
+        free(i2c->acks[i]);
+    free(i2c->acks);
+    free(i2c->transactions);
+    ftdi_mpsse_queue_free(i2c->queue);
+    free(i2c);
+}
+
+/* Drop the results of the previous batch */
+static void ftdi_i2c_reset(struct ftdi_i2c *i2c)
+{
+    i2c->num_acks = 0;
+    i2c->num_transactions = 0;
+    i2c->flushed = 0;
+}
+
+/* Get a new ACK slot, NULL when out of memory */
+static struct ftdi_i2c_ack *ftdi_i2c_new_ack(struct ftdi_i2c *i2c, int msg, int byte)
+{
+    struct ftdi_i2c_ack *ack;
+    int block = i2c->num_acks / FTDI_I2C_ACK_BLOCK;
+
+    if (block == i2c->num_ack_blocks)
+    {
+        struct ftdi_i2c_ack **acks;
+
+        acks = (struct ftdi_i2c_ack **)realloc(i2c->acks, (block + 1) * sizeof(*acks));
+        if (acks == NULL)
+            return NULL;
+        i2c->acks = acks;
+        acks[block] = (struct ftdi_i2c_ack *)malloc(FTDI_I2C_ACK_BLOCK * sizeof(**acks));
+        if (acks[block] == NULL)
+            return NULL;
+        i2c->num_ack_blocks++;
+    }
+
+    ack = &i2c->acks[block][i2c->num_acks % FTDI_I2C_ACK_BLOCK];
+    ack->value = 0;
+    ack->msg = msg;
+    ack->byte = byte;
+    i2c->num_acks++;
+    return ack;
+}
+
+/* Queue a byte sent by the master and the read of its ACK bit */
+static int ftdi_i2c_put_byte(struct ftdi_i2c *i2c, unsigned char byte, int msg, int index)
+{
+    struct ftdi_i2c_ack *ack = ftdi_i2c_new_ack(i2c, msg, index);
+
+    if (ack == NULL)
+        return -2;
+    /* SDA driven, data changes while SCL is low */
+    if (ftdi_i2c_pins(i2c, 0, 0, 1) ||
+        ftdi_mpsse_shift_bits(i2c->queue, MPSSE_WRITE_NEG, &byte, NULL, 8) ||
+        ftdi_i2c_pins(i2c, 0, 1, 1) ||
+        ftdi_mpsse_shift_bits(i2c->queue, 0, NULL, &ack->value, 1))
+        return -2;
+    return 0;
+}
+
+/* Queue a byte read by the master and its ACK or NACK */
+static int ftdi_i2c_get_byte(struct ftdi_i2c *i2c, unsigned char *byte, int last)
+{
+    unsigned char ack = last ? 0xff : 0x00;
+
+    if (ftdi_i2c_pins(i2c, 0, 1, 1) ||
+        ftdi_mpsse_shift_bits(i2c->queue, 0, NULL, byte, 8) ||
+        ftdi_i2c_pins(i2c, 0, 0, 1) ||
+        ftdi_mpsse_shift_bits(i2c->queue, MPSSE_WRITE_NEG, &ack, NULL, 1))
+        return -2;
+    return 0;
+}
+
+/**
+    Queue an I2C transaction for ftdi_i2c_flush()
+
+    The messages are sent as one transaction: a start condition, each
+    message with its address byte, a repeated start between messages
+    and a stop condition at the end. Read buffers are filled and write
+    buffers have to stay valid until ftdi_i2c_flush().
+
+    \param i2c I2C master
+    \param msgs messages of the transaction
+    \param num number of messages
+
+    \retval >=0: number of the transaction in this batch, see ftdi_i2c_get_nack()
+    \retval -1: invalid arguments
+    \retval -2: out of memory, nothing of the transaction is queued
+*/
+int ftdi_i2c_queue(struct ftdi_i2c *i2c, const struct ftdi_i2c_msg *msgs, int num)
+{
+    struct ftdi_context *ftdi;
+    struct ftdi_i2c_transaction *transaction;
+    struct ftdi_mpsse_mark mark;
+    int m, i;
+
+    if (i2c == NULL)
+        return -1;
+    ftdi = i2c->ftdi;
+    if (msgs == NULL || num < 1)
+        ftdi_error_return(-1, "invalid I2C transaction");
+    for (m = 0; m < num; m++)
+    {
+        if (msgs[m].length < 0 || msgs[m].addr > 0x7f ||
+            (msgs[m].buf == NULL && msgs[m].length > 0))
+            ftdi_error_return(-1, "invalid I2C message");
+    }
+
+    if (i2c->flushed)
+        ftdi_i2c_reset(i2c);
+    if (i2c->num_transactions == i2c->transactions_size)
+    {
+        int size = i2c->transactions_size ? 2 * i2c->transactions_size : 16;
+        struct ftdi_i2c_transaction *transactions;
+
+        transactions = (struct ftdi_i2c_transaction *)realloc(i2c->transactions,
+                                                               size * sizeof(*transactions));
+        if (transactions == NULL)
+            ftdi_error_return(-2, "out of memory for I2C transaction");
+        i2c->transactions = transactions;
+        i2c->transactions_size = size;
+    }
+    transaction = &i2c->transactions[i2c->num_transactions];
+    transaction->first_ack = i2c->num_acks;
+    ftdi_mpsse_queue_mark(i2c->queue, &mark);
+
+    for (m = 0; m < num; m++)
+    {
+        const struct ftdi_i2c_msg *msg = &msgs[m];
+        int read = msg->flags & FTDI_I2C_READ;
+
+        /* start, or repeated start with SCL low first */
+        if (m > 0 && ftdi_i2c_pins(i2c, 0, 1, FTDI_I2C_HOLD))
+            goto no_mem;
+        if (ftdi_i2c_pins(i2c, 1, 1, FTDI_I2C_HOLD) ||
+            ftdi_i2c_pins(i2c, 1, 0, FTDI_I2C_HOLD) ||
+            ftdi_i2c_pins(i2c, 0, 0, FTDI_I2C_HOLD))
+            goto no_mem;
+
+        if (ftdi_i2c_put_byte(i2c, (msg->addr << 1) | (read ? 1 : 0), m, -1))
+            goto no_mem;
+        for (i = 0; i < msg->length; i++)
+        {
+            if (read ? ftdi_i2c_get_byte(i2c, msg->buf + i, i == msg->length - 1)
+                     : ftdi_i2c_put_byte(i2c, msg->buf[i], m, i))
+                goto no_mem;
+        }
+    }
+
+    /* stop */
+    if (ftdi_i2c_pins(i2c, 0, 0, FTDI_I2C_HOLD) ||
+        ftdi_i2c_pins(i2c, 1, 0, FTDI_I2C_HOLD) ||
+        ftdi_i2c_pins(i2c, 1, 1, FTDI_I2C_HOLD))
+        goto no_mem;
+
+    transaction->num_acks = i2c->num_acks - transaction->first_ack;
+    return i2c->num_transactions++;
+
+no_mem:
+    /* take back the half queued transaction, the ones before stay */
+    ftdi_mpsse_queue_rollback(i2c->queue, &mark);
+    i2c->num_acks = transaction->first_ack;
+    ftdi_error_return(-2, "out of memory for I2C transaction");
+}
+
+/**
+    Send all transactions queued with ftdi_i2c_queue()
+
+    Afterwards ftdi_i2c_get_nack() tells whether they were acknowledged.
+
+    \param i2c I2C master
+
+    \retval  0: all fine
+    \retval <0: see ftdi_mpsse_queue_flush()
+*/
+int ftdi_i2c_flush(struct ftdi_i2c *i2c)
+{
+    int ret;
+
+    if (i2c == NULL)
+        return -1;
+    ret = ftdi_mpsse_queue_flush(i2c->queue);
+    i2c->flushed = 1;
+    if (ret < 0)
+        i2c->num_transactions = 0;
+    return ret;
+}
+
+/**
+    Find the first byte of a flushed transaction that was not acknowledged
+
+    \param i2c I2C master
+    \param transaction number returned by ftdi_i2c_queue()
+    \param msg set to the message of the NACK, may be NULL
+    \param byte set to the byte of the NACK, -1 for the address byte,
+           may be NULL
+
+    \retval  0: all bytes acknowledged
+    \retval  1: NACK, msg and byte tell where
+    \retval -1: no such transaction
+*/
+int ftdi_i2c_get_nack(struct ftdi_i2c *i2c, int transaction, int *msg, int *byte)
+{
+    struct ftdi_i2c_transaction *t;
+    int i;
+
+    if (i2c == NULL || !i2c->flushed || transaction < 0 ||
+        transaction >= i2c->num_transactions)
+        return -1;
+
+    t = &i2c->transactions[transaction];
+    for (i = t->first_ack; i < t->first_ack + t->num_acks; i++)
+    {
+        struct ftdi_i2c_ack *ack = &i2c->acks[i / FTDI_I2C_ACK_BLOCK][i % FTDI_I2C_ACK_BLOCK];
+
+        if (ack->value & 0x01)
+        {
+            if (msg)
+                *msg = ack->msg;
+            if (byte)
+                *byte = ack->byte;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+    Run one I2C transaction
+
+    Shorthand for ftdi_i2c_queue(), ftdi_i2c_flush() and
+    ftdi_i2c_get_nack(). Transactions queued before are sent as well.
+
+    \param i2c I2C master
+    \param msgs messages of the transaction
+    \param num number of messages
+    \param msg set to the message of the first NACK, may be NULL
+    \param byte set to the byte of the first NACK, -1 for the address,
+           may be NULL
+
+    \retval  0: all bytes acknowledged
+    \retval  1: NACK, msg and byte tell where
+    \retval <0: see ftdi_i2c_queue() and ftdi_mpsse_queue_flush()
+*/
+int ftdi_i2c_transfer(struct ftdi_i2c *i2c, const struct ftdi_i2c_msg *msgs, int num,
+                      int *msg, int *byte)
+{
+    int transaction, ret;
+
+    transaction = ftdi_i2c_queue(i2c, msgs, num);
+    if (transaction < 0)
+        return transaction;
+    ret = ftdi_i2c_flush(i2c);
+    if (ret < 0)
+        return ret;
+    return ftdi_i2c_get_nack(i2c, transaction, msg, byte);
+}
+
+/**
+    Get the MPSSE command queue behind ftdi_i2c_queue()
+
+    Commands added to it, e.g. GPIO changes, are sent in order with the
+    queued I2C transactions.
+
+    \param i2c I2C master
+
+    \retval the command queue, NULL if i2c is NULL
+*/
+struct ftdi_mpsse_queue *ftdi_i2c_get_queue(struct ftdi_i2c *i2c)
+{
+    if (i2c == NULL)
+        return NULL;
+    return i2c->queue;
+}
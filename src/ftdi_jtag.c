@@ -0,0 +1,620 @@
+/***************************************************************************
+                          ftdi_jtag.c  -  description
+                             -------------------
+    copyright            : (C) 2011 by the libftdi developers
+    email                : opensource@intra2net.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation;             *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * JTAG master on MPSSE: TCK is ADBUS0, TDI ADBUS1, TDO ADBUS2 and TMS
+ * ADBUS3. The TAP state is tracked while commands are queued, so state
+ * changes take the shortest TMS sequence and whole scan sequences go
+ * out in one write with one reply read.
+ *
+ * Scans shift LSB first. All bits but the last go out as byte and bit
+ * shifts with TMS low; the last one is clocked with TMS high to leave
+ * the shift state. The chip returns captured bits of bit shifts at the
+ * top of the reply byte, they are moved into place after the flush.
+ *
+ * TMS commands drive TDI as well, the state changes queued here leave it
+ * low. Scans without data to send rely on that: their byte shifts only
+ * read, the other bits send zeros.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ftdi.h"
+#include "ftdi_i.h"
+
+#define FTDI_JTAG_TCK 0x01
+#define FTDI_JTAG_TDI 0x02
+#define FTDI_JTAG_TDO 0x04
+#define FTDI_JTAG_TMS 0x08
+
+/* TDI changes on the falling edge, TDO is sampled on the rising one */
+#define FTDI_JTAG_MODE (MPSSE_LSB | MPSSE_WRITE_NEG)
+
+/* Longest data phase of one MPSSE shift command */
+#define FTDI_JTAG_MAX_SHIFT 65536
+
+/* Bit fixups per block, blocks never move as reply destinations */
+#define FTDI_JTAG_FIXUP_BLOCK 256
+
+/* Captured bits of a bit shift, copied to dest after the flush */
+struct ftdi_jtag_fixup
+{
+    /** reply byte as returned by the chip */
+    unsigned char raw;
+    /** number of bits at the top of raw */
+    int count;
+    unsigned char *dest;
+    /** bit position in dest of the first bit */
+    int bit;
+};
+
+struct ftdi_jtag
+{
+    struct ftdi_context *ftdi;
+    struct ftdi_jtag_config config;
+    struct ftdi_mpsse_queue *queue;
+    int h_type;
+    /** TAP state after the queued commands */
+    int state;
+    struct ftdi_jtag_fixup **fixups;
+    int num_fixup_blocks;
+    int num_fixups;
+};
+
+/* Queue fill level and TAP state, to take back a failed operation */
+struct ftdi_jtag_mark
+{
+    struct ftdi_mpsse_mark queue;
+    int state;
+    int num_fixups;
+};
+
+/* Next TAP state for TMS low and TMS high */
+static const unsigned char ftdi_jtag_next[16][2] =
+{
+    /* RESET */     { FTDI_JTAG_IDLE,      FTDI_JTAG_RESET },
+    /* IDLE */      { FTDI_JTAG_IDLE,      FTDI_JTAG_DRSELECT },
+    /* DRSELECT */  { FTDI_JTAG_DRCAPTURE, FTDI_JTAG_IRSELECT },
+    /* DRCAPTURE */ { FTDI_JTAG_DRSHIFT,   FTDI_JTAG_DREXIT1 },
+    /* DRSHIFT */   { FTDI_JTAG_DRSHIFT,   FTDI_JTAG_DREXIT1 },
+    /* DREXIT1 */   { FTDI_JTAG_DRPAUSE,   FTDI_JTAG_DRUPDATE },
+    /* DRPAUSE */   { FTDI_JTAG_DRPAUSE,   FTDI_JTAG_DREXIT2 },
+    /* DREXIT2 */   { FTDI_JTAG_DRSHIFT,   FTDI_JTAG_DRUPDATE },
+    /* DRUPDATE */  { FTDI_JTAG_IDLE,      FTDI_JTAG_DRSELECT },
+    /* IRSELECT */  { FTDI_JTAG_IRCAPTURE, FTDI_JTAG_RESET },
+    /* IRCAPTURE */ { FTDI_JTAG_IRSHIFT,   FTDI_JTAG_IREXIT1 },
+    /* IRSHIFT */   { FTDI_JTAG_IRSHIFT,   FTDI_JTAG_IREXIT1 },
+    /* IREXIT1 */   { FTDI_JTAG_IRPAUSE,   FTDI_JTAG_IRUPDATE },
+    /* IRPAUSE */   { FTDI_JTAG_IRPAUSE,   FTDI_JTAG_IREXIT2 },
+    /* IREXIT2 */   { FTDI_JTAG_IRSHIFT,   FTDI_JTAG_IRUPDATE },
+    /* IRUPDATE */  { FTDI_JTAG_IDLE,      FTDI_JTAG_DRSELECT },
+};
+
+/**
+    Get the TAP state following a TCK cycle
+
+    \param state enum ftdi_jtag_state
+    \param tms level of TMS
+
+    \retval the next state, -1 for an invalid state
+*/
+int ftdi_jtag_next_state(int state, int tms)
+{
+    if (state < 0 || state > FTDI_JTAG_IRUPDATE)
+        return -1;
+    return ftdi_jtag_next[state][tms ? 1 : 0];
+}
+
+/**
+    Find the shortest TMS sequence between two TAP states
+
+    \param from current enum ftdi_jtag_state
+    \param to wanted enum ftdi_jtag_state
+    \param tms set to the TMS bits, first bit in bit 0
+
+    \retval number of TCK cycles, 0 when from equals to
+    \retval -1: invalid state
+*/
+int ftdi_jtag_tms_path(int from, int to, unsigned char *tms)
+{
+    /* breadth first search, paths are at most 8 bits */
+    int bits[16], length[16];
+    int queue[16], head = 0, tail = 0;
+
+    if (from < 0 || from > FTDI_JTAG_IRUPDATE || to < 0 || to > FTDI_JTAG_IRUPDATE)
+        return -1;
+
+    memset(length, -1, sizeof(length));
+    length[from] = 0;
+    bits[from] = 0;
+    queue[tail++] = from;
+    while (head < tail && length[to] < 0)
+    {
+        int state = queue[head++];
+        int t;
+
+        for (t = 0; t < 2; t++)
+        {
+            int next = ftdi_jtag_next[state][t];
+
+            if (length[next] >= 0)
+                continue;
+            length[next] = length[state] + 1;
+            bits[next] = bits[state] | (t << length[state]);
+            queue[tail++] = next;
+        }
+    }
+    *tms = bits[to];
+    return length[to];
+}
+
+/**
+    Set a JTAG configuration to the defaults: clock divisor 0, other low
+    byte pins inputs.
+
+    \param config configuration to initialize
+*/
+void ftdi_jtag_config_init(struct ftdi_jtag_config *config)
+{
+    config->divisor = 0;
+    config->frequency = 0;
+    config->gpio_value = 0;
+    config->gpio_direction = 0;
+}
+
+/**
+    Set up a JTAG master on an opened device
+
+    Switches the interface to MPSSE mode, programs the clock and moves
+    the TAP through Test-Logic-Reset to Run-Test/Idle. On H type chips
+    the divide by 5 prescaler is disabled, so TCK is
+    60 MHz / ((1 + divisor) * 2), otherwise 12 MHz / ((1 + divisor) * 2).
+    A config.frequency above 0 replaces the divisor by the fastest clock
+    not above it.
+
+    \param ftdi pointer to ftdi_context of an opened device
+    \param config JTAG configuration, NULL for the defaults
+
+    \retval pointer to the new JTAG master, NULL on error; the reason is
+            in ftdi_get_error_string() when ftdi is not NULL
+*/
+struct ftdi_jtag *ftdi_jtag_new(struct ftdi_context *ftdi, const struct ftdi_jtag_config *config)
+{
+    struct ftdi_jtag *jtag;
+    unsigned char pins = FTDI_JTAG_TCK | FTDI_JTAG_TDI | FTDI_JTAG_TDO | FTDI_JTAG_TMS;
+
+    if (ftdi == NULL)
+        return NULL;
+    if (ftdi->usb_dev == NULL)
+    {
+        ftdi->error_str = "USB device unavailable";
+        return NULL;
+    }
+
+    jtag = (struct ftdi_jtag *)calloc(1, sizeof(struct ftdi_jtag));
+    if (jtag == NULL || (jtag->queue = ftdi_mpsse_queue_new(ftdi)) == NULL)
+    {
+        free(jtag);
+        ftdi->error_str = "out of memory";
+        return NULL;
+    }
+    jtag->ftdi = ftdi;
+    if (config)
+        jtag->config = *config;
+    else
+        ftdi_jtag_config_init(&jtag->config);
+    jtag->h_type = (ftdi->type == TYPE_2232H || ftdi->type == TYPE_4232H ||
+                    ftdi->type == TYPE_232H);
+
+    if (ftdi_set_bitmode(ftdi, 0, BITMODE_RESET) < 0 ||
+        ftdi_set_bitmode(ftdi, 0, BITMODE_MPSSE) < 0 ||
+        ftdi_usb_purge_buffers(ftdi) < 0)
+    {
+        ftdi_jtag_free(jtag);
+        return NULL;
+    }
+
+    if (jtag->h_type)
+    {
+        /* ftdi_mpsse_set_clock() picks the prescaler and clocking itself */
+        unsigned char setup[] = { DIS_ADAPTIVE, DIS_DIV_5, DIS_3_PHASE };
+        int n = jtag->config.frequency > 0 ? 1 : sizeof(setup);
+
+        if (ftdi_mpsse_queue_raw(jtag->queue, setup, n, NULL, 0) < 0)
+            goto no_mem;
+    }
+    if (ftdi_mpsse_loopback(jtag->queue, 0) < 0)
+        goto no_mem;
+    if (jtag->config.frequency > 0)
+    {
+        if (ftdi_mpsse_set_clock(jtag->queue, jtag->config.frequency, 0, NULL) < 0)
+        {
+            ftdi_jtag_free(jtag);
+            ftdi->error_str = "JTAG clock needs an MPSSE capable chip";
+            return NULL;
+        }
+    }
+    else if (ftdi_mpsse_set_divisor(jtag->queue, jtag->config.divisor) < 0)
+        goto no_mem;
+    /* TCK low, TMS high, TDO input */
+    if (ftdi_mpsse_set_bits_low(jtag->queue,
+                                (jtag->config.gpio_value & ~pins) | FTDI_JTAG_TMS,
+                                (jtag->config.gpio_direction & ~pins) |
+                                FTDI_JTAG_TCK | FTDI_JTAG_TDI | FTDI_JTAG_TMS) < 0 ||
+        ftdi_jtag_reset(jtag) < 0 ||
+        ftdi_jtag_goto(jtag, FTDI_JTAG_IDLE) < 0)
+        goto no_mem;
+    if (ftdi_jtag_flush(jtag) < 0)
+    {
+        ftdi_jtag_free(jtag);
+        return NULL;
+    }
+    return jtag;
+
+no_mem:
+    ftdi_jtag_free(jtag);
+    ftdi->error_str = "out of memory";
+    return NULL;
+}
+
+/**
+    Free a JTAG master, the device stays in MPSSE mode
+
+    \param jtag JTAG master, may be NULL
+*/
+void ftdi_jtag_free(struct ftdi_jtag *jtag)
+{
+    int i;
+
+    if (jtag == NULL)
+        return;
+    for (i = 0; i < jtag->num_fixup_blocks; i++)
+        free(jtag->fixups[i]);
+    free(jtag->fixups);
+    ftdi_mpsse_queue_free(jtag->queue);
+    free(jtag);
+}
+
+/**
+    Get the TAP state the queued commands end in
+
+    \param jtag JTAG master
+
+    \retval enum ftdi_jtag_state, -1 if jtag is NULL
+*/
+int ftdi_jtag_get_state(struct ftdi_jtag *jtag)
+{
+    if (jtag == NULL)
+        return -1;
+    return jtag->state;
+}
+
+/**
+    Get the MPSSE command queue behind the JTAG master
+
+    Commands added to it, e.g. GPIO changes, are sent in order with the
+    queued JTAG operations. They must not clock TCK.
+
+    \param jtag JTAG master
+
+    \retval the command queue, NULL if jtag is NULL
+*/
+struct ftdi_mpsse_queue *ftdi_jtag_get_queue(struct ftdi_jtag *jtag)
+{
+    if (jtag == NULL)
+        return NULL;
+    return jtag->queue;
+}
+
+static void ftdi_jtag_mark(struct ftdi_jtag *jtag, struct ftdi_jtag_mark *mark)
+{
+    ftdi_mpsse_queue_mark(jtag->queue, &mark->queue);
+    mark->state = jtag->state;
+    mark->num_fixups = jtag->num_fixups;
+}
+
+/* Drop what was queued since ftdi_jtag_mark(), returns -2 for out of memory */
+static int ftdi_jtag_rollback(struct ftdi_jtag *jtag, const struct ftdi_jtag_mark *mark)
+{
+    ftdi_mpsse_queue_rollback(jtag->queue, &mark->queue);
+    jtag->state = mark->state;
+    jtag->num_fixups = mark->num_fixups;
+    jtag->ftdi->error_str = "out of memory for JTAG command";
+    return -2;
+}
+
+/* Queue TMS bits, first bit in bit 0, TDI held at tdi */
+static int ftdi_jtag_put_tms(struct ftdi_jtag *jtag, unsigned char tms, int bits, int tdi)
+{
+    struct ftdi_jtag_mark mark;
+
+    ftdi_jtag_mark(jtag, &mark);
+    while (bits > 0)
+    {
+        int n = bits > 7 ? 7 : bits;
+        int i;
+
+        if (ftdi_mpsse_write_tms(jtag->queue, MPSSE_WRITE_NEG, tms, n, tdi, NULL) < 0)
+            return ftdi_jtag_rollback(jtag, &mark);
+        for (i = 0; i < n; i++)
+            jtag->state = ftdi_jtag_next[jtag->state][(tms >> i) & 1];
+        tms >>= n;
+        bits -= n;
+    }
+    return 0;
+}
+
+/**
+    Queue five TCK cycles with TMS high, which reach Test-Logic-Reset
+    from any state
+
+    \param jtag JTAG master
+
+    \retval  0: all fine
+    \retval <0: see ftdi_mpsse_queue_raw()
+*/
+int ftdi_jtag_reset(struct ftdi_jtag *jtag)
+{
+    if (jtag == NULL)
+        return -1;
+    if (ftdi_mpsse_write_tms(jtag->queue, MPSSE_WRITE_NEG, 0x1f, 5, 0, NULL) < 0)
+        return -2;
+    jtag->state = FTDI_JTAG_RESET;
+    return 0;
+}
+
+/**
+    Queue moving the TAP to a state on the shortest path
+
+    \param jtag JTAG master
+    \param state wanted enum ftdi_jtag_state
+
+    \retval  0: all fine
+    \retval -1: invalid state
+    \retval -2: out of memory
+*/
+int ftdi_jtag_goto(struct ftdi_jtag *jtag, int state)
+{
+    unsigned char tms;
+    int bits;
+
+    if (jtag == NULL)
+        return -1;
+    bits = ftdi_jtag_tms_path(jtag->state, state, &tms);
+    if (bits < 0)
+    {
+        jtag->ftdi->error_str = "invalid JTAG state";
+        return -1;
+    }
+    return ftdi_jtag_put_tms(jtag, tms, bits, 0);
+}
+
+/**
+    Queue TCK cycles in Run-Test/Idle
+
+    The TAP is moved to Run-Test/Idle first.
+
+    \param jtag JTAG master
+    \param cycles number of TCK cycles
+
+    \retval  0: all fine
+    \retval <0: see ftdi_jtag_goto(), nothing is queued on failure
+*/
+int ftdi_jtag_run_test(struct ftdi_jtag *jtag, int cycles)
+{
+    struct ftdi_jtag_mark mark;
+    int ret;
+
+    if (jtag == NULL || cycles < 0)
+        return -1;
+    ftdi_jtag_mark(jtag, &mark);
+    ret = ftdi_jtag_goto(jtag, FTDI_JTAG_IDLE);
+
+    /* H type chips clock whole bytes without data, TMS stays low */
+    while (!ret && jtag->h_type && cycles >= 8 + 1)
+    {
+        int bytes = (cycles - 1) / 8;
+        unsigned char cmd[3];
+
+        /* TMS low for sure before clocking without TMS control */
+        ret = ftdi_jtag_put_tms(jtag, 0, 1, 0);
+        cycles--;
+        if (bytes > FTDI_JTAG_MAX_SHIFT)
+            bytes = FTDI_JTAG_MAX_SHIFT;
+        cmd[0] = CLK_BYTES;
+        cmd[1] = (bytes - 1) & 0xff;
+        cmd[2] = (bytes - 1) >> 8;
+        if (!ret)
+            ret = ftdi_mpsse_queue_raw(jtag->queue, cmd, sizeof(cmd), NULL, 0);
+        cycles -= 8 * bytes;
+    }
+    if (!ret)
+        ret = ftdi_jtag_put_tms(jtag, 0, cycles, 0);
+    if (ret)
+        return ftdi_jtag_rollback(jtag, &mark);
+    return 0;
+}
+
+/* Get a new fixup for bit captures, NULL when out of memory */
+static struct ftdi_jtag_fixup *ftdi_jtag_new_fixup(struct ftdi_jtag *jtag, unsigned char *dest,
+                                                   int bit, int count)
+{
+    struct ftdi_jtag_fixup *fixup;
+    int block = jtag->num_fixups / FTDI_JTAG_FIXUP_BLOCK;
+
+    if (block == jtag->num_fixup_blocks)
+    {
+        struct ftdi_jtag_fixup **fixups;
+
+        fixups = (struct ftdi_jtag_fixup **)realloc(jtag->fixups, (block + 1) * sizeof(*fixups));
+        if (fixups == NULL)
+            return NULL;
+        jtag->fixups = fixups;
+        fixups[block] = (struct ftdi_jtag_fixup *)malloc(FTDI_JTAG_FIXUP_BLOCK * sizeof(**fixups));
+        if (fixups[block] == NULL)
+            return NULL;
+        jtag->num_fixup_blocks++;
+    }
+
+    fixup = &jtag->fixups[block][jtag->num_fixups % FTDI_JTAG_FIXUP_BLOCK];
+    fixup->raw = 0;
+    fixup->count = count;
+    fixup->dest = dest;
+    fixup->bit = bit;
+    jtag->num_fixups++;
+    return fixup;
+}
+
+/* Queue a scan of the instruction or data register */
+static int ftdi_jtag_scan(struct ftdi_jtag *jtag, int shift_state, int bits,
+                          const unsigned char *out, unsigned char *in, int end_state)
+{
+    static const unsigned char zeros[256];
+    struct ftdi_context *ftdi;
+    struct ftdi_jtag_fixup *fixup;
+    struct ftdi_jtag_mark mark;
+    int pos = 0, last, rest;
+    unsigned char byte;
+
+    if (jtag == NULL)
+        return -1;
+    ftdi = jtag->ftdi;
+    if (bits < 1 || end_state < 0 || end_state > FTDI_JTAG_IRUPDATE ||
+        end_state == FTDI_JTAG_DRSHIFT || end_state == FTDI_JTAG_IRSHIFT)
+        ftdi_error_return(-1, "invalid JTAG scan");
+
+    ftdi_jtag_mark(jtag, &mark);
+    if (ftdi_jtag_goto(jtag, shift_state) < 0)
+        return ftdi_jtag_rollback(jtag, &mark);
+
+    /* whole bytes, then the remaining bits but the last one */
+    last = bits - 1;
+    while (last - pos >= 8)
+    {
+        int n = (last - pos) / 8;
+        const unsigned char *data = out ? out + pos / 8 : NULL;
+
+        if (n > FTDI_JTAG_MAX_SHIFT)
+            n = FTDI_JTAG_MAX_SHIFT;
+        if (!out && !in)
+        {
+            if (n > (int)sizeof(zeros))
+                n = sizeof(zeros);
+            data = zeros;
+        }
+        if (ftdi_mpsse_shift_bytes(jtag->queue, FTDI_JTAG_MODE, data,
+                                   in ? in + pos / 8 : NULL, n) < 0)
+            return ftdi_jtag_rollback(jtag, &mark);
+        pos += 8 * n;
+    }
+
+    rest = last - pos;
+    if (rest > 0)
+    {
+        byte = out ? out[pos / 8] : 0;
+        fixup = in ? ftdi_jtag_new_fixup(jtag, in + pos / 8, 0, rest) : NULL;
+        if ((in && fixup == NULL) ||
+            ftdi_mpsse_shift_bits(jtag->queue, FTDI_JTAG_MODE, &byte,
+                                  fixup ? &fixup->raw : NULL, rest) < 0)
+            return ftdi_jtag_rollback(jtag, &mark);
+        pos += rest;
+    }
+
+    /* the last bit leaves the shift state */
+    fixup = in ? ftdi_jtag_new_fixup(jtag, in + pos / 8, pos % 8, 1) : NULL;
+    if ((in && fixup == NULL) ||
+        ftdi_mpsse_write_tms(jtag->queue, MPSSE_WRITE_NEG, 0x01, 1,
+                             out ? (out[pos / 8] >> (pos % 8)) & 1 : 0,
+                             fixup ? &fixup->raw : NULL) < 0)
+        return ftdi_jtag_rollback(jtag, &mark);
+    jtag->state = ftdi_jtag_next[jtag->state][1];
+
+    if (ftdi_jtag_goto(jtag, end_state) < 0)
+        return ftdi_jtag_rollback(jtag, &mark);
+    return 0;
+}
+
+/**
+    Queue a scan of the instruction register
+
+    The TAP is moved to Shift-IR, bits are shifted LSB first of out[0]
+    and the TAP ends in end_state. in is only filled by ftdi_jtag_flush();
+    out has to stay valid until then.
+
+    \param jtag JTAG master
+    \param bits number of bits
+    \param out bits to send, NULL to send zeros
+    \param in receives the captured bits, NULL to not capture
+    \param end_state enum ftdi_jtag_state to go to afterwards, not a shift state
+
+    \retval  0: all fine
+    \retval -1: invalid arguments
+    \retval -2: out of memory, nothing of the scan is queued
+*/
+int ftdi_jtag_scan_ir(struct ftdi_jtag *jtag, int bits, const unsigned char *out,
+                      unsigned char *in, int end_state)
+{
+    return ftdi_jtag_scan(jtag, FTDI_JTAG_IRSHIFT, bits, out, in, end_state);
+}
+
+/**
+    Queue a scan of the data register
+
+    Like ftdi_jtag_scan_ir(), through Shift-DR.
+
+    \param jtag JTAG master
+    \param bits number of bits
+    \param out bits to send, NULL to send zeros
+    \param in receives the captured bits, NULL to not capture
+    \param end_state enum ftdi_jtag_state to go to afterwards, not a shift state
+
+    \retval  0: all fine
+    \retval -1: invalid arguments
+    \retval -2: out of memory, nothing of the scan is queued
+*/
+int ftdi_jtag_scan_dr(struct ftdi_jtag *jtag, int bits, const unsigned char *out,
+                      unsigned char *in, int end_state)
+{
+    return ftdi_jtag_scan(jtag, FTDI_JTAG_DRSHIFT, bits, out, in, end_state);
+}
+
+/**
+    Send all queued JTAG operations and collect the captured bits
+
+    \param jtag JTAG master
+
+    \retval  0: all fine
+    \retval <0: see ftdi_mpsse_queue_flush()
+*/
+int ftdi_jtag_flush(struct ftdi_jtag *jtag)
+{
+    int ret, i;
+
+    if (jtag == NULL)
+        return -1;
+    ret = ftdi_mpsse_queue_flush(jtag->queue);
+
+    for (i = 0; ret == 0 && i < jtag->num_fixups; i++)
+    {
+        struct ftdi_jtag_fixup *fixup = &jtag->fixups[i / FTDI_JTAG_FIXUP_BLOCK][i % FTDI_JTAG_FIXUP_BLOCK];
+        unsigned char value = fixup->raw >> (8 - fixup->count);
+        unsigned char mask = (0xff >> (8 - fixup->count)) << fixup->bit;
+
+        fixup->dest[0] = (fixup->dest[0] & ~mask) | ((value << fixup->bit) & mask);
+    }
+    jtag->num_fixups = 0;
+    return ret;
+}
@@ -0,0 +1,627 @@
+/***************************************************************************
+                          ftdi_mpsse.c  -  description
+                             -------------------
+    copyright            : (C) 2011 by the libftdi developers
+    email                : opensource@intra2net.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation;             *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * MPSSE command queue. Commands are collected in one buffer together
+ * with the number of reply bytes each one produces and where those
+ * bytes go. ftdi_mpsse_queue_flush() sends the buffer with a trailing
+ * SEND_IMMEDIATE in one bulk write while the reply is read back
+ * concurrently, then scatters the reply to the commands.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ftdi.h"
+#include "ftdi_i.h"
+
+/* Longest data phase of one MPSSE shift command */
+#define FTDI_MPSSE_MAX_SHIFT 65536
+
+/* Where the reply bytes of one command go */
+struct ftdi_mpsse_reply
+{
+    unsigned char *dest;
+    int length;
+};
+
+struct ftdi_mpsse_queue
+{
+    struct ftdi_context *ftdi;
+    /** queued command bytes */
+    unsigned char *commands;
+    int num_commands;
+    int commands_size;
+    /** reply slots in command order */
+    struct ftdi_mpsse_reply *replies;
+    int num_replies;
+    int replies_size;
+    /** reply bytes expected by the queued commands */
+    int reply_length;
+    /** receive buffer of the flush */
+    unsigned char *reply;
+    int reply_size;
+};
+
+/**
+    Create an MPSSE command queue
+
+    The device has to be in BITMODE_MPSSE when the queue is flushed.
+
+    \param ftdi pointer to ftdi_context the queue sends to
+
+    \retval pointer to the new queue, NULL when out of memory or ftdi is NULL
+*/
+struct ftdi_mpsse_queue *ftdi_mpsse_queue_new(struct ftdi_context *ftdi)
+{
+    struct ftdi_mpsse_queue *queue;
+
+    if (ftdi == NULL)
+        return NULL;
+
+    queue = (struct ftdi_mpsse_queue *)calloc(1, sizeof(struct ftdi_mpsse_queue));
+    if (queue == NULL)
+        return NULL;
+    queue->ftdi = ftdi;
+    return queue;
+}
+
+/**
+    Free an MPSSE command queue, queued commands are dropped
+
+    \param queue queue to free, may be NULL
+*/
+void ftdi_mpsse_queue_free(struct ftdi_mpsse_queue *queue)
+{
+    if (queue == NULL)
+        return;
+    free(queue->commands);
+    free(queue->replies);
+    free(queue->reply);
+    free(queue);
+}
+
+/* Make room for length more command bytes */
+static int ftdi_mpsse_reserve(struct ftdi_mpsse_queue *queue, int length)
+{
+    unsigned char *commands;
+    int size = queue->commands_size ? queue->commands_size : 256;
+
+    /* one spare byte for the SEND_IMMEDIATE of the flush */
+    while (size < queue->num_commands + length + 1)
+        size *= 2;
+    if (size == queue->commands_size)
+        return 0;
+
+    commands = (unsigned char *)realloc(queue->commands, size);
+    if (commands == NULL)
+        return -1;
+    queue->commands = commands;
+    queue->commands_size = size;
+    return 0;
+}
+
+/* Record that the last command produces length reply bytes for dest */
+static int ftdi_mpsse_expect(struct ftdi_mpsse_queue *queue, unsigned char *dest, int length)
+{
+    if (queue->num_replies == queue->replies_size)
+    {
+        int size = queue->replies_size ? 2 * queue->replies_size : 64;
+        struct ftdi_mpsse_reply *replies;
+
+        replies = (struct ftdi_mpsse_reply *)realloc(queue->replies, size * sizeof(*replies));
+        if (replies == NULL)
+            return -1;
+        queue->replies = replies;
+        queue->replies_size = size;
+    }
+    queue->replies[queue->num_replies].dest = dest;
+    queue->replies[queue->num_replies].length = length;
+    queue->num_replies++;
+    queue->reply_length += length;
+    return 0;
+}
+
+/**
+    Queue raw command bytes
+
+    \param queue MPSSE command queue
+    \param command command bytes
+    \param length number of command bytes
+    \param reply receives the reply bytes on flush, NULL to discard them
+    \param reply_length number of bytes the command returns
+
+    \retval  0: all fine
+    \retval -1: invalid arguments
+    \retval -2: out of memory
+*/
+int ftdi_mpsse_queue_raw(struct ftdi_mpsse_queue *queue, const unsigned char *command,
+                         int length, unsigned char *reply, int reply_length)
+{
+    struct ftdi_context *ftdi;
+
+    if (queue == NULL)
+        return -1;
+    ftdi = queue->ftdi;
+    if (length < 0 || reply_length < 0 || (command == NULL && length))
+        ftdi_error_return(-1, "invalid MPSSE command");
+
+    if (ftdi_mpsse_reserve(queue, length) < 0 ||
+        (reply_length && ftdi_mpsse_expect(queue, reply, reply_length) < 0))
+        ftdi_error_return(-2, "out of memory for MPSSE command");
+
+    if (length)
+        memcpy(queue->commands + queue->num_commands, command, length);
+    queue->num_commands += length;
+    return 0;
+}
+
+/**
+    Queue setting the low byte GPIO pins (ADBUS)
+
+    \param queue MPSSE command queue
+    \param value pin levels
+    \param direction pin directions, 1 for output
+
+    \retval  0: all fine
+    \retval <0: see ftdi_mpsse_queue_raw()
+*/
+int ftdi_mpsse_set_bits_low(struct ftdi_mpsse_queue *queue,
+                            unsigned char value, unsigned char direction)
+{
+    unsigned char cmd[3] = { SET_BITS_LOW, value, direction };
+    return ftdi_mpsse_queue_raw(queue, cmd, sizeof(cmd), NULL, 0);
+}
+
+/**
+    Queue setting the high byte GPIO pins (ACBUS)
+
+    \param queue MPSSE command queue
+    \param value pin levels
+    \param direction pin directions, 1 for output
+
+    \retval  0: all fine
+    \retval <0: see ftdi_mpsse_queue_raw()
+*/
+int ftdi_mpsse_set_bits_high(struct ftdi_mpsse_queue *queue,
+                             unsigned char value, unsigned char direction)
+{
+    unsigned char cmd[3] = { SET_BITS_HIGH, value, direction };
+    return ftdi_mpsse_queue_raw(queue, cmd, sizeof(cmd), NULL, 0);
+}
+
+/**
+    Queue reading the low byte GPIO pins (ADBUS)
+
+    \param queue MPSSE command queue
+    \param value receives the pin levels on flush
+
+    \retval  0: all fine
+    \retval <0: see ftdi_mpsse_queue_raw()
+*/
+int ftdi_mpsse_get_bits_low(struct ftdi_mpsse_queue *queue, unsigned char *value)
+{
+    unsigned char cmd = GET_BITS_LOW;
+    return ftdi_mpsse_queue_raw(queue, &cmd, 1, value, 1);
+}
+
+/**
+    Queue reading the high byte GPIO pins (ACBUS)
+
+    \param queue MPSSE command queue
+    \param value receives the pin levels on flush
+
+    \retval  0: all fine
+    \retval <0: see ftdi_mpsse_queue_raw()
+*/
+int ftdi_mpsse_get_bits_high(struct ftdi_mpsse_queue *queue, unsigned char *value)
+{
+    unsigned char cmd = GET_BITS_HIGH;
+    return ftdi_mpsse_queue_raw(queue, &cmd, 1, value, 1);
+}
+
+/**
+    Queue setting the clock divisor
+
+    \param queue MPSSE command queue
+    \param divisor TCK_DIVISOR value, the clock is base / ((1 + divisor) * 2)
+
+    \retval  0: all fine
+    \retval <0: see ftdi_mpsse_queue_raw()
+*/
+int ftdi_mpsse_set_divisor(struct ftdi_mpsse_queue *queue, unsigned short divisor)
+{
+    unsigned char cmd[3] = { TCK_DIVISOR, divisor & 0xff, divisor >> 8 };
+    return ftdi_mpsse_queue_raw(queue, cmd, sizeof(cmd), NULL, 0);
+}
+
+/**
+    Find the clock settings for a frequency
+
+    The MPSSE clock is base / ((1 + divisor) * 2). The base is 12 MHz on
+    the FT2232C/D and on H type chips with the divide by 5 prescaler,
+    60 MHz on H type chips without it. Three phase clocking, H type chips
+    only, keeps data valid around both clock edges and takes 2/3 of the
+    base. The fastest clock not above frequency is chosen; below the
+    slowest possible clock the slowest one is used.
+
+    \param type enum ftdi_chip_type of the device
+    \param frequency wanted clock in Hz
+    \param three_phase 1 to use three phase clocking, ignored before H type chips
+    \param clock receives the settings and the commands to send them
+
+    \retval  0: all fine
+    \retval -1: invalid frequency
+    \retval -2: chip has no MPSSE
+*/
+int ftdi_mpsse_plan_clock(enum ftdi_chip_type type, int frequency, int three_phase,
+                          struct ftdi_mpsse_clock *clock)
+{
+    int h_type = (type == TYPE_2232H || type == TYPE_4232H || type == TYPE_232H);
+    long long base, divisor;
+    int n = 0;
+
+    if (frequency <= 0 || clock == NULL)
+        return -1;
+    if (!h_type && type != TYPE_2232C)
+        return -2;
+
+    clock->three_phase = h_type && three_phase;
+    clock->div5 = 0;
+    for (;;)
+    {
+        base = (clock->div5 || !h_type) ? 12000000 : 60000000;
+        if (clock->three_phase)
+            base = base * 2 / 3;
+        divisor = (base + 2LL * frequency - 1) / (2LL * frequency) - 1;
+        if (divisor < 0)
+            divisor = 0;
+        if (divisor <= 0xffff || clock->div5 || !h_type)
+            break;
+        /* too slow for the 60 MHz base */
+        clock->div5 = 1;
+    }
+    if (divisor > 0xffff)
+        divisor = 0xffff;
+
+    clock->divisor = (unsigned short)divisor;
+    clock->frequency = (double)base / ((divisor + 1) * 2);
+    if (h_type)
+    {
+        clock->commands[n++] = clock->div5 ? EN_DIV_5 : DIS_DIV_5;
+        clock->commands[n++] = clock->three_phase ? EN_3_PHASE : DIS_3_PHASE;
+    }
+    clock->commands[n++] = TCK_DIVISOR;
+    clock->commands[n++] = divisor & 0xff;
+    clock->commands[n++] = divisor >> 8;
+    clock->num_commands = n;
+    return 0;
+}
+
+/**
+    Queue the clock settings for a frequency, see ftdi_mpsse_plan_clock()
+
+    \param queue MPSSE command queue
+    \param frequency wanted clock in Hz
+    \param three_phase 1 to use three phase clocking, ignored before H type chips
+    \param clock receives the settings, may be NULL
+
+    \retval  0: all fine
+    \retval -1: invalid frequency
+    \retval -2: chip has no MPSSE, or see ftdi_mpsse_queue_raw()
+*/
+int ftdi_mpsse_set_clock(struct ftdi_mpsse_queue *queue, int frequency, int three_phase,
+                         struct ftdi_mpsse_clock *clock)
+{
+    struct ftdi_mpsse_clock plan;
+    int ret;
+
+    if (queue == NULL)
+        return -1;
+    ret = ftdi_mpsse_plan_clock(queue->ftdi->type, frequency, three_phase, &plan);
+    if (ret < 0)
+        return ret;
+    if (clock)
+        *clock = plan;
+    return ftdi_mpsse_queue_raw(queue, plan.commands, plan.num_commands, NULL, 0);
+}
+
+/**
+    Queue connecting or disconnecting the internal TDI/DO to TDO/DI loopback
+
+    \param queue MPSSE command queue
+    \param enable 1 to connect, 0 to disconnect
+
+    \retval  0: all fine
+    \retval <0: see ftdi_mpsse_queue_raw()
+*/
+int ftdi_mpsse_loopback(struct ftdi_mpsse_queue *queue, int enable)
+{
+    unsigned char cmd = enable ? LOOPBACK_START : LOOPBACK_END;
+    return ftdi_mpsse_queue_raw(queue, &cmd, 1, NULL, 0);
+}
+
+/**
+    Queue shifting bytes on TDI/DO and/or TDO/DI
+
+    Transfers longer than one MPSSE command allows are split.
+
+    \param queue MPSSE command queue
+    \param mode clock edges and bit order: MPSSE_WRITE_NEG, MPSSE_READ_NEG, MPSSE_LSB
+    \param out bytes to shift out, NULL to only read
+    \param in receives the bytes shifted in on flush, NULL to only write
+    \param length number of bytes
+
+    \retval  0: all fine
+    \retval -1: invalid arguments
+    \retval -2: out of memory, nothing of the transfer is queued
+*/
+int ftdi_mpsse_shift_bytes(struct ftdi_mpsse_queue *queue, unsigned char mode,
+                           const unsigned char *out, unsigned char *in, int length)
+{
+    struct ftdi_context *ftdi;
+    struct ftdi_mpsse_mark mark;
+    unsigned char opcode;
+
+    if (queue == NULL)
+        return -1;
+    ftdi = queue->ftdi;
+    if (length < 1 || (out == NULL && in == NULL) ||
+        (mode & ~(MPSSE_WRITE_NEG | MPSSE_READ_NEG | MPSSE_LSB)))
+        ftdi_error_return(-1, "invalid MPSSE shift");
+
+    ftdi_mpsse_queue_mark(queue, &mark);
+    opcode = mode | (out ? MPSSE_DO_WRITE : 0) | (in ? MPSSE_DO_READ : 0);
+    while (length > 0)
+    {
+        int n = length > FTDI_MPSSE_MAX_SHIFT ? FTDI_MPSSE_MAX_SHIFT : length;
+        unsigned char *cmd;
+
+        if (ftdi_mpsse_reserve(queue, 3 + (out ? n : 0)) < 0 ||
+            (in && ftdi_mpsse_expect(queue, in, n) < 0))
+        {
+            /* drop the commands of the transfer queued so far */
+            ftdi_mpsse_queue_rollback(queue, &mark);
+            ftdi_error_return(-2, "out of memory for MPSSE command");
+        }
+
+        cmd = queue->commands + queue->num_commands;
+        cmd[0] = opcode;
+        cmd[1] = (n - 1) & 0xff;
+        cmd[2] = (n - 1) >> 8;
+        if (out)
+        {
+            memcpy(cmd + 3, out, n);
+            out += n;
+        }
+        queue->num_commands += 3 + (out ? n : 0);
+        if (in)
+            in += n;
+        length -= n;
+    }
+    return 0;
+}
+
+/**
+    Queue shifting up to 8 bits on TDI/DO and/or TDO/DI
+
+    \param queue MPSSE command queue
+    \param mode clock edges and bit order: MPSSE_WRITE_NEG, MPSSE_READ_NEG, MPSSE_LSB
+    \param out byte holding the bits to shift out, NULL to only read
+    \param in receives the byte shifted in on flush as returned by the
+           chip, NULL to only write
+    \param bits number of bits, 1 to 8
+
+    \retval  0: all fine
+    \retval <0: see ftdi_mpsse_queue_raw()
+*/
+int ftdi_mpsse_shift_bits(struct ftdi_mpsse_queue *queue, unsigned char mode,
+                          const unsigned char *out, unsigned char *in, int bits)
+{
+    struct ftdi_context *ftdi;
+    unsigned char cmd[3];
+
+    if (queue == NULL)
+        return -1;
+    ftdi = queue->ftdi;
+    if (bits < 1 || bits > 8 || (out == NULL && in == NULL) ||
+        (mode & ~(MPSSE_WRITE_NEG | MPSSE_READ_NEG | MPSSE_LSB)))
+        ftdi_error_return(-1, "invalid MPSSE shift");
+
+    cmd[0] = mode | MPSSE_BITMODE | (out ? MPSSE_DO_WRITE : 0) | (in ? MPSSE_DO_READ : 0);
+    cmd[1] = bits - 1;
+    cmd[2] = out ? *out : 0;
+    return ftdi_mpsse_queue_raw(queue, cmd, out ? 3 : 2, in, in ? 1 : 0);
+}
+
+/**
+    Queue clocking up to 7 bits out on TMS/CS
+
+    \param queue MPSSE command queue
+    \param mode clock edges: MPSSE_WRITE_NEG, MPSSE_READ_NEG
+    \param tms TMS bits, sent LSB first
+    \param bits number of bits, 1 to 7
+    \param tdi level held on TDI/DO during the command
+    \param in receives the TDO/DI bits sampled meanwhile as returned by
+           the chip, NULL to not read
+
+    \retval  0: all fine
+    \retval <0: see ftdi_mpsse_queue_raw()
+*/
+int ftdi_mpsse_write_tms(struct ftdi_mpsse_queue *queue, unsigned char mode,
+                         unsigned char tms, int bits, int tdi, unsigned char *in)
+{
+    struct ftdi_context *ftdi;
+    unsigned char cmd[3];
+
+    if (queue == NULL)
+        return -1;
+    ftdi = queue->ftdi;
+    if (bits < 1 || bits > 7 || (mode & ~(MPSSE_WRITE_NEG | MPSSE_READ_NEG)))
+        ftdi_error_return(-1, "invalid MPSSE TMS command");
+
+    cmd[0] = mode | MPSSE_WRITE_TMS | MPSSE_BITMODE | MPSSE_LSB | (in ? MPSSE_DO_READ : 0);
+    cmd[1] = bits - 1;
+    cmd[2] = (tms & 0x7f) | (tdi ? 0x80 : 0);
+    return ftdi_mpsse_queue_raw(queue, cmd, sizeof(cmd), in, in ? 1 : 0);
+}
+
+/**
+    Get the queued command bytes, e.g. for logging
+
+    \param queue MPSSE command queue
+    \param commands set to the queued bytes, valid until the queue changes
+
+    \retval >=0: number of queued command bytes
+    \retval  -1: invalid arguments
+*/
+int ftdi_mpsse_queue_commands(struct ftdi_mpsse_queue *queue, const unsigned char **commands)
+{
+    if (queue == NULL || commands == NULL)
+        return -1;
+    *commands = queue->commands;
+    return queue->num_commands;
+}
+
+/**
+    Get the number of reply bytes the queued commands will produce
+
+    \param queue MPSSE command queue
+
+    \retval >=0: number of reply bytes
+    \retval  -1: invalid queue
+*/
+int ftdi_mpsse_queue_reply_length(struct ftdi_mpsse_queue *queue)
+{
+    if (queue == NULL)
+        return -1;
+    return queue->reply_length;
+}
+
+/**
+    Drop all queued commands without sending them
+
+    \param queue MPSSE command queue, may be NULL
+*/
+void ftdi_mpsse_queue_clear(struct ftdi_mpsse_queue *queue)
+{
+    if (queue == NULL)
+        return;
+    queue->num_commands = 0;
+    queue->num_replies = 0;
+    queue->reply_length = 0;
+}
+
+/* Remember the fill level of a queue, to take back what follows */
+void ftdi_mpsse_queue_mark(struct ftdi_mpsse_queue *queue, struct ftdi_mpsse_mark *mark)
+{
+    mark->num_commands = queue->num_commands;
+    mark->num_replies = queue->num_replies;
+    mark->reply_length = queue->reply_length;
+}
+
+/* Drop the commands queued since ftdi_mpsse_queue_mark() */
+void ftdi_mpsse_queue_rollback(struct ftdi_mpsse_queue *queue, const struct ftdi_mpsse_mark *mark)
+{
+    queue->num_commands = mark->num_commands;
+    queue->num_replies = mark->num_replies;
+    queue->reply_length = mark->reply_length;
+}
+
+/**
+    Send all queued commands and collect their replies
+
+    The commands go out in one bulk write followed by SEND_IMMEDIATE.
+    The reply is read while writing, so replies larger than the chip's
+    buffers don't stall the write. On success every reply slot holds its
+    bytes. The queue is empty afterwards, also when an error occured.
+
+    \param queue MPSSE command queue
+
+    \retval  0: all fine
+    \retval -1: invalid queue
+    \retval -2: writing the commands failed
+    \retval -3: reading the reply failed or timed out
+    \retval -4: out of memory for the reply
+    \retval -666: USB device unavailable
+*/
+int ftdi_mpsse_queue_flush(struct ftdi_mpsse_queue *queue)
+{
+    struct ftdi_context *ftdi;
+    struct ftdi_transfer_control *read_tc = NULL, *write_tc;
+    int ret = 0, i, pos;
+
+    if (queue == NULL)
+        return -1;
+    ftdi = queue->ftdi;
+    if (ftdi->usb_dev == NULL)
+        ftdi_error_return(-666, "USB device unavailable");
+    if (queue->num_commands == 0)
+        return 0;
+
+    if (queue->reply_length > 0)
+    {
+        if (queue->reply_size < queue->reply_length)
+        {
+            unsigned char *reply = (unsigned char *)realloc(queue->reply, queue->reply_length);
+            if (reply == NULL)
+            {
+                ftdi_mpsse_queue_clear(queue);
+                ftdi_error_return(-4, "out of memory for MPSSE reply");
+            }
+            queue->reply = reply;
+            queue->reply_size = queue->reply_length;
+        }
+
+        /* room was reserved with every command */
+        queue->commands[queue->num_commands++] = SEND_IMMEDIATE;
+
+        read_tc = ftdi_read_data_submit(ftdi, queue->reply, queue->reply_length);
+        if (read_tc == NULL)
+        {
+            ftdi_mpsse_queue_clear(queue);
+            ftdi_error_return(-3, "submitting MPSSE reply read failed");
+        }
+    }
+
+    write_tc = ftdi_write_data_submit(ftdi, queue->commands, queue->num_commands);
+    if (write_tc == NULL || ftdi_transfer_data_done(write_tc) != queue->num_commands)
+        ret = -2;
+    if (read_tc)
+    {
+        /* no commands, no reply: waiting would block for good on read-ahead */
+        if (ret)
+            ftdi_transfer_data_drop(read_tc);
+        else if (ftdi_transfer_data_done(read_tc) != queue->reply_length)
+            ret = -3;
+    }
+
+    if (ret == 0)
+    {
+        for (i = 0, pos = 0; i < queue->num_replies; i++)
+        {
+            if (queue->replies[i].dest)
+                memcpy(queue->replies[i].dest, queue->reply + pos, queue->replies[i].length);
+            pos += queue->replies[i].length;
+        }
+    }
+
+    ftdi_mpsse_queue_clear(queue);
+    if (ret == -2)
+        ftdi_error_return(-2, "writing MPSSE commands failed");
+    if (ret == -3)
+        ftdi_error_return(-3, "reading MPSSE reply failed");
+    return 0;
+}
@@ -0,0 +1,375 @@
+/***************************************************************************
+                          ftdi_pattern.c  -  description
+                             -------------------
+    copyright            : (C) 2011 by the libftdi developers
+    email                : opensource@intra2net.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation;             *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * Checker for the test patterns of enum ftdi_stream_pattern. The checker
+ * synchronizes to the first value it sees; after each mismatch it counts
+ * one error and resynchronizes to the received value, so a lost block
+ * shows up as a single error.
+ *
+ * Byte patterns are compared against a precomputed copy of the sequence
+ * with memcmp(); word patterns with an XOR/OR reduction over blocks of
+ * words that the compiler vectorizes. Only blocks containing an error
+ * are walked value by value.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ftdi.h"
+
+/* 8 bit Galois LFSR x^8 + x^6 + x^5 + x^4 + 1, period 255 */
+#define FTDI_PATTERN_LFSR_TAPS  0xb8
+#define FTDI_PATTERN_LFSR_SEED  0x01
+
+/* Words checked per block of the word patterns */
+#define FTDI_PATTERN_BLOCK      64
+
+struct ftdi_pattern_checker
+{
+    int pattern;
+    /** bytes per value */
+    int width;
+    int synced;
+    /** expected next value, for byte patterns its position in sequence */
+    uint32_t next;
+    /** bytes of a word split between two buffers */
+    unsigned char partial[4];
+    int partial_len;
+    struct ftdi_pattern_stats stats;
+    /** byte patterns: period of the sequence, the sequence twice and
+        the position of every byte value in it, -1 if it never occurs */
+    int period;
+    unsigned char sequence[2 * 256];
+    int position[256];
+};
+
+static uint8_t ftdi_pattern_lfsr_next(uint8_t value)
+{
+    return (value >> 1) ^ ((value & 1) ? FTDI_PATTERN_LFSR_TAPS : 0);
+}
+
+/**
+    Get the byte that follows value in a byte pattern
+
+    \param pattern FTDI_PATTERN_COUNT8 or FTDI_PATTERN_LFSR
+    \param value current byte
+
+    \retval the next byte of the pattern
+*/
+uint8_t ftdi_pattern_next_byte(int pattern, uint8_t value)
+{
+    if (pattern == FTDI_PATTERN_LFSR)
+        return ftdi_pattern_lfsr_next(value);
+    return value + 1;
+}
+
+/**
+    Fill a buffer with a test pattern
+
+    Useful as stream producer for loopback tests. Word patterns are
+    written little endian.
+
+    \param pattern enum ftdi_stream_pattern
+    \param buffer buffer to fill
+    \param length size of the buffer, a multiple of the word size
+    \param value first value to write, updated to the value following
+           the buffer; for FTDI_PATTERN_LFSR it must not be 0
+
+    \retval  0: all fine
+    \retval -1: unknown pattern or length not a multiple of the word size
+*/
+int ftdi_pattern_fill(int pattern, uint8_t *buffer, int length, uint32_t *value)
+{
+    uint32_t v = *value;
+    int i;
+
+    switch (pattern)
+    {
+        case FTDI_PATTERN_COUNT8:
+        case FTDI_PATTERN_LFSR:
+            for (i = 0; i < length; i++)
+            {
+                buffer[i] = (uint8_t)v;
+                v = ftdi_pattern_next_byte(pattern, (uint8_t)v);
+            }
+            break;
+        case FTDI_PATTERN_COUNT16:
+            if (length % 2)
+                return -1;
+            for (i = 0; i < length; i += 2, v = (v + 1) & 0xffff)
+            {
+                buffer[i] = v;
+                buffer[i + 1] = v >> 8;
+            }
+            break;
+        case FTDI_PATTERN_COUNT32:
+            if (length % 4)
+                return -1;
+            for (i = 0; i < length; i += 4, v++)
+            {
+                buffer[i] = v;
+                buffer[i + 1] = v >> 8;
+                buffer[i + 2] = v >> 16;
+                buffer[i + 3] = v >> 24;
+            }
+            break;
+        default:
+            return -1;
+    }
+    *value = v;
+    return 0;
+}
+
+/**
+    Create a checker for a test pattern
+
+    \param pattern enum ftdi_stream_pattern, not FTDI_PATTERN_NONE
+
+    \retval pointer to the new checker, NULL for an unknown pattern or
+            when out of memory
+*/
+struct ftdi_pattern_checker *ftdi_pattern_checker_new(int pattern)
+{
+    struct ftdi_pattern_checker *checker;
+    int i;
+
+    if (pattern < FTDI_PATTERN_COUNT8 || pattern > FTDI_PATTERN_LFSR)
+        return NULL;
+
+    checker = (struct ftdi_pattern_checker *)calloc(1, sizeof(struct ftdi_pattern_checker));
+    if (checker == NULL)
+        return NULL;
+
+    checker->pattern = pattern;
+    switch (pattern)
+    {
+        case FTDI_PATTERN_COUNT16:
+            checker->width = 2;
+            break;
+        case FTDI_PATTERN_COUNT32:
+            checker->width = 4;
+            break;
+        default:
+        {
+            uint8_t value = (pattern == FTDI_PATTERN_LFSR) ? FTDI_PATTERN_LFSR_SEED : 0;
+
+            checker->width = 1;
+            checker->period = (pattern == FTDI_PATTERN_LFSR) ? 255 : 256;
+            for (i = 0; i < 256; i++)
+                checker->position[i] = -1;
+            for (i = 0; i < checker->period; i++)
+            {
+                checker->sequence[i] = checker->sequence[i + checker->period] = value;
+                checker->position[value] = i;
+                value = ftdi_pattern_next_byte(pattern, value);
+            }
+            break;
+        }
+    }
+    checker->stats.first_error = -1;
+    return checker;
+}
+
+/**
+    Free a pattern checker
+
+    \param checker checker to free, may be NULL
+*/
+void ftdi_pattern_checker_free(struct ftdi_pattern_checker *checker)
+{
+    free(checker);
+}
+
+/* Count an error at the given stream offset */
+static void ftdi_pattern_error(struct ftdi_pattern_checker *checker, uint64_t offset)
+{
+    if (checker->stats.errors++ == 0)
+        checker->stats.first_error = offset;
+}
+
+/* Check one word value, the slow path of the word patterns */
+static void ftdi_pattern_check_word(struct ftdi_pattern_checker *checker,
+                                    uint32_t value, uint64_t offset)
+{
+    uint32_t mask = (checker->width == 2) ? 0xffff : 0xffffffff;
+
+    if (checker->synced && value != checker->next)
+        ftdi_pattern_error(checker, offset);
+    checker->synced = 1;
+    checker->next = (value + 1) & mask;
+}
+
+static uint32_t ftdi_pattern_load(const uint8_t *p, int width)
+{
+    if (width == 2)
+        return p[0] | (p[1] << 8);
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Byte patterns: compare runs against the stored sequence */
+static void ftdi_pattern_check_bytes(struct ftdi_pattern_checker *checker,
+                                     const uint8_t *buffer, int length, uint64_t offset)
+{
+    int i = 0;
+
+    while (i < length)
+    {
+        int n;
+
+        if (!checker->synced)
+        {
+            /* a byte outside the sequence (0 for the LFSR) can't sync */
+            if (checker->position[buffer[i]] < 0)
+            {
+                ftdi_pattern_error(checker, offset + i);
+                i++;
+                continue;
+            }
+            checker->next = checker->position[buffer[i]];
+            checker->synced = 1;
+        }
+
+        n = length - i;
+        if (n > checker->period)
+            n = checker->period;
+        if (memcmp(buffer + i, checker->sequence + checker->next, n) == 0)
+        {
+            checker->next = (checker->next + n) % checker->period;
+            i += n;
+            continue;
+        }
+
+        /* walk up to the mismatch and resync there */
+        while (buffer[i] == checker->sequence[checker->next])
+        {
+            checker->next = (checker->next + 1) % checker->period;
+            i++;
+        }
+        ftdi_pattern_error(checker, offset + i);
+        checker->synced = 0;
+        if (checker->position[buffer[i]] >= 0)
+        {
+            checker->next = (checker->position[buffer[i]] + 1) % checker->period;
+            checker->synced = 1;
+        }
+        i++;
+    }
+}
+
+/* Word patterns: reduce blocks of words, walk only blocks with errors */
+static void ftdi_pattern_check_words(struct ftdi_pattern_checker *checker,
+                                     const uint8_t *buffer, int length, uint64_t offset)
+{
+    int width = checker->width;
+    uint32_t mask = (width == 2) ? 0xffff : 0xffffffff;
+    int i = 0;
+
+    /* complete a word split by the previous buffer */
+    if (checker->partial_len)
+    {
+        while (checker->partial_len < width && i < length)
+            checker->partial[checker->partial_len++] = buffer[i++];
+        if (checker->partial_len < width)
+            return;
+        ftdi_pattern_check_word(checker, ftdi_pattern_load(checker->partial, width),
+                                offset - (width - i));
+        checker->partial_len = 0;
+    }
+
+    if (!checker->synced && length - i >= width)
+    {
+        ftdi_pattern_check_word(checker, ftdi_pattern_load(buffer + i, width), offset + i);
+        i += width;
+    }
+
+    while (length - i >= width)
+    {
+        int words = (length - i) / width;
+        uint32_t diff = 0;
+        int w;
+
+        if (words > FTDI_PATTERN_BLOCK)
+            words = FTDI_PATTERN_BLOCK;
+
+        if (width == 2)
+        {
+            for (w = 0; w < words; w++)
+                diff |= ftdi_pattern_load(buffer + i + 2 * w, 2) ^ ((checker->next + w) & 0xffff);
+        }
+        else
+        {
+            for (w = 0; w < words; w++)
+                diff |= ftdi_pattern_load(buffer + i + 4 * w, 4) ^ (checker->next + w);
+        }
+
+        if (diff == 0)
+        {
+            checker->next = (checker->next + words) & mask;
+        }
+        else
+        {
+            for (w = 0; w < words; w++)
+                ftdi_pattern_check_word(checker, ftdi_pattern_load(buffer + i + width * w, width),
+                                        offset + i + width * w);
+        }
+        i += words * width;
+    }
+
+    /* keep the start of a word continued in the next buffer */
+    while (i < length)
+        checker->partial[checker->partial_len++] = buffer[i++];
+}
+
+/**
+    Check received data against the test pattern
+
+    Call with consecutive blocks of the stream; words may be split
+    between blocks.
+
+    \param checker pattern checker
+    \param buffer received data
+    \param length size of the received data
+
+    \retval number of errors found in this block
+*/
+int ftdi_pattern_check(struct ftdi_pattern_checker *checker,
+                       const uint8_t *buffer, int length)
+{
+    uint64_t errors = checker->stats.errors;
+
+    if (buffer == NULL || length <= 0)
+        return 0;
+
+    if (checker->width == 1)
+        ftdi_pattern_check_bytes(checker, buffer, length, checker->stats.bytes);
+    else
+        ftdi_pattern_check_words(checker, buffer, length, checker->stats.bytes);
+    checker->stats.bytes += length;
+    return checker->stats.errors - errors;
+}
+
+/**
+    Get the results of a pattern checker
+
+    \param checker pattern checker
+    \param stats filled with the bytes checked, the errors found and the
+           stream offset of the first error
+*/
+void ftdi_pattern_get_stats(struct ftdi_pattern_checker *checker,
+                            struct ftdi_pattern_stats *stats)
+{
+    *stats = checker->stats;
+}
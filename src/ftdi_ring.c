@@ -0,0 +1,268 @@
+/***************************************************************************
+                          ftdi_ring.c  -  description
+                             -------------------
+    copyright            : (C) 2011 by the libftdi developers
+    email                : opensource@intra2net.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation;             *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * Single producer / single consumer ring buffer sink for the streaming
+ * functions. The stream callback runs inside libusb event handling and
+ * only copies the payload into the ring; a separate consumer thread
+ * drains it. Producer and consumer each own one index, published with
+ * release stores and read with acquire loads, so no lock is needed.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ftdi.h"
+#include "ftdi_i.h"
+
+#define ring_load(p)            __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define ring_store(p, v)        __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define ring_load_relaxed(p)    __atomic_load_n((p), __ATOMIC_RELAXED)
+#define ring_store_relaxed(p, v) __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+
+/**
+    Allocate a ring buffer for streamed data.
+
+    \param size capacity in bytes, rounded up to the next power of two
+
+    \retval pointer to the new ring, NULL if out of memory or size is 0
+*/
+struct ftdi_stream_ring *ftdi_stream_ring_new(size_t size)
+{
+    struct ftdi_stream_ring *ring;
+    size_t capacity = 1;
+
+    if (size == 0)
+        return NULL;
+    while (capacity < size)
+    {
+        capacity <<= 1;
+        if (capacity == 0)
+            return NULL;
+    }
+
+    ring = (struct ftdi_stream_ring *)calloc(1, sizeof(struct ftdi_stream_ring));
+    if (ring == NULL)
+        return NULL;
+
+    ring->buffer = (unsigned char *)malloc(capacity);
+    if (ring->buffer == NULL)
+    {
+        free(ring);
+        return NULL;
+    }
+    ring->size = capacity;
+    return ring;
+}
+
+/**
+    Free a ring buffer. No stream may use it anymore.
+
+    \param ring ring buffer, may be NULL
+*/
+void ftdi_stream_ring_free(struct ftdi_stream_ring *ring)
+{
+    if (ring == NULL)
+        return;
+    free(ring->buffer);
+    free(ring);
+}
+
+/**
+    Get the capacity of a ring buffer.
+
+    \param ring ring buffer
+
+    \retval capacity in bytes
+*/
+size_t ftdi_stream_ring_size(struct ftdi_stream_ring *ring)
+{
+    return ring->size;
+}
+
+/**
+    Append a block to the ring. Producer side.
+
+    The block is stored completely or not at all, so a full ring never
+    leaves a torn block behind. Dropped blocks are counted in the
+    overflow statistics.
+
+    \param ring ring buffer
+    \param data block to store
+    \param length size of the block
+
+    \retval length: block stored
+    \retval 0: ring full, block dropped
+*/
+size_t ftdi_stream_ring_write(struct ftdi_stream_ring *ring,
+                              const unsigned char *data, size_t length)
+{
+    size_t head = ring->head;
+    size_t fill = head - ring_load(&ring->tail);
+    size_t offset, first;
+
+    if (length > ring->size - fill)
+    {
+        ring_store_relaxed(&ring->stats.overflows, ring->stats.overflows + 1);
+        ring_store_relaxed(&ring->stats.bytes_dropped, ring->stats.bytes_dropped + length);
+        return 0;
+    }
+
+    offset = head & (ring->size - 1);
+    first = ring->size - offset;
+    if (first > length)
+        first = length;
+    memcpy(ring->buffer + offset, data, first);
+    memcpy(ring->buffer, data + first, length - first);
+
+    fill += length;
+    if (fill > ring->stats.high_water)
+        ring_store_relaxed(&ring->stats.high_water, fill);
+    ring_store_relaxed(&ring->stats.bytes_written, ring->stats.bytes_written + length);
+
+    ring_store(&ring->head, head + length);
+    return length;
+}
+
+/**
+    Get the number of bytes waiting in the ring. Consumer side.
+
+    \param ring ring buffer
+
+    \retval number of bytes that can be read
+*/
+size_t ftdi_stream_ring_fill(struct ftdi_stream_ring *ring)
+{
+    return ring_load(&ring->head) - ring->tail;
+}
+
+/**
+    Get the contiguous readable part of the ring without copying.
+    Consumer side. Release the bytes with ftdi_stream_ring_consume().
+
+    \param ring ring buffer
+    \param data set to the first readable byte
+
+    \retval number of contiguous bytes at data
+*/
+size_t ftdi_stream_ring_peek(struct ftdi_stream_ring *ring, const unsigned char **data)
+{
+    size_t tail = ring->tail;
+    size_t fill = ring_load(&ring->head) - tail;
+    size_t offset = tail & (ring->size - 1);
+
+    *data = ring->buffer + offset;
+    if (fill > ring->size - offset)
+        fill = ring->size - offset;
+    return fill;
+}
+
+/**
+    Release bytes returned by ftdi_stream_ring_peek(). Consumer side.
+
+    \param ring ring buffer
+    \param length number of bytes to release, at most the fill level
+*/
+void ftdi_stream_ring_consume(struct ftdi_stream_ring *ring, size_t length)
+{
+    size_t fill = ring_load(&ring->head) - ring->tail;
+
+    if (length > fill)
+        length = fill;
+    ring_store(&ring->tail, ring->tail + length);
+}
+
+/**
+    Copy data out of the ring. Consumer side.
+
+    \param ring ring buffer
+    \param data destination buffer
+    \param length size of the destination buffer
+
+    \retval number of bytes copied, 0 if the ring is empty
+*/
+size_t ftdi_stream_ring_read(struct ftdi_stream_ring *ring,
+                             unsigned char *data, size_t length)
+{
+    size_t copied = 0;
+
+    while (copied < length)
+    {
+        const unsigned char *src;
+        size_t n = ftdi_stream_ring_peek(ring, &src);
+
+        if (n == 0)
+            break;
+        if (n > length - copied)
+            n = length - copied;
+        memcpy(data + copied, src, n);
+        ftdi_stream_ring_consume(ring, n);
+        copied += n;
+    }
+    return copied;
+}
+
+/**
+    Ask ftdi_stream_ring_sink() to end the stream it is attached to.
+    May be called from the consumer thread.
+
+    \param ring ring buffer
+*/
+void ftdi_stream_ring_stop(struct ftdi_stream_ring *ring)
+{
+    ring_store(&ring->stop, 1);
+}
+
+/**
+    Get the statistics of a ring buffer. May be called from any thread.
+
+    \param ring ring buffer
+    \param stats filled with the current statistics
+*/
+void ftdi_stream_ring_get_stats(struct ftdi_stream_ring *ring,
+                                struct ftdi_stream_ring_stats *stats)
+{
+    stats->bytes_written = ring_load_relaxed(&ring->stats.bytes_written);
+    stats->bytes_dropped = ring_load_relaxed(&ring->stats.bytes_dropped);
+    stats->overflows = ring_load_relaxed(&ring->stats.overflows);
+    stats->high_water = ring_load_relaxed(&ring->stats.high_water);
+}
+
+/**
+    Stream callback storing the received data in a ring buffer.
+
+    Pass it to ftdi_readstream() with the ring as userdata. Every block
+    is copied into the ring; when the ring is full the block is dropped
+    and counted instead of stalling the USB transfers. The stream ends
+    once ftdi_stream_ring_stop() was called.
+
+    \param buffer received data, NULL for progress reports
+    \param length size of the received data
+    \param progress progress report, ignored
+    \param userdata the ftdi_stream_ring
+
+    \retval 0: continue streaming
+    \retval 1: stop requested
+*/
+int ftdi_stream_ring_sink(uint8_t *buffer, int length,
+                          FTDIProgressInfo *progress, void *userdata)
+{
+    struct ftdi_stream_ring *ring = (struct ftdi_stream_ring *)userdata;
+
+    (void)progress;
+    if (buffer != NULL && length > 0)
+        ftdi_stream_ring_write(ring, buffer, length);
+    return ring_load(&ring->stop) ? 1 : 0;
+}
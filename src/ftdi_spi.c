@@ -0,0 +1,476 @@
+/***************************************************************************
+                          ftdi_spi.c  -  description
+                             -------------------
+    copyright            : (C) 2011 by the libftdi developers
+    email                : opensource@intra2net.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation;             *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * SPI master on MPSSE. SK is the clock, DO is MOSI, DI is MISO; chip
+ * selects are low byte GPIO pins, active low.
+ *
+ * ftdi_spi_transfer() streams a transaction: the data is cut into
+ * commands of up to 64 KiB which go out in several bulk writes kept in
+ * flight at once, while a single read collects the reply straight into
+ * the caller's buffer. Chip select changes produce no reply, so the
+ * reply is exactly the data shifted in. With the read-ahead engine
+ * several bulk reads are in flight as well.
+ *
+ * ftdi_spi_queue() collects small transactions in an MPSSE command
+ * queue, ftdi_spi_flush() sends them in one write.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ftdi.h"
+#include "ftdi_i.h"
+
+/* SK, DO and DI on the low byte */
+#define FTDI_SPI_SK 0x01
+#define FTDI_SPI_DO 0x02
+#define FTDI_SPI_DI 0x04
+
+/* Longest data phase of one MPSSE shift command */
+#define FTDI_SPI_MAX_COMMAND 65536
+
+/* Command bytes around the data of one write: CS change, shift
+ * header, CS change and SEND_IMMEDIATE */
+#define FTDI_SPI_OVERHEAD (3 + 3 + 3 + 1)
+
+struct ftdi_spi
+{
+    struct ftdi_context *ftdi;
+    struct ftdi_spi_config config;
+    /** MPSSE_WRITE_NEG/MPSSE_READ_NEG/MPSSE_LSB for the shifts */
+    unsigned char shift_mode;
+    /** low byte levels and directions with all chip selects released */
+    unsigned char idle;
+    unsigned char direction;
+    /** write buffers of ftdi_spi_transfer() and their transfers */
+    unsigned char **buffers;
+    struct ftdi_transfer_control **writes;
+    /** queue of ftdi_spi_queue() */
+    struct ftdi_mpsse_queue *queue;
+    /** read-ahead was started by ftdi_spi_new() */
+    int readahead;
+};
+
+/**
+    Set an SPI configuration to the defaults: mode 0, MSB first, one chip
+    select on ADBUS3, clock divisor 0, four 64 KiB writes and four reads
+    in flight.
+
+    \param config configuration to initialize
+*/
+void ftdi_spi_config_init(struct ftdi_spi_config *config)
+{
+    config->mode = 0;
+    config->lsb_first = 0;
+    config->cs_pins = 0x08;
+    config->gpio_value = 0;
+    config->gpio_direction = 0;
+    config->divisor = 0;
+    config->frequency = 0;
+    config->chunk_size = FTDI_SPI_MAX_COMMAND;
+    config->num_writes = 4;
+    config->num_reads = 4;
+}
+
+static int ftdi_spi_is_h_type(struct ftdi_context *ftdi)
+{
+    return ftdi->type == TYPE_2232H || ftdi->type == TYPE_4232H || ftdi->type == TYPE_232H;
+}
+
+/**
+    Set up an SPI master on an opened device
+
+    Switches the interface to MPSSE mode, sets the clock divisor and
+    releases all chip selects. With config.num_reads above 1 the
+    read-ahead engine is started, unless it already runs, see
+    ftdi_readahead_start(). On H type chips the divide by 5 prescaler
+    is disabled, so the clock is 60 MHz / ((1 + divisor) * 2), otherwise
+    12 MHz / ((1 + divisor) * 2). A config.frequency above 0 replaces
+    the divisor by the fastest clock not above it.
+
+    \param ftdi pointer to ftdi_context of an opened device
+    \param config SPI configuration, NULL for the defaults
+
+    \retval pointer to the new SPI master, NULL on error; the reason is
+            in ftdi_get_error_string() when ftdi is not NULL
+*/
+struct ftdi_spi *ftdi_spi_new(struct ftdi_context *ftdi, const struct ftdi_spi_config *config)
+{
+    struct ftdi_spi *spi;
+    int mode, i;
+
+    if (ftdi == NULL)
+        return NULL;
+    if (ftdi->usb_dev == NULL)
+    {
+        ftdi->error_str = "USB device unavailable";
+        return NULL;
+    }
+
+    spi = (struct ftdi_spi *)calloc(1, sizeof(struct ftdi_spi));
+    if (spi == NULL)
+    {
+        ftdi->error_str = "out of memory";
+        return NULL;
+    }
+    spi->ftdi = ftdi;
+    if (config)
+        spi->config = *config;
+    else
+        ftdi_spi_config_init(&spi->config);
+
+    mode = spi->config.mode;
+    if (mode < 0 || mode > 3 || (spi->config.cs_pins & (FTDI_SPI_SK | FTDI_SPI_DO | FTDI_SPI_DI)) ||
+        spi->config.chunk_size < 1 || spi->config.chunk_size > FTDI_SPI_MAX_COMMAND ||
+        spi->config.num_writes < 1)
+    {
+        ftdi->error_str = "invalid SPI configuration";
+        free(spi);
+        return NULL;
+    }
+
+    /* Data changes on one clock edge and is sampled on the other */
+    spi->shift_mode = (mode == 0 || mode == 3) ? MPSSE_WRITE_NEG : MPSSE_READ_NEG;
+    if (spi->config.lsb_first)
+        spi->shift_mode |= MPSSE_LSB;
+
+    spi->idle = (spi->config.gpio_value & ~(FTDI_SPI_SK | FTDI_SPI_DO | FTDI_SPI_DI)) |
+                spi->config.cs_pins | ((mode >= 2) ? FTDI_SPI_SK : 0);
+    spi->direction = (spi->config.gpio_direction & ~FTDI_SPI_DI) |
+                     spi->config.cs_pins | FTDI_SPI_SK | FTDI_SPI_DO;
+
+    spi->buffers = (unsigned char **)calloc(spi->config.num_writes, sizeof(*spi->buffers));
+    spi->writes = (struct ftdi_transfer_control **)calloc(spi->config.num_writes,
+                                                           sizeof(*spi->writes));
+    spi->queue = ftdi_mpsse_queue_new(ftdi);
+    if (!spi->buffers || !spi->writes || !spi->queue)
+        goto no_mem;
+    for (i = 0; i < spi->config.num_writes; i++)
+    {
+        spi->buffers[i] = (unsigned char *)malloc(spi->config.chunk_size + FTDI_SPI_OVERHEAD);
+        if (spi->buffers[i] == NULL)
+            goto no_mem;
+    }
+
+    if (ftdi_set_bitmode(ftdi, 0, BITMODE_RESET) < 0 ||
+        ftdi_set_bitmode(ftdi, spi->direction, BITMODE_MPSSE) < 0 ||
+        ftdi_usb_purge_buffers(ftdi) < 0)
+    {
+        ftdi_spi_free(spi);
+        return NULL;
+    }
+
+    if (spi->config.num_reads > 1 && ftdi->readahead == NULL)
+    {
+        if (ftdi_readahead_start(ftdi, spi->config.num_reads, 0) < 0)
+        {
+            ftdi_spi_free(spi);
+            return NULL;
+        }
+        spi->readahead = 1;
+    }
+
+    if (ftdi_spi_is_h_type(ftdi))
+    {
+        /* ftdi_mpsse_set_clock() picks the prescaler and clocking itself */
+        unsigned char setup[] = { DIS_ADAPTIVE, DIS_DIV_5, DIS_3_PHASE };
+        int n = spi->config.frequency > 0 ? 1 : sizeof(setup);
+
+        if (ftdi_mpsse_queue_raw(spi->queue, setup, n, NULL, 0) < 0)
+            goto no_mem;
+    }
+    if (ftdi_mpsse_loopback(spi->queue, 0) < 0)
+        goto no_mem;
+    if (spi->config.frequency > 0)
+    {
+        if (ftdi_mpsse_set_clock(spi->queue, spi->config.frequency, 0, NULL) < 0)
+        {
+            ftdi_spi_free(spi);
+            ftdi->error_str = "SPI clock needs an MPSSE capable chip";
+            return NULL;
+        }
+    }
+    else if (ftdi_mpsse_set_divisor(spi->queue, spi->config.divisor) < 0)
+        goto no_mem;
+    if (ftdi_mpsse_set_bits_low(spi->queue, spi->idle, spi->direction) < 0)
+        goto no_mem;
+    if (ftdi_mpsse_queue_flush(spi->queue) < 0)
+    {
+        ftdi_spi_free(spi);
+        return NULL;
+    }
+    return spi;
+
+no_mem:
+    ftdi_spi_free(spi);
+    ftdi->error_str = "out of memory";
+    return NULL;
+}
+
+/**
+    Free an SPI master, the device stays in MPSSE mode
+
+    Read-ahead started by ftdi_spi_new() is stopped.
+
+    \param spi SPI master, may be NULL
+*/
+void ftdi_spi_free(struct ftdi_spi *spi)
+{
+    int i;
+
+    if (spi == NULL)
+        return;
+    if (spi->readahead)
+        ftdi_readahead_stop(spi->ftdi);
+    if (spi->buffers)
+    {
+        for (i = 0; i < spi->config.num_writes; i++)
+            free(spi->buffers[i]);
+    }
+    free(spi->buffers);
+    free(spi->writes);
+    ftdi_mpsse_queue_free(spi->queue);
+    free(spi);
+}
+
+/* Append a SET_BITS_LOW with the chip selects in cs asserted */
+static int ftdi_spi_put_cs(struct ftdi_spi *spi, unsigned char *buf, unsigned char cs)
+{
+    buf[0] = SET_BITS_LOW;
+    buf[1] = spi->idle & ~cs;
+    buf[2] = spi->direction;
+    return 3;
+}
+
+/**
+    Run one SPI transaction, or part of one
+
+    The data is shifted in both directions at once. With out NULL only
+    reads are clocked and MOSI keeps its level; with in NULL the received
+    data is dropped. Large transfers are streamed with several writes in
+    flight.
+
+    To send a command and then read under one chip select, call with
+    FTDI_SPI_START for the command and FTDI_SPI_END for the read.
+
+    \param spi SPI master
+    \param cs chip select pins to assert, a subset of config.cs_pins, 0 for none
+    \param out data to send, or NULL
+    \param in receives the data read, or NULL
+    \param length number of bytes
+    \param flags FTDI_SPI_START to assert cs first, FTDI_SPI_END to
+           release it afterwards, FTDI_SPI_WHOLE for both
+
+    \retval  0: all fine
+    \retval -1: invalid arguments
+    \retval -2: writing to the device failed
+    \retval -3: reading from the device failed or timed out
+*/
+int ftdi_spi_transfer(struct ftdi_spi *spi, unsigned char cs,
+                      const unsigned char *out, unsigned char *in, int length, int flags)
+{
+    struct ftdi_context *ftdi;
+    struct ftdi_transfer_control *read_tc = NULL;
+    unsigned char opcode;
+    int pos = 0, slot = 0, ret = 0, i;
+
+    if (spi == NULL)
+        return -1;
+    ftdi = spi->ftdi;
+    if (length < 0 || (cs & ~spi->config.cs_pins))
+        ftdi_error_return(-1, "invalid SPI transfer");
+    if (length == 0 && !(flags & FTDI_SPI_WHOLE))
+        return 0;
+
+    /* with neither direction, zeros are clocked out */
+    opcode = spi->shift_mode | (in ? MPSSE_DO_READ : 0) | ((out || !in) ? MPSSE_DO_WRITE : 0);
+
+    if (in && length)
+    {
+        read_tc = ftdi_read_data_submit(ftdi, in, length);
+        if (read_tc == NULL)
+            ftdi_error_return(-3, "submitting SPI read failed");
+    }
+
+    do
+    {
+        unsigned char *buf = spi->buffers[slot];
+        int n = 0, chunk = length - pos;
+
+        if (chunk > spi->config.chunk_size)
+            chunk = spi->config.chunk_size;
+
+        /* the buffer is free once its previous write is done */
+        if (spi->writes[slot])
+        {
+            int done = ftdi_transfer_data_done(spi->writes[slot]);
+            spi->writes[slot] = NULL;
+            if (done < 0 && !ret)
+                ret = -2;
+        }
+        if (ret)
+            break;
+
+        if (pos == 0 && (flags & FTDI_SPI_START))
+            n += ftdi_spi_put_cs(spi, buf + n, cs);
+        if (chunk > 0)
+        {
+            buf[n++] = opcode;
+            buf[n++] = (chunk - 1) & 0xff;
+            buf[n++] = (chunk - 1) >> 8;
+            if (out)
+                memcpy(buf + n, out + pos, chunk);
+            else if (!in)
+                memset(buf + n, 0, chunk);
+            if (opcode & MPSSE_DO_WRITE)
+                n += chunk;
+            pos += chunk;
+        }
+        if (pos == length)
+        {
+            if (flags & FTDI_SPI_END)
+                n += ftdi_spi_put_cs(spi, buf + n, 0);
+            if (in)
+                buf[n++] = SEND_IMMEDIATE;
+        }
+
+        spi->writes[slot] = ftdi_write_data_submit(ftdi, buf, n);
+        if (spi->writes[slot] == NULL)
+            ret = -2;
+        slot = (slot + 1) % spi->config.num_writes;
+    }
+    while (pos < length && !ret);
+
+    for (i = 0; i < spi->config.num_writes; i++)
+    {
+        if (spi->writes[i])
+        {
+            if (ftdi_transfer_data_done(spi->writes[i]) < 0 && !ret)
+                ret = -2;
+            spi->writes[i] = NULL;
+        }
+    }
+    if (read_tc)
+    {
+        /* the device didn't get all of the transfer, don't wait for its data */
+        if (ret)
+            ftdi_transfer_data_drop(read_tc);
+        else if (ftdi_transfer_data_done(read_tc) != length)
+            ret = -3;
+    }
+
+    if (ret == -2)
+        ftdi_error_return(-2, "writing SPI data failed");
+    if (ret == -3)
+        ftdi_error_return(-3, "reading SPI data failed");
+    return 0;
+}
+
+/**
+    Queue an SPI transaction for ftdi_spi_flush()
+
+    Like ftdi_spi_transfer(), but nothing is sent yet and in is only
+    filled by ftdi_spi_flush(). out has to stay valid until then.
+
+    \param spi SPI master
+    \param cs chip select pins to assert, a subset of config.cs_pins, 0 for none
+    \param out data to send, or NULL to only read
+    \param in receives the data read on flush, or NULL
+    \param length number of bytes
+    \param flags FTDI_SPI_START, FTDI_SPI_END or FTDI_SPI_WHOLE
+
+    \retval  0: all fine
+    \retval -1: invalid arguments
+    \retval -2: out of memory, nothing of the transaction is queued
+*/
+int ftdi_spi_queue(struct ftdi_spi *spi, unsigned char cs,
+                   const unsigned char *out, unsigned char *in, int length, int flags)
+{
+    struct ftdi_context *ftdi;
+    struct ftdi_mpsse_mark mark;
+    int ret = 0;
+
+    if (spi == NULL)
+        return -1;
+    ftdi = spi->ftdi;
+    if (length < 0 || (cs & ~spi->config.cs_pins))
+        ftdi_error_return(-1, "invalid SPI transfer");
+
+    ftdi_mpsse_queue_mark(spi->queue, &mark);
+    if (flags & FTDI_SPI_START)
+        ret = ftdi_mpsse_set_bits_low(spi->queue, spi->idle & ~cs, spi->direction);
+    while (!ret && length > 0)
+    {
+        /* clocking without data in either direction sends zeros */
+        static const unsigned char zeros[256];
+        int n = length;
+
+        if (out == NULL && in == NULL)
+        {
+            if (n > (int)sizeof(zeros))
+                n = sizeof(zeros);
+            ret = ftdi_mpsse_shift_bytes(spi->queue, spi->shift_mode, zeros, NULL, n);
+        }
+        else
+            ret = ftdi_mpsse_shift_bytes(spi->queue, spi->shift_mode, out, in, n);
+        if (out)
+            out += n;
+        if (in)
+            in += n;
+        length -= n;
+    }
+    if (!ret && (flags & FTDI_SPI_END))
+        ret = ftdi_mpsse_set_bits_low(spi->queue, spi->idle, spi->direction);
+    if (ret)
+    {
+        /* take back the half queued transaction, chip select included */
+        ftdi_mpsse_queue_rollback(spi->queue, &mark);
+        ftdi_error_return(-2, "out of memory for SPI transaction");
+    }
+    return 0;
+}
+
+/**
+    Send all transactions queued with ftdi_spi_queue()
+
+    \param spi SPI master
+
+    \retval  0: all fine
+    \retval <0: see ftdi_mpsse_queue_flush()
+*/
+int ftdi_spi_flush(struct ftdi_spi *spi)
+{
+    if (spi == NULL)
+        return -1;
+    return ftdi_mpsse_queue_flush(spi->queue);
+}
+
+/**
+    Get the MPSSE command queue behind ftdi_spi_queue()
+
+    Commands added to it, e.g. GPIO changes, are sent in order with the
+    queued SPI transactions.
+
+    \param spi SPI master
+
+    \retval the command queue, NULL if spi is NULL
+*/
+struct ftdi_mpsse_queue *ftdi_spi_get_queue(struct ftdi_spi *spi)
+{
+    if (spi == NULL)
+        return NULL;
+    return spi->queue;
+}
@@ -41,33 +41,135 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
 
 #include "ftdi.h"
+#include "ftdi_i.h"
+
+/* Line status byte, the second status byte of every packet */
+#define FTDI_LSR_OVERRUN 0x02
+#define FTDI_LSR_ERRORS  0x9c   /* parity, framing, break, error in RCVR FIFO */
 
 typedef struct
 {
     FTDIStreamCallback *callback;
+    FTDIStreamProducer *producer;
     void *userdata;
+    struct ftdi_context *ftdi;
+    struct ftdi_stream_config config;
+    struct libusb_transfer **transfers;
+    int numRead;
+    int numWrite;
+    int finished;
+    int roundResult;
     int packetsize;
+    int whole;
+    int writesize;
     int activity;
     int result;
+    int writing;
+    int stopping;
+    int draining;
+    int in_flight;
+    struct ftdi_stream_control *control;
+    struct libusb_transfer **parked;
+    int num_parked;
     FTDIProgressInfo progress;
+    FTDIProgressInfo wprogress;
+    FTDIRateWindow rwindow;
+    FTDIRateWindow wwindow;
+    struct ftdi_stream_stats *stats;
+    double total_gap;
+    struct ftdi_pattern_checker *checker;
 } FTDIStreamState;
 
+/**
+   Helper function to calculate (unix) time differences
+
+   \param a timeval
+   \param b timeval
+*/
+static double
+TimevalDiff(const struct timeval *a, const struct timeval *b)
+{
+   return (a->tv_sec - b->tv_sec) + 1e-6 * (a->tv_usec - b->tv_usec);
+}
+
+/* Account a completed read transfer in the statistics
+ *
+ * Must run before the status bytes are stripped
+ */
+static void
+ftdi_stream_account_read(FTDIStreamState *state, struct libusb_transfer *transfer,
+                         const struct timeval *now)
+{
+    struct ftdi_stream_stats *stats = state->stats;
+    int packet_size = state->packetsize;
+    int length = transfer->actual_length;
+    int numPackets = (length + packet_size - 1) / packet_size;
+    int i;
+
+    if (stats->transfers)
+    {
+        double gap = TimevalDiff(now, &stats->last_completion);
+
+        state->total_gap += gap;
+        if (gap > stats->max_gap)
+            stats->max_gap = gap;
+        stats->mean_gap = state->total_gap / stats->transfers;
+    }
+    stats->last_completion = *now;
+    stats->transfers++;
+
+    if (length < transfer->length)
+        stats->short_transfers++;
+    if (length <= 2 * numPackets)
+        stats->empty_transfers++;
+
+    for (i = 0; i < numPackets; i++)
+    {
+        unsigned char lsr;
+
+        if (i * packet_size + 1 >= length)
+            break;
+        lsr = transfer->buffer[i * packet_size + 1];
+        if (lsr & FTDI_LSR_OVERRUN)
+            stats->overruns++;
+        if (lsr & FTDI_LSR_ERRORS)
+            stats->line_errors++;
+    }
+}
+
+/* Check whether ftdi_stream_pause() is in effect */
+static int
+ftdi_stream_is_paused(FTDIStreamState *state)
+{
+    return state->control &&
+           __atomic_load_n(&state->control->paused, __ATOMIC_ACQUIRE);
+}
+
 /* Handle callbacks
- * 
- * With Exit request, free memory and release the transfer
  *
- * state->result is only set when some error happens 
+ * While paused, keep the transfer parked for ftdi_stream_resume().
+ * With Exit request, retire the transfer. Transfers are freed
+ * once none is in flight anymore.
+ *
+ * state->result is only set when some error happens or the
+ * callback asks to stop
  */
 static void
 ftdi_readstream_cb(struct libusb_transfer *transfer)
 {
    FTDIStreamState *state = transfer->user_data;
    int packet_size = state->packetsize;
+   struct timeval completed;
 
    state->activity++;
-   if (transfer->status == LIBUSB_TRANSFER_COMPLETED)
+   /* While draining, the data of cancelled transfers is still delivered */
+   if (transfer->status == LIBUSB_TRANSFER_COMPLETED ||
+       (transfer->status == LIBUSB_TRANSFER_CANCELLED && state->draining &&
+        !state->result && transfer->actual_length > 0))
    {
        int i;
        uint8_t *ptr = transfer->buffer;
@@ -75,17 +177,46 @@ ftdi_readstream_cb(struct libusb_transfer *transfer)
        int numPackets = (length + packet_size - 1) / packet_size;
        int res = 0;
 
-       for (i = 0; i < numPackets; i++)
+       if (state->stats)
+       {
+           ftdi_now(&completed);
+           ftdi_stream_account_read(state, transfer, &completed);
+       }
+
+       if (state->whole)
+       {
+           /* Strip the status bytes once and hand over the whole transfer */
+           length = ftdi_compact_packets(ptr, length, ptr, length,
+                                         packet_size, 0);
+           state->progress.current.totalBytes += length;
+           if (state->checker)
+           {
+               ftdi_pattern_check(state->checker, ptr, length);
+               if (state->stats)
+                   ftdi_pattern_get_stats(state->checker, &state->stats->pattern);
+           }
+           if (length > 0)
+               res = state->callback(ptr, length, NULL, state->userdata);
+           numPackets = 0;
+       }
+
+       for (i = 0; i < numPackets && !res; i++)
        {
            int payloadLen;
            int packetLen = length;
-           
+
            if (packetLen > packet_size)
                packetLen = packet_size;
-           
+
            payloadLen = packetLen - 2;
            state->progress.current.totalBytes += payloadLen;
-           
+           if (state->checker)
+           {
+               ftdi_pattern_check(state->checker, ptr + 2, payloadLen);
+               if (state->stats)
+                   ftdi_pattern_get_stats(state->checker, &state->stats->pattern);
+           }
+
            res = state->callback(ptr + 2, payloadLen,
                                  NULL, state->userdata);
 
@@ -94,79 +225,309 @@ ftdi_readstream_cb(struct libusb_transfer *transfer)
        }
        if (res)
        {
-           free(transfer->buffer);
-           libusb_free_transfer(transfer);           
+           if (!state->result)
+               state->result = res;
        }
-       else
+       else if (transfer->status == LIBUSB_TRANSFER_COMPLETED &&
+                !state->result && !state->stopping && ftdi_stream_is_paused(state))
        {
+           state->parked[state->num_parked++] = transfer;
+       }
+       else if (transfer->status == LIBUSB_TRANSFER_COMPLETED &&
+                !state->result && !state->stopping)
+       {
+           struct timeval now;
+           double latency;
+
            transfer->status = -1;
            state->result = libusb_submit_transfer(transfer);
+           if (!state->result)
+           {
+               if (state->stats)
+               {
+                   ftdi_now(&now);
+                   latency = TimevalDiff(&now, &completed);
+                   if (latency > state->stats->max_resubmit)
+                       state->stats->max_resubmit = latency;
+               }
+               return;
+           }
        }
    }
-   else
+   else if (transfer->status != LIBUSB_TRANSFER_CANCELLED)
    {
-       fprintf(stderr, "unknown status %d\n",transfer->status); 
+       fprintf(stderr, "unknown status %d\n",transfer->status);
        state->result = LIBUSB_ERROR_IO;
    }
+   state->in_flight--;
+}
+
+/* Refill a write transfer from the producer and submit it
+ *
+ * Returns 1 when the transfer was submitted, 0 when the write side
+ * has ended, either because the producer has no more data or because
+ * of an error, which is then stored in state->result
+ */
+static int
+ftdi_writestream_submit(FTDIStreamState *state, struct libusb_transfer *transfer)
+{
+    int length;
+
+    if (!state->writing || state->result || state->stopping)
+        return 0;
+
+    length = state->producer(transfer->buffer, state->writesize,
+                             NULL, state->userdata);
+    if (length <= 0 || length > state->writesize)
+    {
+        if (length < 0)
+            state->result = length;
+        else if (length > state->writesize)
+            state->result = LIBUSB_ERROR_OVERFLOW;
+        state->writing = 0;
+        return 0;
+    }
+
+    transfer->length = length;
+    transfer->status = -1;
+    state->result = libusb_submit_transfer(transfer);
+    if (state->result)
+    {
+        state->writing = 0;
+        return 0;
+    }
+    return 1;
+}
+
+static void
+ftdi_writestream_cb(struct libusb_transfer *transfer)
+{
+    FTDIStreamState *state = transfer->user_data;
+
+    state->activity++;
+    if (transfer->status == LIBUSB_TRANSFER_COMPLETED)
+    {
+        if (state->stats)
+            state->stats->write_transfers++;
+        state->wprogress.current.totalBytes += transfer->actual_length;
+        if (state->writing && !state->result && !state->stopping &&
+            ftdi_stream_is_paused(state))
+            state->parked[state->num_parked++] = transfer;
+        else if (ftdi_writestream_submit(state, transfer))
+            return;
+    }
+    else if (transfer->status != LIBUSB_TRANSFER_CANCELLED)
+    {
+        fprintf(stderr, "unknown status %d\n",transfer->status);
+        state->result = LIBUSB_ERROR_IO;
+    }
+    state->in_flight--;
+}
+
+/* Resubmit the transfers parked while the stream was paused */
+static void
+ftdi_stream_resume_parked(FTDIStreamState *state)
+{
+    while (state->num_parked > 0 && !state->result)
+    {
+        struct libusb_transfer *transfer = state->parked[--state->num_parked];
+
+        if (transfer->callback == ftdi_readstream_cb)
+        {
+            transfer->status = -1;
+            state->result = libusb_submit_transfer(transfer);
+            if (state->result)
+                break;
+            state->in_flight++;
+        }
+        else if (ftdi_writestream_submit(state, transfer))
+            state->in_flight++;
+    }
 }
 
 /**
-   Helper function to calculate (unix) time differences
+   Helper function to sample the byte count for the rolling window rate
 
-   \param a timeval
-   \param b timeval
+   \param w rate window
+   \param progress progress info with the current byte count
+   \param now current time
+   \param window length of the window in seconds
 */
-static double
-TimevalDiff(const struct timeval *a, const struct timeval *b)
+void
+ftdi_stream_sample_rate(FTDIRateWindow *w, const FTDIProgressInfo *progress,
+                        const struct timeval *now, double window)
 {
-   return (a->tv_sec - b->tv_sec) + 1e-6 * (a->tv_usec - b->tv_usec);
+    if (w->count)
+    {
+        int last = (w->next + FTDI_STREAM_RATE_SAMPLES - 1) % FTDI_STREAM_RATE_SAMPLES;
+
+        if (TimevalDiff(now, &w->samples[last].time) < window / FTDI_STREAM_RATE_SAMPLES)
+            return;
+    }
+
+    w->samples[w->next].totalBytes = progress->current.totalBytes;
+    w->samples[w->next].time = *now;
+    w->next = (w->next + 1) % FTDI_STREAM_RATE_SAMPLES;
+    if (w->count < FTDI_STREAM_RATE_SAMPLES)
+        w->count++;
 }
 
 /**
-    Streaming reading of data from the device
-    
-    Use asynchronous transfers in libusb-1.0 for high-performance
-    streaming of data from a device interface back to the PC. This
-    function continuously transfers data until either an error occurs
-    or the callback returns a nonzero value. This function returns
-    a libusb error code or the callback's return value.
+   Helper function to calculate the rate over the last window
 
-    For every contiguous block of received data, the callback will
-    be invoked.
+   Uses the oldest sample inside the window, or the newest one if all
+   samples are older.
 
-    \param  ftdi pointer to ftdi_context
-    \param  callback to user supplied function for one block of data
-    \param  userdata
-    \param  packetsPerTransfer number of packets per transfer
-    \param  numTransfers Number of transfers per callback
+   \param w rate window
+   \param progress progress info with the current byte count
+   \param now current time
+   \param window length of the window in seconds
+*/
+double
+ftdi_stream_window_rate(const FTDIRateWindow *w, const FTDIProgressInfo *progress,
+                        const struct timeval *now, double window)
+{
+    const struct size_and_time *sample = NULL;
+    double elapsed;
+    int i;
+
+    for (i = 0; i < w->count; i++)
+    {
+        int index = (w->next + FTDI_STREAM_RATE_SAMPLES - w->count + i) % FTDI_STREAM_RATE_SAMPLES;
+
+        sample = &w->samples[index];
+        if (TimevalDiff(now, &sample->time) <= window)
+            break;
+    }
+    if (sample == NULL)
+        return 0;
+
+    elapsed = TimevalDiff(now, &sample->time);
+    if (elapsed <= 0)
+        return 0;
+    return (progress->current.totalBytes - sample->totalBytes) / elapsed;
+}
+
+/**
+   Helper function to update the times and rates of a progress report
 
+   \param progress progress info to update
+   \param w rate window of the same direction
+   \param now current time
+   \param window length of the rate window in seconds
 */
+void
+ftdi_stream_update_progress(FTDIProgressInfo *progress, const FTDIRateWindow *w,
+                            const struct timeval *now, double window)
+{
+    progress->current.time = *now;
+    progress->windowRate = ftdi_stream_window_rate(w, progress, now, window);
+    progress->totalTime = TimevalDiff(&progress->current.time,
+                                      &progress->first.time);
 
-int
-ftdi_readstream(struct ftdi_context *ftdi,
-                      FTDIStreamCallback *callback, void *userdata,
-                      int packetsPerTransfer, int numTransfers)
+    if (progress->prev.totalBytes)
+    {
+        // We have enough information to calculate rates
+
+        double currentTime;
+
+        currentTime = TimevalDiff(&progress->current.time,
+                                  &progress->prev.time);
+
+        progress->totalRate =
+            progress->current.totalBytes /progress->totalTime;
+        progress->currentRate =
+            (progress->current.totalBytes -
+             progress->prev.totalBytes) / currentTime;
+    }
+}
+
+/**
+    Set a stream configuration to the defaults of ftdi_readstream():
+    synchronous FIFO mode with all pins as outputs, 8 packets per
+    transfer and 256 transfers in flight, one callback per packet,
+    progress reports every second with a 100 ms rate window, no
+    pattern check.
+
+    \param config configuration to initialize
+*/
+void
+ftdi_stream_config_init(struct ftdi_stream_config *config)
 {
-    struct libusb_transfer **transfers;
-    FTDIStreamState state = { callback, userdata, ftdi->max_packet_size, 1 };
-    int bufferSize = packetsPerTransfer * ftdi->max_packet_size;
+    config->bitmode = BITMODE_SYNCFF;
+    config->bitmask = 0xff;
+    config->packets_per_transfer = 8;
+    config->num_transfers = 256;
+    config->whole_transfers = 0;
+    config->stats = NULL;
+    config->progress_interval = 1.0;
+    config->rate_window = 0.1;
+    config->control = NULL;
+    config->pattern = FTDI_PATTERN_NONE;
+}
+
+/* Prepare the state of a stream, nothing is allocated yet
+ *
+ * Returns LIBUSB_ERROR_INVALID_PARAM for an unusable configuration
+ */
+static int
+ftdi_stream_init_state(FTDIStreamState *state, struct ftdi_context *ftdi,
+                       const struct ftdi_stream_config *config,
+                       FTDIStreamCallback *callback, FTDIStreamProducer *producer,
+                       void *userdata)
+{
+    memset(state, 0, sizeof(*state));
+    if (config)
+        state->config = *config;
+    else
+        ftdi_stream_config_init(&state->config);
+
+    if (ftdi == NULL || ftdi->usb_dev == NULL ||
+        state->config.packets_per_transfer < 1 || state->config.num_transfers < 1 ||
+        (callback == NULL && producer == NULL))
+        return LIBUSB_ERROR_INVALID_PARAM;
+
+    state->ftdi = ftdi;
+    state->callback = callback;
+    state->producer = producer;
+    state->userdata = userdata;
+    state->packetsize = ftdi->max_packet_size;
+    state->numRead = callback ? state->config.num_transfers : 0;
+    state->numWrite = producer ? state->config.num_transfers : 0;
+    return 0;
+}
+
+/* Set up the transfers of a stream and start it
+ *
+ * Returns 0 or the error to pass to ftdi_stream_teardown()
+ */
+static int
+ftdi_stream_setup(FTDIStreamState *state)
+{
+    struct ftdi_context *ftdi = state->ftdi;
+    const struct ftdi_stream_config *config = &state->config;
+    int bufferSize = config->packets_per_transfer * ftdi->max_packet_size;
+    int numRead = state->numRead;
+    int numWrite = state->numWrite;
     int xferIndex;
-    int err = 0;
+    int err;
 
     /* Only FT2232H and FT232H know about the synchronous FIFO Mode*/
-    if ((ftdi->type != TYPE_2232H) && (ftdi->type != TYPE_232H))
+    if (config->bitmode == BITMODE_SYNCFF &&
+        (ftdi->type != TYPE_2232H) && (ftdi->type != TYPE_232H))
     {
         fprintf(stderr,"Device doesn't support synchronous FIFO mode\n");
         return 1;
     }
-    
+
     /* We don't know in what state we are, switch to reset*/
-    if (ftdi_set_bitmode(ftdi,  0xff, BITMODE_RESET) < 0)
+    if (config->bitmode != FTDI_STREAM_KEEP_MODE &&
+        ftdi_set_bitmode(ftdi, config->bitmask, BITMODE_RESET) < 0)
     {
         fprintf(stderr,"Can't reset mode\n");
         return 1;
     }
-    
+
     /* Purge anything remaining in the buffers*/
     if (ftdi_usb_purge_buffers(ftdi) < 0)
     {
@@ -174,122 +535,784 @@ ftdi_readstream(struct ftdi_context *ftdi,
         return 1;
     }
 
+    state->whole = config->whole_transfers;
+    /* A stop or pause requested before the start takes effect right away */
+    state->control = config->control;
+    state->stats = config->stats;
+    if (state->stats)
+    {
+        memset(state->stats, 0, sizeof(*state->stats));
+        state->stats->pattern.first_error = -1;
+    }
+    if (config->pattern != FTDI_PATTERN_NONE && state->callback)
+    {
+        state->checker = ftdi_pattern_checker_new(config->pattern);
+        if (!state->checker)
+            return LIBUSB_ERROR_INVALID_PARAM;
+    }
+    state->writesize = bufferSize;
+    state->writing = (state->producer != NULL);
+
     /*
      * Set up all transfers
      */
-    
-    transfers = calloc(numTransfers, sizeof *transfers);
-    if (!transfers) {
-        err = LIBUSB_ERROR_NO_MEM;
-        goto cleanup;
-    }
-    
-    for (xferIndex = 0; xferIndex < numTransfers; xferIndex++)
+
+    state->transfers = calloc(numRead + numWrite, sizeof *state->transfers);
+    state->parked = calloc(numRead + numWrite, sizeof *state->parked);
+    if (!state->transfers || !state->parked)
+        return LIBUSB_ERROR_NO_MEM;
+
+    for (xferIndex = 0; xferIndex < numRead + numWrite; xferIndex++)
     {
         struct libusb_transfer *transfer;
-        
+
         transfer = libusb_alloc_transfer(0);
-        transfers[xferIndex] = transfer;
-        if (!transfer) {
-            err = LIBUSB_ERROR_NO_MEM;
-            goto cleanup;
-        }
-        
-        libusb_fill_bulk_transfer(transfer, ftdi->usb_dev, ftdi->out_ep,
-                                  malloc(bufferSize), bufferSize, 
-				  ftdi_readstream_cb,
-                                  &state, 0);
-        
-        if (!transfer->buffer) {
-            err = LIBUSB_ERROR_NO_MEM;
-            goto cleanup;
-        }
-        
-        transfer->status = -1;
-        err = libusb_submit_transfer(transfer);
+        state->transfers[xferIndex] = transfer;
+        if (!transfer)
+            return LIBUSB_ERROR_NO_MEM;
+
+        if (xferIndex < numRead)
+            libusb_fill_bulk_transfer(transfer, ftdi->usb_dev, ftdi->out_ep,
+                                      malloc(bufferSize), bufferSize,
+                                      ftdi_readstream_cb,
+                                      state, 0);
+        else
+            libusb_fill_bulk_transfer(transfer, ftdi->usb_dev, ftdi->in_ep,
+                                      malloc(bufferSize), bufferSize,
+                                      ftdi_writestream_cb,
+                                      state, 0);
+
+        if (!transfer->buffer)
+            return LIBUSB_ERROR_NO_MEM;
+    }
+
+    /* Started paused: park the transfers until ftdi_stream_resume() */
+    if (ftdi_stream_is_paused(state))
+    {
+        for (xferIndex = 0; xferIndex < numRead + numWrite; xferIndex++)
+            state->parked[state->num_parked++] = state->transfers[xferIndex];
+        numRead = 0;
+        numWrite = 0;
+    }
+
+    for (xferIndex = 0; xferIndex < numRead; xferIndex++)
+    {
+        state->transfers[xferIndex]->status = -1;
+        err = libusb_submit_transfer(state->transfers[xferIndex]);
         if (err)
-            goto cleanup;
+            return err;
+        state->in_flight++;
     }
 
     /* Start the transfers only when everything has been set up.
-     * Otherwise the transfers start stuttering and the PC not 
-     * fetching data for several to several ten milliseconds 
+     * Otherwise the transfers start stuttering and the PC not
+     * fetching data for several to several ten milliseconds
      * and we skip blocks
      */
-    if (ftdi_set_bitmode(ftdi,  0xff, BITMODE_SYNCFF) < 0)
+    if (config->bitmode != FTDI_STREAM_KEEP_MODE &&
+        ftdi_set_bitmode(ftdi, config->bitmask, config->bitmode) < 0)
     {
-        fprintf(stderr,"Can't set synchronous fifo mode: %s\n",
+        fprintf(stderr,"Can't set bit mode 0x%02x: %s\n", config->bitmode,
                 ftdi_get_error_string(ftdi));
-        goto cleanup;
+        return 1;
     }
 
-    /*
-     * Run the transfers, and periodically assess progress.
+    /* Outgoing data must not reach the chip before it is in
+     * the streaming mode, so writes are only queued now
      */
-    
-    gettimeofday(&state.progress.first.time, NULL);
-    
-    do
+    for (xferIndex = state->numRead; xferIndex < state->numRead + numWrite; xferIndex++)
     {
-        FTDIProgressInfo  *progress = &state.progress;
-        const double progressInterval = 1.0;
-        struct timeval timeout = { 0, ftdi->usb_read_timeout };
-        struct timeval now;
-        
-        int err = libusb_handle_events_timeout(ftdi->usb_ctx, &timeout);
-        if (err ==  LIBUSB_ERROR_INTERRUPTED)
-            /* restart interrupted events */
-            err = libusb_handle_events_timeout(ftdi->usb_ctx, &timeout);  
-        if (!state.result)
+        if (ftdi_writestream_submit(state, state->transfers[xferIndex]))
+            state->in_flight++;
+    }
+
+    ftdi_now(&state->progress.first.time);
+    state->progress.current.time = state->progress.first.time;
+    state->wprogress.first.time = state->progress.first.time;
+    state->wprogress.current.time = state->progress.first.time;
+    return 0;
+}
+
+/* Handle control requests before the next round of events
+ *
+ * Returns 1 once the stream is finished
+ */
+static int
+ftdi_stream_poll(FTDIStreamState *state)
+{
+    int paused = ftdi_stream_is_paused(state);
+
+    if (state->finished)
+        return 1;
+
+    if (state->control && !state->draining &&
+        __atomic_load_n(&state->control->stop, __ATOMIC_ACQUIRE))
+    {
+        /* Graceful stop: no new transfers, let those in flight complete */
+        state->draining = 1;
+        state->stopping = 1;
+    }
+    else if (!paused && state->num_parked)
+        ftdi_stream_resume_parked(state);
+
+    if (state->result || (state->in_flight == 0 && (!paused || state->draining)))
+        state->finished = 1;
+    return state->finished;
+}
+
+/* Assess a round of event handling: detect stalls, report progress */
+static void
+ftdi_stream_account_round(FTDIStreamState *state, int res)
+{
+    const double progressInterval = state->config.progress_interval;
+    const double rateWindow = state->config.rate_window;
+    struct timeval now;
+
+    if (!state->result)
+    {
+        state->result = res;
+    }
+    if (state->activity == 0)
+    {
+        /* Nothing arrives anymore: cancel the rest when draining */
+        if (state->draining)
         {
-            state.result = err;
+            state->finished = 1;
+            return;
         }
-        if (state.activity == 0)
-            state.result = 1;
-        else
-            state.activity = 0;
-        
-        // If enough time has elapsed, update the progress
-        gettimeofday(&now, NULL);
-        if (TimevalDiff(&now, &progress->current.time) >= progressInterval)
+        if (!ftdi_stream_is_paused(state))
+            state->result = 1;
+    }
+    else
+        state->activity = 0;
+
+    if (progressInterval <= 0)
+        return;
+
+    // If enough time has elapsed, update the progress
+    ftdi_now(&now);
+    if (state->callback)
+    {
+        ftdi_stream_sample_rate(&state->rwindow, &state->progress, &now, rateWindow);
+        if (TimevalDiff(&now, &state->progress.current.time) >= progressInterval)
         {
-            progress->current.time = now;
-            progress->totalTime = TimevalDiff(&progress->current.time,
-                                              &progress->first.time);
-            
-            if (progress->prev.totalBytes)
+            ftdi_stream_update_progress(&state->progress, &state->rwindow, &now, rateWindow);
+            state->callback(NULL, 0, &state->progress, state->userdata);
+            state->progress.prev = state->progress.current;
+        }
+    }
+    if (state->producer)
+    {
+        ftdi_stream_sample_rate(&state->wwindow, &state->wprogress, &now, rateWindow);
+        if (TimevalDiff(&now, &state->wprogress.current.time) >= progressInterval)
+        {
+            ftdi_stream_update_progress(&state->wprogress, &state->wwindow, &now, rateWindow);
+            state->producer(NULL, 0, &state->wprogress, state->userdata);
+            state->wprogress.prev = state->wprogress.current;
+        }
+    }
+}
+
+/* Cancel any outstanding transfers, and free memory
+ *
+ * Returns err if set, the result of the stream otherwise
+ */
+static int
+ftdi_stream_teardown(FTDIStreamState *state, int err)
+{
+    int numTransfers = state->numRead + state->numWrite;
+    int xferIndex;
+
+    state->finished = 1;
+    if (state->transfers)
+    {
+        state->stopping = 1;
+        for (xferIndex = 0; xferIndex < numTransfers; xferIndex++)
+        {
+            if (state->transfers[xferIndex])
+                libusb_cancel_transfer(state->transfers[xferIndex]);
+        }
+
+        while (state->in_flight > 0)
+        {
+            struct timeval timeout = { 0, 100000 };
+            int res = libusb_handle_events_timeout(state->ftdi->usb_ctx, &timeout);
+            if (res < 0 && res != LIBUSB_ERROR_INTERRUPTED)
+                break;
+        }
+
+        /* Transfers libusb still owns are leaked rather than freed */
+        if (state->in_flight == 0)
+        {
+            for (xferIndex = 0; xferIndex < numTransfers; xferIndex++)
             {
-                // We have enough information to calculate rates
-                
-                double currentTime;
-                
-                currentTime = TimevalDiff(&progress->current.time,
-                                          &progress->prev.time);
-                
-                progress->totalRate = 
-		    progress->current.totalBytes /progress->totalTime;
-                progress->currentRate = 
-		    (progress->current.totalBytes -
-		     progress->prev.totalBytes) / currentTime;
+                if (state->transfers[xferIndex])
+                {
+                    free(state->transfers[xferIndex]->buffer);
+                    libusb_free_transfer(state->transfers[xferIndex]);
+                }
             }
-            
-            state.callback(NULL, 0, progress, state.userdata);
-            progress->prev = progress->current;
-            
+            free(state->transfers);
         }
-    } while (!state.result);
-    
+        state->transfers = NULL;
+    }
+    free(state->parked);
+    state->parked = NULL;
+
+    ftdi_pattern_checker_free(state->checker);
+    state->checker = NULL;
+
+    /* The stop request is used up, the control can start another stream */
+    if (state->draining)
+        __atomic_store_n(&state->control->stop, 0, __ATOMIC_RELEASE);
+
+    if (err)
+        state->result = err;
+    return state->result;
+}
+
+/**
+    Stream data from and/or to the device
+
+    The common engine of the streaming functions. It keeps
+    config->num_transfers asynchronous transfers per direction in
+    flight on the interface the context was opened on. A NULL callback
+    disables reading, a NULL producer disables writing; see
+    ftdi_readstream() and ftdi_writestream() for their semantics.
+
+    Unless config->bitmode is FTDI_STREAM_KEEP_MODE, the chip is reset,
+    its buffers are purged, and it is switched to config->bitmode once
+    the read transfers are queued. With FTDI_STREAM_KEEP_MODE the mode
+    set up by the caller, e.g. MPSSE or synchronous bitbang, is left
+    alone and only the buffers are purged.
+
+    Progress is reported to the callback and the producer with a NULL
+    buffer every config->progress_interval seconds. Times in progress
+    reports and statistics come from a monotonic clock where available.
+
+    With config->control the stream can be paused, resumed and stopped
+    while it runs, see ftdi_stream_pause().
+
+    If config->stats is set, it is cleared and then updated on every
+    completed transfer: gaps between read completions, the latency of
+    resubmitting a read, short and empty transfers, and packets whose
+    line status byte reports an overrun or another receive error.
+
+    With config->pattern the received data is checked against that test
+    pattern before it is passed to the callback; errors and the offset
+    of the first one are counted in config->stats.
+
+    \param  ftdi pointer to ftdi_context
+    \param  config stream configuration, NULL for the defaults
+    \param  callback to user supplied function for received data, or NULL
+    \param  producer user supplied function for data to send, or NULL
+    \param  userdata passed to callback and producer
+
+    \retval 0: producer ended the stream, or ftdi_stream_stop() was called
+    \retval 1: setup failed or the stream stalled
+    \retval other: libusb error code or the callback's return value
+*/
+int
+ftdi_stream_run(struct ftdi_context *ftdi, const struct ftdi_stream_config *config,
+                FTDIStreamCallback *callback, FTDIStreamProducer *producer,
+                void *userdata)
+{
+    FTDIStreamState state;
+    int err;
+
+    err = ftdi_stream_init_state(&state, ftdi, config, callback, producer, userdata);
+    if (err)
+        return err;
+
+    err = ftdi_stream_setup(&state);
+
     /*
-     * Cancel any outstanding transfers, and free memory.
+     * Run the transfers, and periodically assess progress.
      */
-    
- cleanup:
-    fprintf(stderr, "cleanup\n");
-    if (transfers)
-       free(transfers);
+
+    while (!err && !ftdi_stream_poll(&state))
+    {
+        struct timeval timeout = { 0, ftdi->usb_read_timeout };
+
+        int res = libusb_handle_events_timeout(ftdi->usb_ctx, &timeout);
+        if (res ==  LIBUSB_ERROR_INTERRUPTED)
+            /* restart interrupted events */
+            res = libusb_handle_events_timeout(ftdi->usb_ctx, &timeout);
+        ftdi_stream_account_round(&state, res);
+    }
+
+    return ftdi_stream_teardown(&state, err);
+}
+
+/**
+    Streaming reading of data from the device
+
+    Use asynchronous transfers in libusb-1.0 for high-performance
+    streaming of data from a device interface back to the PC. This
+    function continuously transfers data until either an error occurs
+    or the callback returns a nonzero value. This function returns
+    a libusb error code or the callback's return value.
+
+    For every contiguous block of received data, the callback will
+    be invoked.
+
+    About once per second the callback is invoked with a NULL buffer
+    and the progress of the stream. Its time stamps, starting with
+    progress->first.time, come from CLOCK_MONOTONIC where available, not
+    from the wall clock. FTDIProgressInfo.windowRate, appended to the
+    structure, holds the rate over the last 100 ms.
+
+    The device is switched to synchronous FIFO mode, which only the
+    FT2232H and FT232H support. Use ftdi_stream_run() for other modes.
+
+    \param  ftdi pointer to ftdi_context
+    \param  callback to user supplied function for one block of data
+    \param  userdata
+    \param  packetsPerTransfer number of packets per transfer
+    \param  numTransfers Number of transfers per callback
+
+*/
+
+int
+ftdi_readstream(struct ftdi_context *ftdi,
+                      FTDIStreamCallback *callback, void *userdata,
+                      int packetsPerTransfer, int numTransfers)
+{
+    struct ftdi_stream_config config;
+
+    ftdi_stream_config_init(&config);
+    config.packets_per_transfer = packetsPerTransfer;
+    config.num_transfers = numTransfers;
+    return ftdi_stream_run(ftdi, &config, callback, NULL, userdata);
+}
+
+/**
+    Streaming reading of data from the device, one callback per transfer
+
+    Works like ftdi_readstream(), but instead of once per USB packet the
+    callback is invoked once per completed transfer. The modem status
+    bytes are stripped in place, so the callback gets the payload of up
+    to packetsPerTransfer packets as one contiguous block. Transfers
+    without payload do not invoke the callback.
+
+    \param  ftdi pointer to ftdi_context
+    \param  callback to user supplied function for one block of data
+    \param  userdata
+    \param  packetsPerTransfer number of packets per transfer
+    \param  numTransfers Number of transfers in flight
+*/
+int
+ftdi_readstream_whole(struct ftdi_context *ftdi,
+                      FTDIStreamCallback *callback, void *userdata,
+                      int packetsPerTransfer, int numTransfers)
+{
+    struct ftdi_stream_config config;
+
+    ftdi_stream_config_init(&config);
+    config.packets_per_transfer = packetsPerTransfer;
+    config.num_transfers = numTransfers;
+    config.whole_transfers = 1;
+    return ftdi_stream_run(ftdi, &config, callback, NULL, userdata);
+}
+
+/**
+    Streaming writing of data to the device
+
+    Counterpart of ftdi_readstream(): keeps numTransfers asynchronous
+    bulk transfers in flight, each refilled by the producer as soon as
+    it completed. The producer stores up to length bytes in buffer and
+    returns how many it stored. Returning 0 ends the stream once the
+    transfers still in flight are done, a negative value aborts it and
+    is returned by this function.
+
+    The producer is also invoked about once per second with a NULL
+    buffer and the progress of the stream; its return value is then
+    ignored.
+
+    \param  ftdi pointer to ftdi_context
+    \param  producer user supplied function filling one block of data
+    \param  userdata
+    \param  packetsPerTransfer number of packets per transfer
+    \param  numTransfers Number of transfers in flight
+
+    \retval 0: producer ended the stream and all data was sent
+    \retval <0: libusb error code or the producer's return value
+*/
+int
+ftdi_writestream(struct ftdi_context *ftdi,
+                 FTDIStreamProducer *producer, void *userdata,
+                 int packetsPerTransfer, int numTransfers)
+{
+    struct ftdi_stream_config config;
+
+    ftdi_stream_config_init(&config);
+    config.packets_per_transfer = packetsPerTransfer;
+    config.num_transfers = numTransfers;
+    return ftdi_stream_run(ftdi, &config, NULL, producer, userdata);
+}
+
+/**
+    Concurrent streaming of data from and to the device
+
+    Runs ftdi_readstream() and ftdi_writestream() on one device and one
+    event loop, each direction with its own numTransfers transfers.
+    The stream ends when the callback returns a nonzero value or an
+    error occurs. When the producer ends the write side, reading
+    continues.
+
+    \param  ftdi pointer to ftdi_context
+    \param  callback to user supplied function for one block of received data
+    \param  producer user supplied function filling one block of data to send
+    \param  userdata passed to both callback and producer
+    \param  packetsPerTransfer number of packets per transfer
+    \param  numTransfers Number of transfers in flight per direction
+*/
+int
+ftdi_readwritestream(struct ftdi_context *ftdi,
+                     FTDIStreamCallback *callback, FTDIStreamProducer *producer,
+                     void *userdata, int packetsPerTransfer, int numTransfers)
+{
+    struct ftdi_stream_config config;
+
+    ftdi_stream_config_init(&config);
+    config.packets_per_transfer = packetsPerTransfer;
+    config.num_transfers = numTransfers;
+    return ftdi_stream_run(ftdi, &config, callback, producer, userdata);
+}
+
+/**
+    Allocate a control to pause, resume and stop a stream. Pass it in
+    ftdi_stream_config.control. A control can be reused for several
+    streams, but only by one at a time.
+
+    \retval pointer to the new control, NULL if out of memory
+*/
+struct ftdi_stream_control *
+ftdi_stream_control_new(void)
+{
+    return (struct ftdi_stream_control *)calloc(1, sizeof(struct ftdi_stream_control));
+}
+
+/**
+    Free a stream control. No stream may use it anymore.
+
+    \param control stream control, may be NULL
+*/
+void
+ftdi_stream_control_free(struct ftdi_stream_control *control)
+{
+    free(control);
+}
+
+/**
+    Pause a running stream
+
+    Completed transfers are not resubmitted anymore, but stay allocated;
+    the data they carry is still passed to the callback. The device keeps
+    its mode, so ftdi_stream_resume() continues with minimal latency.
+    May be called from the stream callback or from another thread. A
+    stream started with a paused control sets up its transfers, but
+    submits them only once resumed.
+
+    \param control stream control
+
+    \retval  0: all fine
+    \retval -1: invalid control
+*/
+int
+ftdi_stream_pause(struct ftdi_stream_control *control)
+{
+    if (control == NULL)
+        return -1;
+    __atomic_store_n(&control->paused, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+    Resume a stream paused with ftdi_stream_pause()
+
+    The parked transfers are resubmitted by the stream's event loop.
+    May be called from the stream callback or from another thread.
+
+    \param control stream control
+
+    \retval  0: all fine
+    \retval -1: invalid control
+*/
+int
+ftdi_stream_resume(struct ftdi_stream_control *control)
+{
+    if (control == NULL)
+        return -1;
+    __atomic_store_n(&control->paused, 0, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+    Stop a running stream gracefully
+
+    No new transfers are submitted. Transfers in flight are allowed to
+    complete and their data is passed to the callback; those that stay
+    idle are cancelled, and any data they already received is passed on
+    as well. ftdi_stream_run() then returns 0. May be called from the
+    stream callback or from another thread. A stop requested before the
+    stream starts ends it right away. The request is cleared once a
+    stream stopped because of it.
+
+    \param control stream control
+
+    \retval  0: all fine
+    \retval -1: invalid control
+*/
+int
+ftdi_stream_stop(struct ftdi_stream_control *control)
+{
+    if (control == NULL)
+        return -1;
+    __atomic_store_n(&control->stop, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/* Streams registered with ftdi_stream_group_add() */
+struct ftdi_stream_group
+{
+    FTDIStreamState **streams;
+    int num_streams;
+};
+
+/**
+    Allocate an empty stream group
+
+    A stream group runs the streams of several devices from one event
+    loop in the calling thread. Devices opened with ftdi_init_shared()
+    on one libusb context are serviced together; otherwise every
+    libusb context gets its own time slice in each round.
+
+    \retval pointer to the new group, NULL if out of memory
+*/
+struct ftdi_stream_group *
+ftdi_stream_group_new(void)
+{
+    return (struct ftdi_stream_group *)calloc(1, sizeof(struct ftdi_stream_group));
+}
+
+/**
+    Free a stream group. It must not be running.
+
+    \param group stream group, may be NULL
+*/
+void
+ftdi_stream_group_free(struct ftdi_stream_group *group)
+{
+    int i;
+
+    if (group == NULL)
+        return;
+    for (i = 0; i < group->num_streams; i++)
+        free(group->streams[i]);
+    free(group->streams);
+    free(group);
+}
+
+/**
+    Register the stream of one device with a group
+
+    Takes the same arguments as ftdi_stream_run(); the configuration is
+    copied. Every device keeps its own transfers, callbacks, progress
+    reports, statistics and control.
+
+    \param  group stream group
+    \param  ftdi pointer to an open ftdi_context, at most once per group
+    \param  config stream configuration, NULL for the defaults
+    \param  callback to user supplied function for received data, or NULL
+    \param  producer user supplied function for data to send, or NULL
+    \param  userdata passed to callback and producer
+
+    \retval >=0: index of the stream in the group
+    \retval -1: invalid arguments or device already in the group
+    \retval -2: out of memory
+*/
+int
+ftdi_stream_group_add(struct ftdi_stream_group *group, struct ftdi_context *ftdi,
+                      const struct ftdi_stream_config *config,
+                      FTDIStreamCallback *callback, FTDIStreamProducer *producer,
+                      void *userdata)
+{
+    FTDIStreamState **streams;
+    FTDIStreamState *state;
+    int i;
+
+    if (group == NULL)
+        return -1;
+    for (i = 0; i < group->num_streams; i++)
+    {
+        if (group->streams[i]->ftdi == ftdi)
+            return -1;
+    }
+
+    state = (FTDIStreamState *)malloc(sizeof(FTDIStreamState));
+    if (state == NULL)
+        return -2;
+    if (ftdi_stream_init_state(state, ftdi, config, callback, producer, userdata))
+    {
+        free(state);
+        return -1;
+    }
+
+    streams = (FTDIStreamState **)realloc(group->streams,
+                                          (group->num_streams + 1) * sizeof(*streams));
+    if (streams == NULL)
+    {
+        free(state);
+        return -2;
+    }
+    group->streams = streams;
+    group->streams[group->num_streams] = state;
+    return group->num_streams++;
+}
+
+/**
+    Get the result of one stream of a group after ftdi_stream_group_run()
+
+    \param group stream group
+    \param index index returned by ftdi_stream_group_add()
+
+    \retval value ftdi_stream_run() would have returned for this stream
+    \retval LIBUSB_ERROR_INVALID_PARAM: invalid group or index
+*/
+int
+ftdi_stream_group_result(struct ftdi_stream_group *group, int index)
+{
+    if (group == NULL || index < 0 || index >= group->num_streams)
+        return LIBUSB_ERROR_INVALID_PARAM;
+    return group->streams[index]->result;
+}
+
+/**
+    Run all streams of a group until each has finished
+
+    Every stream behaves as under ftdi_stream_run() and ends on its own;
+    the others continue. All streams are set up before the first round
+    of events, and if one cannot be set up, none is run.
+
+    The report function gets a combined progress report with a NULL
+    buffer every reportInterval seconds: totalBytes counts the bytes
+    received and sent by all streams, windowRate uses the rate_window
+    of the first stream.
+
+    \param  group stream group
+    \param  report function for combined progress reports, or NULL
+    \param  reportInterval seconds between combined reports
+    \param  userdata passed to report
+
+    \retval 0: all streams ran, see ftdi_stream_group_result()
+    \retval LIBUSB_ERROR_INVALID_PARAM: empty or invalid group
+    \retval other: setup error of the first stream that failed
+*/
+int
+ftdi_stream_group_run(struct ftdi_stream_group *group,
+                      FTDIStreamCallback *report, double reportInterval,
+                      void *userdata)
+{
+    FTDIProgressInfo total;
+    FTDIRateWindow window;
+    double rateWindow;
+    int i, j, err = 0, active;
+
+    if (group == NULL || group->num_streams == 0)
+        return LIBUSB_ERROR_INVALID_PARAM;
+    rateWindow = group->streams[0]->config.rate_window;
+
+    /* Start from a clean state, the group may have run before */
+    for (i = 0; i < group->num_streams; i++)
+    {
+        FTDIStreamState copy = *group->streams[i];
+
+        ftdi_stream_init_state(group->streams[i], copy.ftdi, &copy.config,
+                               copy.callback, copy.producer, copy.userdata);
+    }
+
+    for (i = 0; i < group->num_streams && !err; i++)
+        err = ftdi_stream_setup(group->streams[i]);
     if (err)
+    {
+        for (j = 0; j < i; j++)
+            ftdi_stream_teardown(group->streams[j], j == i - 1 ? err : 0);
+        for (; j < group->num_streams; j++)
+            group->streams[j]->result = 0;
         return err;
-    else
-        return state.result;
-}
+    }
 
+    memset(&total, 0, sizeof(total));
+    memset(&window, 0, sizeof(window));
+    ftdi_now(&total.first.time);
+    total.current.time = total.first.time;
+
+    do
+    {
+        struct timeval now;
+
+        active = 0;
+        for (i = 0; i < group->num_streams; i++)
+        {
+            FTDIStreamState *state = group->streams[i];
+
+            if (state->transfers == NULL)
+                continue;
+            if (ftdi_stream_poll(state))
+                ftdi_stream_teardown(state, 0);
+            else
+                active++;
+        }
+
+        /* One round of events per libusb context */
+        for (i = 0; i < group->num_streams; i++)
+        {
+            FTDIStreamState *state = group->streams[i];
+            struct timeval timeout = { 0, state->ftdi->usb_read_timeout };
+
+            if (state->transfers == NULL)
+                continue;
+            for (j = 0; j < i; j++)
+            {
+                if (group->streams[j]->transfers &&
+                    group->streams[j]->ftdi->usb_ctx == state->ftdi->usb_ctx)
+                    break;
+            }
+            if (j < i)
+            {
+                state->roundResult = group->streams[j]->roundResult;
+                continue;
+            }
+
+            state->roundResult = libusb_handle_events_timeout(state->ftdi->usb_ctx, &timeout);
+            if (state->roundResult == LIBUSB_ERROR_INTERRUPTED)
+                state->roundResult = libusb_handle_events_timeout(state->ftdi->usb_ctx, &timeout);
+        }
+
+        total.current.totalBytes = 0;
+        for (i = 0; i < group->num_streams; i++)
+        {
+            FTDIStreamState *state = group->streams[i];
+
+            if (state->transfers)
+                ftdi_stream_account_round(state, state->roundResult);
+            total.current.totalBytes += state->progress.current.totalBytes +
+                                        state->wprogress.current.totalBytes;
+        }
+
+        if (report == NULL || reportInterval <= 0)
+            continue;
+
+        ftdi_now(&now);
+        ftdi_stream_sample_rate(&window, &total, &now, rateWindow);
+        if (TimevalDiff(&now, &total.current.time) >= reportInterval)
+        {
+            ftdi_stream_update_progress(&total, &window, &now, rateWindow);
+            report(NULL, 0, &total, userdata);
+            total.prev = total.current;
+        }
+    } while (active);
+
+    return 0;
+}
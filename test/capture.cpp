@@ -0,0 +1,181 @@
+/**@file
+@brief Test the capture file format for stream recordings
+
+@author libftdi developers
+*/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation;             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <ftdi.h>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+
+using namespace std;
+
+/// Temporary capture file with chunks of 1..100 counter bytes, 10 us apart
+class CaptureFixture
+{
+public:
+    enum { Chunks = 2500, Start = 1000000 };
+
+    CaptureFixture()
+        : ftdi(ftdi_new()), total(0)
+    {
+        strcpy(path, "/tmp/ftdi_capture_XXXXXX");
+        int fd = mkstemp(path);
+        BOOST_REQUIRE(fd >= 0);
+        close(fd);
+    }
+
+    ~CaptureFixture()
+    {
+        unlink(path);
+        ftdi_free(ftdi);
+    }
+
+    void record(bool finish)
+    {
+        struct ftdi_capture_writer *writer =
+            ftdi_capture_open_write(path, ftdi, BITMODE_SYNCFF, 0);
+        BOOST_REQUIRE(writer != NULL);
+
+        vector<unsigned char> chunk(100);
+        unsigned char counter = 0;
+        for (int i = 0; i < Chunks; i++)
+        {
+            int n = i % 100 + 1;
+            for (int j = 0; j < n; j++)
+                chunk[j] = counter++;
+            BOOST_REQUIRE_EQUAL(ftdi_capture_write(writer, &chunk[0], n, Start + 10 * i), 0);
+            offsets.push_back(total);
+            total += n;
+        }
+
+        if (finish)
+        {
+            BOOST_REQUIRE_EQUAL(ftdi_capture_close_write(writer), 0);
+        }
+        else
+        {
+            // Simulate a crash: keep the data, lose the index and trailer
+            BOOST_REQUIRE_EQUAL(ftdi_capture_close_write(writer), 0);
+            BOOST_REQUIRE_EQUAL(truncate(path, 64 + 24 * Chunks + total + 2 * (16 + 24 * 1024)), 0);
+        }
+    }
+
+    void verify()
+    {
+        struct ftdi_capture_reader *reader = ftdi_capture_open_read(path);
+        BOOST_REQUIRE(reader != NULL);
+
+        struct ftdi_capture_info info;
+        ftdi_capture_get_info(reader, &info);
+        BOOST_CHECK_EQUAL(info.type, (int)ftdi->type);
+        BOOST_CHECK_EQUAL(info.bitmode, (int)BITMODE_SYNCFF);
+        BOOST_CHECK_EQUAL(info.num_chunks, (int64_t)Chunks);
+        BOOST_CHECK_EQUAL(info.total_bytes, total);
+
+        for (int i = 0; i < Chunks; i += 97)
+        {
+            struct ftdi_capture_chunk chunk;
+            BOOST_REQUIRE_EQUAL(ftdi_capture_get_chunk(reader, i, &chunk), 0);
+            BOOST_CHECK_EQUAL(chunk.timestamp, (uint64_t)(Start + 10 * i));
+            BOOST_CHECK_EQUAL(chunk.offset, offsets[i]);
+            BOOST_CHECK_EQUAL(chunk.length, (size_t)(i % 100 + 1));
+            BOOST_CHECK_EQUAL(chunk.data[0], (unsigned char)offsets[i]);
+
+            BOOST_CHECK_EQUAL(ftdi_capture_find_time(reader, Start + 10 * i), i);
+            BOOST_CHECK_EQUAL(ftdi_capture_find_time(reader, Start + 10 * i + 9), i);
+            BOOST_CHECK_EQUAL(ftdi_capture_find_offset(reader, offsets[i]), i);
+            BOOST_CHECK_EQUAL(ftdi_capture_find_offset(reader, offsets[i] + i % 100), i);
+        }
+        BOOST_CHECK_EQUAL(ftdi_capture_find_time(reader, Start - 1), -1);
+        BOOST_CHECK_EQUAL(ftdi_capture_find_offset(reader, total), -1);
+        BOOST_CHECK_EQUAL(ftdi_capture_get_chunk(reader, Chunks, NULL), -1);
+
+        ftdi_capture_close_read(reader);
+    }
+
+    struct ftdi_context *ftdi;
+    char path[32];
+    vector<uint64_t> offsets;
+    uint64_t total;
+};
+
+BOOST_FIXTURE_TEST_SUITE(Capture, CaptureFixture)
+
+BOOST_AUTO_TEST_CASE(Indexed)
+{
+    record(true);
+    verify();
+}
+
+BOOST_AUTO_TEST_CASE(MissingTrailer)
+{
+    record(false);
+    verify();
+}
+
+BOOST_AUTO_TEST_CASE(CallbackCoalesces)
+{
+    struct ftdi_capture_writer *writer =
+        ftdi_capture_open_write(path, ftdi, BITMODE_SYNCFF, 1000);
+    BOOST_REQUIRE(writer != NULL);
+
+    vector<uint8_t> block(510);
+    for (int i = 0; i < 5; i++)
+        BOOST_CHECK_EQUAL(ftdi_capture_callback(&block[0], block.size(), NULL, writer), 0);
+    BOOST_CHECK_EQUAL(ftdi_capture_callback(NULL, 0, NULL, writer), 0);
+    BOOST_REQUIRE_EQUAL(ftdi_capture_close_write(writer), 0);
+
+    struct ftdi_capture_reader *reader = ftdi_capture_open_read(path);
+    BOOST_REQUIRE(reader != NULL);
+    struct ftdi_capture_info info;
+    ftdi_capture_get_info(reader, &info);
+    BOOST_CHECK_EQUAL(info.num_chunks, 3);
+    BOOST_CHECK_EQUAL(info.total_bytes, 2550U);
+    ftdi_capture_close_read(reader);
+}
+
+BOOST_AUTO_TEST_CASE(OversizedChunk)
+{
+    struct ftdi_capture_writer *writer =
+        ftdi_capture_open_write(path, ftdi, BITMODE_SYNCFF, 1000);
+    BOOST_REQUIRE(writer != NULL);
+
+    // the chunk length field has 32 bits, the payload is never touched
+    vector<uint8_t> block(100, 0x55);
+    if (sizeof(size_t) > 4)
+    {
+        BOOST_CHECK(ftdi_capture_open_write(path, ftdi, BITMODE_SYNCFF,
+                                            (size_t)UINT32_MAX + 1) == NULL);
+        BOOST_CHECK_EQUAL(ftdi_capture_write(writer, &block[0], (size_t)UINT32_MAX + 1, 0),
+                          -EINVAL);
+    }
+    BOOST_CHECK_EQUAL(ftdi_capture_write(writer, &block[0], block.size(), 0), 0);
+    BOOST_REQUIRE_EQUAL(ftdi_capture_close_write(writer), 0);
+
+    struct ftdi_capture_reader *reader = ftdi_capture_open_read(path);
+    BOOST_REQUIRE(reader != NULL);
+    struct ftdi_capture_info info;
+    ftdi_capture_get_info(reader, &info);
+    BOOST_CHECK_EQUAL(info.num_chunks, 1);
+    BOOST_CHECK_EQUAL(info.total_bytes, 100U);
+    ftdi_capture_close_read(reader);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
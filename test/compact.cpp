@@ -0,0 +1,99 @@
+/**@file
+@brief Test modem status byte stripping of the read path
+
+@author libftdi developers
+*/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation;             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <ftdi.h>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <vector>
+
+using namespace std;
+
+/// Build a raw bulk read: every packet starts with two status bytes
+static vector<unsigned char> make_raw(int length, int packet_size, vector<unsigned char> &payload)
+{
+    vector<unsigned char> raw(length);
+    unsigned char counter = 0;
+
+    payload.clear();
+    for (int i = 0; i < length; i++)
+    {
+        if (i % packet_size < 2)
+            raw[i] = (i % packet_size) ? 0x60 : 0x31;
+        else
+        {
+            raw[i] = counter++;
+            payload.push_back(raw[i]);
+        }
+    }
+    return raw;
+}
+
+BOOST_AUTO_TEST_SUITE(Compact)
+
+BOOST_AUTO_TEST_CASE(WholeTransfer)
+{
+    const int packet_sizes[] = { 64, 512 };
+    const int lengths[] = { 0, 1, 2, 3, 63, 64, 65, 66, 67, 511, 512, 513, 4095, 4096, 16384 };
+
+    for (unsigned int p = 0; p < sizeof(packet_sizes)/sizeof(int); p++)
+    {
+        for (unsigned int l = 0; l < sizeof(lengths)/sizeof(int); l++)
+        {
+            vector<unsigned char> payload;
+            vector<unsigned char> raw = make_raw(lengths[l], packet_sizes[p], payload);
+            vector<unsigned char> out(lengths[l] + 1, 0xaa);
+
+            int stored = ftdi_compact_packets(&out[0], out.size(), &raw[0], raw.size(), packet_sizes[p], 0);
+
+            BOOST_REQUIRE_EQUAL(stored, (int)payload.size());
+            BOOST_CHECK(equal(payload.begin(), payload.end(), out.begin()));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(SplitBetweenBuffers)
+{
+    vector<unsigned char> payload;
+    vector<unsigned char> raw = make_raw(4096, 64, payload);
+
+    // Fill a small caller buffer first, then keep the rest in place
+    for (int size = 1; size < (int)payload.size(); size += 37)
+    {
+        vector<unsigned char> work(raw);
+        vector<unsigned char> buf(size);
+
+        int part_size = ftdi_compact_packets(&buf[0], size, &work[0], work.size(), 64, 0);
+        BOOST_REQUIRE_EQUAL(part_size, size);
+
+        int remaining = ftdi_compact_packets(&work[0], work.size(), &work[0], work.size(), 64, part_size);
+        BOOST_REQUIRE_EQUAL(part_size + remaining, (int)payload.size());
+
+        BOOST_CHECK(equal(buf.begin(), buf.end(), payload.begin()));
+        BOOST_CHECK(equal(work.begin(), work.begin() + remaining, payload.begin() + part_size));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(InPlace)
+{
+    vector<unsigned char> payload;
+    vector<unsigned char> raw = make_raw(512 * 7 + 100, 512, payload);
+
+    int stored = ftdi_compact_packets(&raw[0], raw.size(), &raw[0], raw.size(), 512, 0);
+
+    BOOST_REQUIRE_EQUAL(stored, (int)payload.size());
+    BOOST_CHECK(equal(payload.begin(), payload.end(), raw.begin()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
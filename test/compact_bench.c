@@ -0,0 +1,115 @@
+/* compact_bench.c
+
+   Micro benchmark for the modem status byte stripping of the read path.
+
+   Feeds synthetic bulk transfers made of 64 and 512 byte packets through
+   the single pass compaction kernel and through the previous
+   memmove()-then-memcpy() scheme, so changes can be measured without
+   any FTDI hardware attached.
+
+   Both run at about the same speed: the kernel itself is no faster.
+   What ftdi_read_data() gains is the copy it no longer does, as the
+   payload now goes straight into the caller's buffer.
+
+   This program is distributed under the GPL, version 2
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ftdi.h>
+
+#define TRANSFER_SIZE 16384
+#define ROUNDS 20000
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static void fill_raw(unsigned char *raw, int length, int packet_size)
+{
+    int i;
+    for (i = 0; i < length; i++)
+        raw[i] = (i % packet_size < 2) ? 0x31 : (unsigned char)i;
+}
+
+/* The way ftdi_read_data() used to strip the status bytes */
+static int compact_twopass(unsigned char *dst, unsigned char *raw, int actual_length, int packet_size)
+{
+    int num_of_chunks = actual_length / packet_size;
+    int chunk_remains = actual_length % packet_size;
+    int offset = 2, i;
+
+    actual_length -= 2;
+    if (actual_length > packet_size - 2)
+    {
+        for (i = 1; i < num_of_chunks; i++)
+            memmove(raw+offset+(packet_size - 2)*i, raw+offset+packet_size*i, packet_size - 2);
+        if (chunk_remains > 2)
+        {
+            memmove(raw+offset+(packet_size - 2)*i, raw+offset+packet_size*i, chunk_remains-2);
+            actual_length -= 2*num_of_chunks;
+        }
+        else
+            actual_length -= 2*(num_of_chunks-1)+chunk_remains;
+    }
+    memcpy(dst, raw+offset, actual_length);
+    return actual_length;
+}
+
+static void run(int packet_size)
+{
+    unsigned char *pristine = malloc(TRANSFER_SIZE);
+    unsigned char *raw = malloc(TRANSFER_SIZE);
+    unsigned char *dst = malloc(TRANSFER_SIZE);
+    double start, old_time, new_time;
+    long long total = 0;
+    int r;
+
+    fill_raw(pristine, TRANSFER_SIZE, packet_size);
+
+    start = now();
+    for (r = 0; r < ROUNDS; r++)
+    {
+        memcpy(raw, pristine, TRANSFER_SIZE);
+        total += compact_twopass(dst, raw, TRANSFER_SIZE, packet_size);
+    }
+    old_time = now() - start;
+
+    start = now();
+    for (r = 0; r < ROUNDS; r++)
+    {
+        memcpy(raw, pristine, TRANSFER_SIZE);
+        total -= ftdi_compact_packets(dst, TRANSFER_SIZE, raw, TRANSFER_SIZE, packet_size, 0);
+    }
+    new_time = now() - start;
+
+    /* Subtract the time needed to restore the synthetic data */
+    start = now();
+    for (r = 0; r < ROUNDS; r++)
+        memcpy(raw, pristine, TRANSFER_SIZE);
+    start = now() - start;
+    old_time -= start;
+    new_time -= start;
+
+    printf("%3d byte packets: two pass %8.1f MB/s, single pass %8.1f MB/s%s\n",
+           packet_size,
+           (double)TRANSFER_SIZE * ROUNDS / old_time / 1e6,
+           (double)TRANSFER_SIZE * ROUNDS / new_time / 1e6,
+           total ? " (MISMATCH)" : "");
+
+    free(pristine);
+    free(raw);
+    free(dst);
+}
+
+int main(void)
+{
+    run(64);
+    run(512);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,139 @@
+/**@file
+@brief Test driving asynchronous transfers from an application event loop
+
+@author libftdi developers
+*/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation;             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "fake_usb.h"
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+struct Completion
+{
+    Completion() : calls(0), result(-100) {}
+    int calls;
+    int result;
+};
+
+static void on_done(struct ftdi_transfer_control *tc, int result, void *userdata)
+{
+    Completion *c = static_cast<Completion *>(userdata);
+
+    c->calls++;
+    c->result = result;
+}
+
+static void fd_added(int fd, short events, void *user_data)
+{
+}
+
+static void fd_removed(int fd, void *user_data)
+{
+}
+
+BOOST_FIXTURE_TEST_SUITE(EventLoop, FakeFixture)
+
+BOOST_AUTO_TEST_CASE(Pollfds)
+{
+    const struct libusb_pollfd **fds = ftdi_get_pollfds(ftdi);
+
+    BOOST_REQUIRE(fds != NULL);
+    BOOST_REQUIRE(fds[0] != NULL);
+    BOOST_CHECK_EQUAL(fds[0]->fd, fake_usb.poll_fd);
+    BOOST_CHECK(fds[1] == NULL);
+    ftdi_free_pollfds(fds);
+    ftdi_free_pollfds(NULL);
+
+    fake_usb.poll_fd = -1;
+    BOOST_CHECK(ftdi_get_pollfds(ftdi) == NULL);
+    BOOST_CHECK(ftdi_get_pollfds(NULL) == NULL);
+}
+
+BOOST_AUTO_TEST_CASE(PollfdNotifiers)
+{
+    int cookie;
+
+    BOOST_CHECK_EQUAL(ftdi_set_pollfd_notifiers(ftdi, fd_added, fd_removed, &cookie), 0);
+    BOOST_CHECK(fake_usb.added_cb == fd_added);
+    BOOST_CHECK(fake_usb.removed_cb == fd_removed);
+    BOOST_CHECK(fake_usb.notifier_data == &cookie);
+
+    BOOST_CHECK_EQUAL(ftdi_set_pollfd_notifiers(ftdi, NULL, NULL, NULL), 0);
+    BOOST_CHECK(fake_usb.added_cb == NULL);
+}
+
+BOOST_AUTO_TEST_CASE(NextTimeout)
+{
+    struct timeval tv;
+
+    BOOST_CHECK_EQUAL(ftdi_get_next_timeout(ftdi, &tv), 0);
+
+    fake_usb.next_timeout = 1500;
+    BOOST_CHECK_EQUAL(ftdi_get_next_timeout(ftdi, &tv), 1);
+    BOOST_CHECK_EQUAL(tv.tv_sec, 1);
+    BOOST_CHECK_EQUAL(tv.tv_usec, 500000);
+
+    fake_usb.next_timeout = -1;
+    BOOST_CHECK_EQUAL(ftdi_get_next_timeout(ftdi, &tv), -2);
+    BOOST_CHECK_EQUAL(ftdi_get_next_timeout(ftdi, NULL), -1);
+}
+
+BOOST_AUTO_TEST_CASE(HandleEventsRunsCallbacks)
+{
+    vector<unsigned char> out(300, 0x42), in(40);
+    Completion wrote, read;
+
+    BOOST_REQUIRE_EQUAL(ftdi_write_data_submit_cb(ftdi, &out[0], out.size(), on_done, &wrote), 0);
+    BOOST_REQUIRE_EQUAL(ftdi_read_data_submit_cb(ftdi, &in[0], in.size(), on_done, &read), 0);
+    BOOST_CHECK_EQUAL(wrote.calls, 0);
+    BOOST_CHECK_EQUAL(read.calls, 0);
+
+    // one non-blocking round completes both
+    BOOST_CHECK_EQUAL(ftdi_handle_events(ftdi), 0);
+    BOOST_CHECK_EQUAL(wrote.calls, 1);
+    BOOST_CHECK_EQUAL(wrote.result, (int)out.size());
+    BOOST_CHECK_EQUAL(read.calls, 1);
+    BOOST_CHECK_EQUAL(read.result, (int)in.size());
+    BOOST_CHECK(dev.written == out);
+    BOOST_CHECK(equal(in.begin(), in.end(), dev.sent.begin()));
+
+    // nothing pending: does not block
+    BOOST_CHECK_EQUAL(ftdi_handle_events(ftdi), 0);
+    BOOST_CHECK_EQUAL(wrote.calls, 1);
+    BOOST_CHECK_EQUAL(fake_usb.pending(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(HandleEventsErrors)
+{
+    vector<unsigned char> out(10);
+    Completion wrote;
+
+    BOOST_REQUIRE_EQUAL(ftdi_write_data_submit_cb(ftdi, &out[0], out.size(), on_done, &wrote), 0);
+    fake_usb.event_failures = 1;
+    BOOST_CHECK_EQUAL(ftdi_handle_events(ftdi), -2);
+    BOOST_CHECK_EQUAL(wrote.calls, 0);
+    BOOST_CHECK_EQUAL(ftdi_handle_events(ftdi), 0);
+    BOOST_CHECK_EQUAL(wrote.calls, 1);
+
+    // a failed transfer reports an error to its callback
+    dev.fail_out_at = dev.out_transfers;
+    BOOST_REQUIRE_EQUAL(ftdi_write_data_submit_cb(ftdi, &out[0], out.size(), on_done, &wrote), 0);
+    BOOST_CHECK_EQUAL(ftdi_handle_events(ftdi), 0);
+    BOOST_CHECK_EQUAL(wrote.calls, 2);
+    BOOST_CHECK_EQUAL(wrote.result, -1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,351 @@
+/**@file
+@brief Fake libusb transfer layer for tests without hardware
+
+@author libftdi developers
+*/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation;             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "fake_usb.h"
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <set>
+#include <poll.h>
+
+FakeUsb fake_usb;
+
+static std::deque<struct libusb_transfer *> pending_transfers;
+static std::set<struct libusb_transfer *> cancelled_transfers;
+
+FakeDevice::FakeDevice(int packet_size)
+    : packet_size(packet_size), in_plan_pos(0), in_data_pos(0), in_limit(-1), lsr_plan_pos(0), out_transfers(0),
+      fail_out_at(-1), next_in_status(-1), seed(12345)
+{
+}
+
+void FakeDevice::attach(struct ftdi_context *ftdi)
+{
+    ftdi->usb_dev = reinterpret_cast<libusb_device_handle *>(this);
+    ftdi->max_packet_size = packet_size;
+    ftdi->type = TYPE_2232H;
+}
+
+void FakeDevice::detach(struct ftdi_context *ftdi)
+{
+    ftdi->usb_dev = NULL;
+}
+
+int FakeDevice::fill_in(unsigned char *buf, int length)
+{
+    int offset = 0;
+
+    while (length - offset >= 2)
+    {
+        int payload = packet_size - 2;
+        int packet, i;
+
+        if (!in_plan.empty())
+        {
+            payload = in_plan[in_plan_pos++ % in_plan.size()];
+            if (payload < 0 || payload > packet_size - 2)
+                payload = packet_size - 2;
+        }
+        if (in_limit >= 0)
+        {
+            if (payload > in_limit)
+                payload = in_limit;
+            in_limit -= payload;
+        }
+        packet = payload + 2;
+        if (packet > length - offset)
+        {
+            if (in_limit >= 0)
+                in_limit += packet - (length - offset);
+            packet = length - offset;
+        }
+
+        buf[offset] = 0x31;
+        buf[offset + 1] = lsr_plan.empty() ? 0x60 : lsr_plan[lsr_plan_pos++ % lsr_plan.size()];
+        for (i = 2; i < packet; i++)
+        {
+            if (in_data_pos < in_data.size())
+                buf[offset + i] = in_data[in_data_pos++];
+            else
+            {
+                seed = seed * 1103515245 + 12345;
+                buf[offset + i] = seed >> 16;
+            }
+            sent.push_back(buf[offset + i]);
+        }
+        offset += packet;
+
+        // a short packet ends the transfer
+        if (packet < packet_size)
+            break;
+    }
+    return offset;
+}
+
+void FakeUsb::reset()
+{
+    pending_transfers.clear();
+    cancelled_transfers.clear();
+    submits_left = -1;
+    cancel_fails = false;
+    event_failures = 0;
+    stalled = false;
+    next_timeout = 0;
+    poll_fd = 3;
+    added_cb = NULL;
+    removed_cb = NULL;
+    notifier_data = NULL;
+    event_rounds = 0;
+}
+
+int FakeUsb::pending() const
+{
+    return pending_transfers.size();
+}
+
+static void complete_transfer(struct libusb_transfer *transfer)
+{
+    FakeDevice *dev = reinterpret_cast<FakeDevice *>(transfer->dev_handle);
+
+    if (cancelled_transfers.erase(transfer))
+    {
+        transfer->status = LIBUSB_TRANSFER_CANCELLED;
+        transfer->actual_length = 0;
+    }
+    else if (transfer->endpoint & 0x80)
+    {
+        transfer->actual_length = dev->fill_in(transfer->buffer, transfer->length);
+        transfer->status = LIBUSB_TRANSFER_COMPLETED;
+        if (dev->next_in_status >= 0)
+        {
+            transfer->status = (enum libusb_transfer_status)dev->next_in_status;
+            dev->next_in_status = -1;
+        }
+    }
+    else if (dev->out_transfers++ == dev->fail_out_at)
+    {
+        transfer->status = LIBUSB_TRANSFER_ERROR;
+        transfer->actual_length = 0;
+    }
+    else
+    {
+        dev->written.insert(dev->written.end(), transfer->buffer, transfer->buffer + transfer->length);
+        transfer->status = LIBUSB_TRANSFER_COMPLETED;
+        transfer->actual_length = transfer->length;
+    }
+    transfer->callback(transfer);
+}
+
+/* Complete everything submitted before this round, callbacks may submit more */
+static int handle_round(bool blocking)
+{
+    std::deque<struct libusb_transfer *> round;
+
+    fake_usb.event_rounds++;
+    if (fake_usb.event_failures > 0)
+    {
+        fake_usb.event_failures--;
+        return LIBUSB_ERROR_IO;
+    }
+    // nothing would ever wake up a blocking call
+    if (pending_transfers.empty() || fake_usb.stalled)
+        return blocking ? LIBUSB_ERROR_TIMEOUT : 0;
+
+    round.swap(pending_transfers);
+    while (!round.empty())
+    {
+        struct libusb_transfer *transfer = round.front();
+
+        round.pop_front();
+        complete_transfer(transfer);
+    }
+    return 0;
+}
+
+FakeFixture::FakeFixture(int packet_size) : dev(packet_size), queue(NULL)
+{
+    fake_usb.reset();
+    live = fake_usb.live;
+    ftdi = ftdi_new();
+    dev.attach(ftdi);
+}
+
+FakeFixture::~FakeFixture()
+{
+    BOOST_CHECK_EQUAL(fake_usb.pending(), 0);
+    FakeDevice::detach(ftdi);
+    ftdi_free(ftdi);
+    BOOST_CHECK_EQUAL(fake_usb.live, live);
+}
+
+std::vector<unsigned char> FakeFixture::queued()
+{
+    const unsigned char *buf;
+    int n = ftdi_mpsse_queue_commands(queue, &buf);
+
+    BOOST_REQUIRE(n >= 0);
+    return std::vector<unsigned char>(buf, buf + n);
+}
+
+void FakeFixture::check_queued(const std::vector<unsigned char> &expected)
+{
+    std::vector<unsigned char> actual = queued();
+
+    BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(),
+                                  expected.begin(), expected.end());
+}
+
+extern "C"
+{
+
+int LIBUSB_CALL libusb_bulk_transfer(libusb_device_handle *dev_handle, unsigned char endpoint,
+                                     unsigned char *data, int length, int *actual_length,
+                                     unsigned int timeout)
+{
+    FakeDevice *dev = reinterpret_cast<FakeDevice *>(dev_handle);
+
+    if (endpoint & 0x80)
+    {
+        *actual_length = dev->fill_in(data, length);
+        return 0;
+    }
+    if (dev->out_transfers++ == dev->fail_out_at)
+    {
+        *actual_length = 0;
+        return LIBUSB_ERROR_IO;
+    }
+    dev->written.insert(dev->written.end(), data, data + length);
+    *actual_length = length;
+    return 0;
+}
+
+int LIBUSB_CALL libusb_control_transfer(libusb_device_handle *dev_handle, uint8_t request_type,
+                                        uint8_t bRequest, uint16_t wValue, uint16_t wIndex,
+                                        unsigned char *data, uint16_t wLength, unsigned int timeout)
+{
+    FakeDevice *dev = reinterpret_cast<FakeDevice *>(dev_handle);
+
+    dev->control_requests.push_back(bRequest);
+    if ((request_type & 0x80) && data)
+        memset(data, 0, wLength);
+    return wLength;
+}
+
+struct libusb_transfer * LIBUSB_CALL libusb_alloc_transfer(int iso_packets)
+{
+    struct libusb_transfer *transfer = (struct libusb_transfer *)
+        calloc(1, sizeof(struct libusb_transfer) + iso_packets * sizeof(struct libusb_iso_packet_descriptor));
+
+    if (transfer)
+        fake_usb.live++;
+    return transfer;
+}
+
+void LIBUSB_CALL libusb_free_transfer(struct libusb_transfer *transfer)
+{
+    if (transfer == NULL)
+        return;
+    fake_usb.live--;
+    free(transfer);
+}
+
+int LIBUSB_CALL libusb_submit_transfer(struct libusb_transfer *transfer)
+{
+    if (fake_usb.submits_left == 0)
+        return LIBUSB_ERROR_IO;
+    if (fake_usb.submits_left > 0)
+        fake_usb.submits_left--;
+    for (size_t i = 0; i < pending_transfers.size(); i++)
+        if (pending_transfers[i] == transfer)
+            return LIBUSB_ERROR_BUSY;
+    pending_transfers.push_back(transfer);
+    return 0;
+}
+
+int LIBUSB_CALL libusb_cancel_transfer(struct libusb_transfer *transfer)
+{
+    size_t i;
+
+    for (i = 0; i < pending_transfers.size(); i++)
+        if (pending_transfers[i] == transfer)
+            break;
+    if (i == pending_transfers.size())
+        return LIBUSB_ERROR_NOT_FOUND;
+    if (fake_usb.cancel_fails)
+        return LIBUSB_ERROR_OTHER;
+    cancelled_transfers.insert(transfer);
+    return 0;
+}
+
+int LIBUSB_CALL libusb_handle_events(libusb_context *ctx)
+{
+    return handle_round(true);
+}
+
+int LIBUSB_CALL libusb_handle_events_completed(libusb_context *ctx, int *completed)
+{
+    if (completed && *completed)
+        return 0;
+    return handle_round(true);
+}
+
+int LIBUSB_CALL libusb_handle_events_timeout(libusb_context *ctx, struct timeval *tv)
+{
+    return handle_round(false);
+}
+
+int LIBUSB_CALL libusb_handle_events_timeout_completed(libusb_context *ctx, struct timeval *tv,
+                                                       int *completed)
+{
+    if (completed && *completed)
+        return 0;
+    return handle_round(false);
+}
+
+int LIBUSB_CALL libusb_get_next_timeout(libusb_context *ctx, struct timeval *tv)
+{
+    if (fake_usb.next_timeout <= 0)
+        return fake_usb.next_timeout < 0 ? LIBUSB_ERROR_OTHER : 0;
+    tv->tv_sec = fake_usb.next_timeout / 1000;
+    tv->tv_usec = (fake_usb.next_timeout % 1000) * 1000;
+    return 1;
+}
+
+const struct libusb_pollfd ** LIBUSB_CALL libusb_get_pollfds(libusb_context *ctx)
+{
+    static struct libusb_pollfd pollfd;
+    const struct libusb_pollfd **fds;
+
+    if (fake_usb.poll_fd < 0)
+        return NULL;
+    // released with free() like the real list
+    fds = (const struct libusb_pollfd **)calloc(2, sizeof(*fds));
+    pollfd.fd = fake_usb.poll_fd;
+    pollfd.events = POLLIN;
+    fds[0] = &pollfd;
+    return fds;
+}
+
+void LIBUSB_CALL libusb_set_pollfd_notifiers(libusb_context *ctx, libusb_pollfd_added_cb added_cb,
+                                             libusb_pollfd_removed_cb removed_cb, void *user_data)
+{
+    fake_usb.added_cb = added_cb;
+    fake_usb.removed_cb = removed_cb;
+    fake_usb.notifier_data = user_data;
+}
+
+}
@@ -0,0 +1,123 @@
+/**@file
+@brief Fake libusb transfer layer for tests without hardware
+
+The test binary defines the bulk, control, asynchronous transfer and
+event handling functions of libusb itself, so libftdi talks to
+FakeDevice objects instead of real devices. Asynchronous transfers
+complete in submission order on the next libusb_handle_events*() call.
+
+@author libftdi developers
+*/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation;             *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef FAKE_USB_H
+#define FAKE_USB_H
+
+#include <ftdi.h>
+#include <vector>
+
+/// One FTDI interface behind a fake device handle
+class FakeDevice
+{
+public:
+    explicit FakeDevice(int packet_size = 512);
+
+    /// Make an initialized context use this device, see detach()
+    void attach(struct ftdi_context *ftdi);
+    /// Must be called before ftdi_free() / ftdi_deinit()
+    static void detach(struct ftdi_context *ftdi);
+
+    /// Produce the raw data of one bulk-IN transfer of up to length bytes
+    int fill_in(unsigned char *buf, int length);
+
+    int packet_size;
+    /// Payload bytes of the following IN packets, cycled; empty for full packets.
+    /// A packet shorter than packet_size ends the transfer, like on the bus.
+    std::vector<int> in_plan;
+    size_t in_plan_pos;
+    /// Payload of the following IN packets, pseudo random data afterwards
+    std::vector<unsigned char> in_data;
+    size_t in_data_pos;
+    /// Payload bytes left to send, -1 for no limit; then packets carry status bytes only
+    int in_limit;
+    /// Line status byte of the following IN packets, cycled; empty for 0x60
+    std::vector<unsigned char> lsr_plan;
+    size_t lsr_plan_pos;
+    /// Every payload byte handed out, in order
+    std::vector<unsigned char> sent;
+    /// Every byte received by OUT transfers, in order
+    std::vector<unsigned char> written;
+    /// Number of OUT transfers completed so far
+    int out_transfers;
+    /// Index of the OUT transfer that fails with LIBUSB_TRANSFER_ERROR, -1 for none
+    int fail_out_at;
+    /// Status of the next asynchronous IN completion, which still carries data
+    int next_in_status;
+    /// bRequest of every control transfer
+    std::vector<int> control_requests;
+
+private:
+    unsigned int seed;
+};
+
+/// Knobs and counters of the fake transfer layer
+struct FakeUsb
+{
+    /// Forget all pending transfers and reset the knobs
+    void reset();
+
+    /// Number of further submissions that succeed, -1 for all
+    int submits_left;
+    /// libusb_cancel_transfer() fails and the transfer stays in flight
+    bool cancel_fails;
+    /// Number of libusb_handle_events*() calls that fail before the next one works
+    int event_failures;
+    /// libusb_handle_events*() calls complete nothing, like a device that doesn't answer
+    bool stalled;
+    /// Value of libusb_get_next_timeout(): < 0 for an error, 0 for none, else milliseconds
+    int next_timeout;
+    /// The only file descriptor reported by libusb_get_pollfds(), -1 for an error
+    int poll_fd;
+
+    /// Last arguments of libusb_set_pollfd_notifiers()
+    libusb_pollfd_added_cb added_cb;
+    libusb_pollfd_removed_cb removed_cb;
+    void *notifier_data;
+
+    /// Submitted transfers not completed yet
+    int pending() const;
+    /// Transfers allocated and not freed
+    int live;
+    /// libusb_handle_events*() calls so far
+    int event_rounds;
+};
+
+extern FakeUsb fake_usb;
+
+/// Test fixture: a context talking to a FakeDevice
+struct FakeFixture
+{
+    explicit FakeFixture(int packet_size = 512);
+    /// Checks that no transfer is left pending or allocated
+    ~FakeFixture();
+
+    /// Commands in queue that are not sent yet
+    std::vector<unsigned char> queued();
+    void check_queued(const std::vector<unsigned char> &expected);
+
+    struct ftdi_context *ftdi;
+    FakeDevice dev;
+    /// MPSSE queue of the engine under test, for queued()
+    struct ftdi_mpsse_queue *queue;
+    /// fake_usb.live before the context was created
+    int live;
+};
+
+#endif
@@ -0,0 +1,157 @@
+/**@file
+@brief Test the file sink of the streaming functions
+
+@author libftdi developers
+*/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation;             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <ftdi.h>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+using namespace std;
+
+/// Feed blocks of a counter pattern through the sink and read the file back
+static void check_roundtrip(int direct, const char *dir = "/tmp")
+{
+    string name = string(dir) + "/ftdi_filesink_XXXXXX";
+    vector<char> path(name.begin(), name.end());
+    path.push_back('\0');
+    int fd = mkstemp(&path[0]);
+    BOOST_REQUIRE(fd >= 0);
+    close(fd);
+
+    struct ftdi_file_sink_config config;
+    ftdi_file_sink_config_init(&config);
+    config.buffer_size = 8192;
+    config.num_buffers = 4;
+    config.direct = direct;
+    config.preallocate = 1 << 20;
+
+    // file systems without O_DIRECT fall back to buffered I/O
+    struct ftdi_file_sink *sink = ftdi_file_sink_open(&path[0], &config);
+    BOOST_REQUIRE(sink != NULL);
+
+    // 3.5 buffers in odd sized blocks, small enough to never overflow
+    const int total = 8192 * 3 + 4096;
+    vector<uint8_t> block(510);
+    int sent = 0;
+    unsigned char counter = 0;
+    while (sent < total)
+    {
+        int n = total - sent < (int)block.size() ? total - sent : block.size();
+        for (int i = 0; i < n; i++)
+            block[i] = counter++;
+        BOOST_REQUIRE_EQUAL(ftdi_file_sink_callback(&block[0], n, NULL, sink), 0);
+        sent += n;
+    }
+
+    struct ftdi_file_sink_stats stats;
+    ftdi_file_sink_get_stats(sink, &stats);
+    BOOST_CHECK_EQUAL(stats.bytes_received, (uint64_t)total);
+    BOOST_CHECK_EQUAL(stats.bytes_dropped, 0U);
+    BOOST_CHECK(stats.max_lag >= 4096U);
+    BOOST_CHECK(stats.preallocated == 0 || stats.preallocated == 1 << 20);
+
+    BOOST_REQUIRE_EQUAL(ftdi_file_sink_close(sink), 0);
+
+    FILE *f = fopen(&path[0], "rb");
+    BOOST_REQUIRE(f != NULL);
+    vector<unsigned char> data(total + 1);
+    BOOST_CHECK_EQUAL(fread(&data[0], 1, data.size(), f), (size_t)total);
+    fclose(f);
+    unlink(&path[0]);
+
+    for (int i = 0; i < total; i++)
+        BOOST_REQUIRE_EQUAL(data[i], (unsigned char)i);
+}
+
+BOOST_AUTO_TEST_SUITE(FileSink)
+
+BOOST_AUTO_TEST_CASE(Buffered)
+{
+    check_roundtrip(0);
+}
+
+BOOST_AUTO_TEST_CASE(Direct)
+{
+    check_roundtrip(1);
+}
+
+BOOST_AUTO_TEST_CASE(DirectOnTmpfs)
+{
+    // tmpfs before Linux 6.6 rejects O_DIRECT
+    if (access("/dev/shm", W_OK) != 0)
+        return;
+    check_roundtrip(1, "/dev/shm");
+}
+
+BOOST_AUTO_TEST_CASE(PreallocateTooMuch)
+{
+    char path[] = "/tmp/ftdi_filesink_XXXXXX";
+    int fd = mkstemp(path);
+    BOOST_REQUIRE(fd >= 0);
+    close(fd);
+
+    struct ftdi_file_sink_config config;
+    ftdi_file_sink_config_init(&config);
+    config.buffer_size = 8192;
+    config.preallocate = (uint64_t)1 << 62;
+
+    struct ftdi_file_sink *sink = ftdi_file_sink_open(path, &config);
+    if (sink != NULL)
+    {
+        // the file system cannot preallocate at all
+        struct ftdi_file_sink_stats stats;
+        ftdi_file_sink_get_stats(sink, &stats);
+        BOOST_CHECK_EQUAL(stats.preallocated, 0U);
+        BOOST_CHECK_EQUAL(ftdi_file_sink_close(sink), 0);
+        unlink(path);
+        return;
+    }
+    BOOST_CHECK(errno == ENOSPC || errno == EFBIG);
+    // the file is not left behind
+    BOOST_CHECK(access(path, F_OK) != 0);
+}
+
+BOOST_AUTO_TEST_CASE(WriteErrorStopsWriting)
+{
+    // every write fails with ENOSPC
+    if (access("/dev/full", W_OK) != 0)
+        return;
+
+    struct ftdi_file_sink_config config;
+    ftdi_file_sink_config_init(&config);
+    config.buffer_size = 4096;
+    config.num_buffers = 4;
+
+    struct ftdi_file_sink *sink = ftdi_file_sink_open("/dev/full", &config);
+    BOOST_REQUIRE(sink != NULL);
+
+    vector<uint8_t> block(4096, 0x55);
+    int stopped = 0;
+    for (int i = 0; i < 64; i++)
+        stopped |= ftdi_file_sink_callback(&block[0], block.size(), NULL, sink);
+
+    struct ftdi_file_sink_stats stats;
+    ftdi_file_sink_get_stats(sink, &stats);
+    BOOST_CHECK_EQUAL(stats.bytes_written, 0U);
+    BOOST_CHECK_EQUAL(ftdi_file_sink_close(sink), -ENOSPC);
+    BOOST_CHECK(stopped || stats.bytes_dropped > 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
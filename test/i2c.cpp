@@ -0,0 +1,240 @@
+/**@file
+@brief Test the I2C master against a fake device
+
+@author libftdi developers
+*/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation;             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "fake_usb.h"
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <vector>
+
+using namespace std;
+
+struct I2cFixture : FakeFixture
+{
+    I2cFixture() : i2c(NULL)
+    {
+        ftdi_i2c_config_init(&config);
+    }
+
+    ~I2cFixture()
+    {
+        ftdi_i2c_free(i2c);
+    }
+
+    void open()
+    {
+        i2c = ftdi_i2c_new(ftdi, &config);
+        BOOST_REQUIRE(i2c != NULL);
+        queue = ftdi_i2c_get_queue(i2c);
+        dev.written.clear();
+    }
+
+    // SCL and SDA levels, SDA high is released by making it an input
+    void pins(int scl, int sda, int repeat = 4)
+    {
+        while (repeat-- > 0)
+        {
+            expected.push_back(SET_BITS_LOW);
+            expected.push_back((scl ? 0x01 : 0) | (sda ? 0x02 : 0));
+            expected.push_back(sda ? 0x01 : 0x03);
+        }
+    }
+
+    void start()
+    {
+        pins(1, 1);
+        pins(1, 0);
+        pins(0, 0);
+    }
+
+    void repeated_start()
+    {
+        pins(0, 1);
+        start();
+    }
+
+    void stop()
+    {
+        pins(0, 0);
+        pins(1, 0);
+        pins(1, 1);
+    }
+
+    // a byte sent by the master, then its ACK bit read
+    void put_byte(unsigned char byte)
+    {
+        pins(0, 0, 1);
+        expected.push_back(MPSSE_WRITE_NEG | MPSSE_BITMODE | MPSSE_DO_WRITE);
+        expected.push_back(7);
+        expected.push_back(byte);
+        pins(0, 1, 1);
+        expected.push_back(MPSSE_BITMODE | MPSSE_DO_READ);
+        expected.push_back(0);
+    }
+
+    // a byte read by the master, then its ACK or NACK
+    void get_byte(bool last)
+    {
+        pins(0, 1, 1);
+        expected.push_back(MPSSE_BITMODE | MPSSE_DO_READ);
+        expected.push_back(7);
+        pins(0, 0, 1);
+        expected.push_back(MPSSE_WRITE_NEG | MPSSE_BITMODE | MPSSE_DO_WRITE);
+        expected.push_back(0);
+        expected.push_back(last ? 0xff : 0x00);
+    }
+
+    struct ftdi_i2c_config config;
+    struct ftdi_i2c *i2c;
+    vector<unsigned char> expected;
+};
+
+BOOST_FIXTURE_TEST_SUITE(I2c, I2cFixture)
+
+BOOST_AUTO_TEST_CASE(SetsUpTheChip)
+{
+    i2c = ftdi_i2c_new(ftdi, &config);
+    BOOST_REQUIRE(i2c != NULL);
+    queue = ftdi_i2c_get_queue(i2c);
+
+    // 100 kHz from the 40 MHz three phase base, bus released
+    const unsigned char setup[] =
+    {
+        DIS_ADAPTIVE, LOOPBACK_END,
+        DIS_DIV_5, EN_3_PHASE, TCK_DIVISOR, 199, 0,
+        SET_BITS_LOW, 0x03, 0x01
+    };
+    BOOST_CHECK_EQUAL_COLLECTIONS(dev.written.begin(), dev.written.end(),
+                                  setup, setup + sizeof(setup));
+    BOOST_CHECK(queued().empty());
+}
+
+BOOST_AUTO_TEST_CASE(EncodesWrite)
+{
+    unsigned char data[] = { 0x12, 0x34 };
+    struct ftdi_i2c_msg msg = { 0x50, 0, 2, data };
+
+    open();
+    BOOST_CHECK_EQUAL(ftdi_i2c_queue(i2c, &msg, 1), 0);
+
+    start();
+    put_byte(0x50 << 1);
+    put_byte(0x12);
+    put_byte(0x34);
+    stop();
+    check_queued(expected);
+    BOOST_CHECK_EQUAL(ftdi_mpsse_queue_reply_length(ftdi_i2c_get_queue(i2c)), 3);
+}
+
+BOOST_AUTO_TEST_CASE(EncodesRepeatedStartRead)
+{
+    unsigned char reg = 0x10, data[2];
+    struct ftdi_i2c_msg msgs[] =
+    {
+        { 0x50, 0, 1, &reg },
+        { 0x50, FTDI_I2C_READ, 2, data }
+    };
+
+    open();
+    BOOST_CHECK_EQUAL(ftdi_i2c_queue(i2c, msgs, 2), 0);
+
+    // the last byte read is not acknowledged by the master
+    start();
+    put_byte(0x50 << 1);
+    put_byte(0x10);
+    repeated_start();
+    put_byte((0x50 << 1) | 1);
+    get_byte(false);
+    get_byte(true);
+    stop();
+    check_queued(expected);
+    BOOST_CHECK_EQUAL(ftdi_mpsse_queue_reply_length(ftdi_i2c_get_queue(i2c)), 5);
+}
+
+BOOST_AUTO_TEST_CASE(ReportsNackPositions)
+{
+    unsigned char reg = 0x10, data[2], write[] = { 0xaa, 0xbb, 0xcc };
+    struct ftdi_i2c_msg first[] =
+    {
+        { 0x50, 0, 1, &reg },
+        { 0x50, FTDI_I2C_READ, 2, data }
+    };
+    struct ftdi_i2c_msg second = { 0x21, 0, 3, write };
+    struct ftdi_i2c_msg third = { 0x22, 0, 0, NULL };
+    int msg = -2, byte = -2;
+
+    open();
+    BOOST_CHECK_EQUAL(ftdi_i2c_queue(i2c, first, 2), 0);
+    BOOST_CHECK_EQUAL(ftdi_i2c_queue(i2c, &second, 1), 1);
+    BOOST_CHECK_EQUAL(ftdi_i2c_queue(i2c, &third, 1), 2);
+    BOOST_CHECK_EQUAL(ftdi_i2c_get_nack(i2c, 0, &msg, &byte), -1);
+
+    // reply bytes in command order, ACK bits are bit 0
+    const unsigned char reply[] =
+    {
+        0x00, 0x00, 0x00, 0x5a, 0xa5,   // first: ACKs, then the data read
+        0xfe, 0x00, 0x01, 0x01,         // second: NACK on byte 1 and 2
+        0x01                            // third: address NACK
+    };
+    dev.in_data.assign(reply, reply + sizeof(reply));
+    BOOST_CHECK_EQUAL(ftdi_i2c_flush(i2c), 0);
+
+    BOOST_CHECK_EQUAL(ftdi_i2c_get_nack(i2c, 0, &msg, &byte), 0);
+    BOOST_CHECK_EQUAL(data[0], 0x5a);
+    BOOST_CHECK_EQUAL(data[1], 0xa5);
+    BOOST_CHECK_EQUAL(ftdi_i2c_get_nack(i2c, 1, &msg, &byte), 1);
+    BOOST_CHECK_EQUAL(msg, 0);
+    BOOST_CHECK_EQUAL(byte, 1);
+    BOOST_CHECK_EQUAL(ftdi_i2c_get_nack(i2c, 2, &msg, &byte), 1);
+    BOOST_CHECK_EQUAL(msg, 0);
+    BOOST_CHECK_EQUAL(byte, -1);
+    BOOST_CHECK_EQUAL(ftdi_i2c_get_nack(i2c, 3, &msg, &byte), -1);
+
+    // the next transaction starts a new batch
+    BOOST_CHECK_EQUAL(ftdi_i2c_queue(i2c, &third, 1), 0);
+    BOOST_CHECK_EQUAL(ftdi_i2c_get_nack(i2c, 0, &msg, &byte), -1);
+}
+
+BOOST_AUTO_TEST_CASE(AckSlotsSpanBlocks)
+{
+    vector<unsigned char> data(600, 0x42);
+    struct ftdi_i2c_msg msg = { 0x50, 0, (int)data.size(), &data[0] };
+    int m = -2, byte = -2;
+
+    open();
+    BOOST_CHECK_EQUAL(ftdi_i2c_queue(i2c, &msg, 1), 0);
+    // one ACK per byte plus the address, the NACK lands in the third block
+    dev.in_data.assign(data.size() + 1, 0x00);
+    dev.in_data[1 + 555] = 0x01;
+    BOOST_CHECK_EQUAL(ftdi_i2c_flush(i2c), 0);
+    BOOST_CHECK_EQUAL(ftdi_i2c_get_nack(i2c, 0, &m, &byte), 1);
+    BOOST_CHECK_EQUAL(m, 0);
+    BOOST_CHECK_EQUAL(byte, 555);
+}
+
+BOOST_AUTO_TEST_CASE(RejectsInvalid)
+{
+    unsigned char data = 0;
+    struct ftdi_i2c_msg bad_addr = { 0x80, 0, 1, &data };
+    struct ftdi_i2c_msg no_buf = { 0x50, 0, 1, NULL };
+
+    open();
+    BOOST_CHECK(ftdi_i2c_get_queue(NULL) == NULL);
+    BOOST_CHECK_EQUAL(ftdi_i2c_queue(i2c, &bad_addr, 1), -1);
+    BOOST_CHECK_EQUAL(ftdi_i2c_queue(i2c, &no_buf, 1), -1);
+    BOOST_CHECK_EQUAL(ftdi_i2c_queue(i2c, &bad_addr, 0), -1);
+    BOOST_CHECK(queued().empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,61 @@
+/**@file
+@brief Test the JTAG TAP state tracking
+
+@author libftdi developers
+*/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation;             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <ftdi.h>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(Jtag)
+
+BOOST_AUTO_TEST_CASE(KnownPaths)
+{
+    unsigned char tms;
+
+    BOOST_CHECK_EQUAL(ftdi_jtag_tms_path(FTDI_JTAG_RESET, FTDI_JTAG_IDLE, &tms), 1);
+    BOOST_CHECK_EQUAL(tms, 0x00);
+    BOOST_CHECK_EQUAL(ftdi_jtag_tms_path(FTDI_JTAG_IDLE, FTDI_JTAG_DRSHIFT, &tms), 3);
+    BOOST_CHECK_EQUAL(tms, 0x01);
+    BOOST_CHECK_EQUAL(ftdi_jtag_tms_path(FTDI_JTAG_IDLE, FTDI_JTAG_IRSHIFT, &tms), 4);
+    BOOST_CHECK_EQUAL(tms, 0x03);
+    BOOST_CHECK_EQUAL(ftdi_jtag_tms_path(FTDI_JTAG_DREXIT1, FTDI_JTAG_IDLE, &tms), 2);
+    BOOST_CHECK_EQUAL(tms, 0x01);
+    BOOST_CHECK_EQUAL(ftdi_jtag_tms_path(FTDI_JTAG_IRPAUSE, FTDI_JTAG_IRPAUSE, &tms), 0);
+    BOOST_CHECK_EQUAL(ftdi_jtag_tms_path(FTDI_JTAG_IDLE, 16, &tms), -1);
+}
+
+BOOST_AUTO_TEST_CASE(AllPathsReachTarget)
+{
+    for (int from = FTDI_JTAG_RESET; from <= FTDI_JTAG_IRUPDATE; from++)
+    {
+        for (int to = FTDI_JTAG_RESET; to <= FTDI_JTAG_IRUPDATE; to++)
+        {
+            unsigned char tms;
+            int bits = ftdi_jtag_tms_path(from, to, &tms);
+            int state = from;
+
+            BOOST_REQUIRE(bits >= 0 && bits <= 8);
+            for (int i = 0; i < bits; i++)
+                state = ftdi_jtag_next_state(state, (tms >> i) & 1);
+            BOOST_CHECK_EQUAL(state, to);
+        }
+        /* five cycles with TMS high reset from anywhere */
+        int state = from;
+        for (int i = 0; i < 5; i++)
+            state = ftdi_jtag_next_state(state, 1);
+        BOOST_CHECK_EQUAL(state, FTDI_JTAG_RESET);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,218 @@
+/**@file
+@brief Test JTAG scans against a fake device
+
+@author libftdi developers
+*/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation;             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "fake_usb.h"
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// opcodes of the shifts a JTAG scan queues
+#define SHIFT_BYTES (MPSSE_LSB | MPSSE_WRITE_NEG)
+#define SHIFT_BITS (MPSSE_LSB | MPSSE_WRITE_NEG | MPSSE_BITMODE)
+#define TMS_BITS (MPSSE_WRITE_TMS | MPSSE_LSB | MPSSE_WRITE_NEG | MPSSE_BITMODE)
+
+struct JtagFixture : FakeFixture
+{
+    JtagFixture() : jtag(NULL)
+    {
+        ftdi_jtag_config_init(&config);
+    }
+
+    ~JtagFixture()
+    {
+        ftdi_jtag_free(jtag);
+    }
+
+    void open()
+    {
+        jtag = ftdi_jtag_new(ftdi, &config);
+        BOOST_REQUIRE(jtag != NULL);
+        BOOST_REQUIRE_EQUAL(ftdi_jtag_get_state(jtag), FTDI_JTAG_IDLE);
+        queue = ftdi_jtag_get_queue(jtag);
+        dev.written.clear();
+    }
+
+    void push(unsigned char a, unsigned char b)
+    {
+        expected.push_back(a);
+        expected.push_back(b);
+    }
+
+    void push(unsigned char a, unsigned char b, unsigned char c)
+    {
+        push(a, b);
+        expected.push_back(c);
+    }
+
+    struct ftdi_jtag_config config;
+    struct ftdi_jtag *jtag;
+    vector<unsigned char> expected;
+};
+
+BOOST_FIXTURE_TEST_SUITE(JtagScan, JtagFixture)
+
+BOOST_AUTO_TEST_CASE(SetsUpTheChip)
+{
+    jtag = ftdi_jtag_new(ftdi, &config);
+    BOOST_REQUIRE(jtag != NULL);
+
+    // TCK, TDI and TMS outputs, five TMS high cycles, then Run-Test/Idle
+    push(DIS_ADAPTIVE, DIS_DIV_5, DIS_3_PHASE);
+    expected.push_back(LOOPBACK_END);
+    push(TCK_DIVISOR, 0, 0);
+    push(SET_BITS_LOW, 0x08, 0x0b);
+    push(TMS_BITS, 4, 0x1f);
+    push(TMS_BITS, 0, 0x00);
+    BOOST_CHECK_EQUAL_COLLECTIONS(dev.written.begin(), dev.written.end(),
+                                  expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(SetsUpTheClock)
+{
+    config.frequency = 5000000;
+    jtag = ftdi_jtag_new(ftdi, &config);
+    BOOST_REQUIRE(jtag != NULL);
+
+    // the clock commands alone pick the prescaler and clocking
+    push(DIS_ADAPTIVE, LOOPBACK_END);
+    push(DIS_DIV_5, DIS_3_PHASE);
+    push(TCK_DIVISOR, 5, 0);
+    push(SET_BITS_LOW, 0x08, 0x0b);
+    push(TMS_BITS, 4, 0x1f);
+    push(TMS_BITS, 0, 0x00);
+    BOOST_CHECK_EQUAL_COLLECTIONS(dev.written.begin(), dev.written.end(),
+                                  expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(NoClockWithoutMpsse)
+{
+    ftdi->type = TYPE_R;
+    config.frequency = 1000000;
+    BOOST_CHECK(ftdi_jtag_new(ftdi, &config) == NULL);
+    BOOST_CHECK_EQUAL(string(ftdi_get_error_string(ftdi)), "JTAG clock needs an MPSSE capable chip");
+}
+
+BOOST_AUTO_TEST_CASE(EncodesScan)
+{
+    const unsigned char out[] = { 0xa5, 0x0c };
+    unsigned char in[2] = { 0, 0 };
+
+    open();
+    BOOST_CHECK_EQUAL(ftdi_jtag_scan_dr(jtag, 12, out, in, FTDI_JTAG_IDLE), 0);
+    BOOST_CHECK_EQUAL(ftdi_jtag_get_state(jtag), FTDI_JTAG_IDLE);
+
+    // Select-DR, Capture-DR, Shift-DR
+    push(TMS_BITS, 2, 0x01);
+    push(SHIFT_BYTES | MPSSE_DO_WRITE | MPSSE_DO_READ, 0, 0);
+    expected.push_back(0xa5);
+    push(SHIFT_BITS | MPSSE_DO_WRITE | MPSSE_DO_READ, 2, 0x0c);
+    // the last bit with TMS high, TDI carries bit 11
+    push(TMS_BITS | MPSSE_DO_READ, 0, 0x81);
+    // Update-DR, Run-Test/Idle
+    push(TMS_BITS, 1, 0x01);
+    check_queued(expected);
+    BOOST_CHECK_EQUAL(ftdi_mpsse_queue_reply_length(ftdi_jtag_get_queue(jtag)), 3);
+}
+
+BOOST_AUTO_TEST_CASE(PlacesCapturedBits)
+{
+    const unsigned char out[] = { 0xa5, 0x0c };
+    unsigned char in[2] = { 0, 0xf0 };
+
+    open();
+    BOOST_CHECK_EQUAL(ftdi_jtag_scan_dr(jtag, 12, out, in, FTDI_JTAG_IDLE), 0);
+
+    // bit shifts return their bits at the top, TMS commands in bit 7
+    const unsigned char reply[] = { 0x5a, 0xbf, 0x80 };
+    dev.in_data.assign(reply, reply + sizeof(reply));
+    BOOST_CHECK_EQUAL(ftdi_jtag_flush(jtag), 0);
+    BOOST_CHECK_EQUAL(in[0], 0x5a);
+    // bits 0-2 from 0xbf, bit 3 from the TMS read, the rest untouched
+    BOOST_CHECK_EQUAL(in[1], 0xfd);
+}
+
+BOOST_AUTO_TEST_CASE(FixupsKeepOtherBits)
+{
+    unsigned char in = 0xff;
+
+    open();
+    BOOST_CHECK_EQUAL(ftdi_jtag_scan_ir(jtag, 5, NULL, &in, FTDI_JTAG_IRPAUSE), 0);
+    BOOST_CHECK_EQUAL(ftdi_jtag_get_state(jtag), FTDI_JTAG_IRPAUSE);
+
+    // 4 bits read as 0011, then a 0 with noise below bit 7
+    const unsigned char reply[] = { 0x3f, 0x7f };
+    dev.in_data.assign(reply, reply + sizeof(reply));
+    BOOST_CHECK_EQUAL(ftdi_jtag_flush(jtag), 0);
+    BOOST_CHECK_EQUAL(in, 0xe3);
+}
+
+BOOST_AUTO_TEST_CASE(FixupsSpanBlocks)
+{
+    vector<unsigned char> in(300, 0x55);
+
+    open();
+    for (size_t i = 0; i < in.size(); i++)
+        BOOST_REQUIRE_EQUAL(ftdi_jtag_scan_dr(jtag, 1, NULL, &in[i], FTDI_JTAG_IDLE), 0);
+    BOOST_CHECK_EQUAL(ftdi_mpsse_queue_reply_length(ftdi_jtag_get_queue(jtag)), 300);
+
+    for (size_t i = 0; i < in.size(); i++)
+        dev.in_data.push_back(i % 3 ? 0x00 : 0x80);
+    BOOST_CHECK_EQUAL(ftdi_jtag_flush(jtag), 0);
+    for (size_t i = 0; i < in.size(); i++)
+        BOOST_CHECK_EQUAL(in[i], (i % 3 ? 0x54 : 0x55));
+}
+
+BOOST_AUTO_TEST_CASE(SendsZerosWithoutData)
+{
+    unsigned char in[3];
+
+    open();
+    BOOST_CHECK_EQUAL(ftdi_jtag_scan_ir(jtag, 20, NULL, NULL, FTDI_JTAG_IDLE), 0);
+    BOOST_CHECK_EQUAL(ftdi_jtag_scan_ir(jtag, 20, NULL, in, FTDI_JTAG_IDLE), 0);
+
+    // Select-DR, Select-IR, Capture-IR, Shift-IR
+    push(TMS_BITS, 3, 0x03);
+    push(SHIFT_BYTES | MPSSE_DO_WRITE, 1, 0);
+    push(0, 0);
+    push(SHIFT_BITS | MPSSE_DO_WRITE, 2, 0);
+    push(TMS_BITS, 0, 0x01);
+    push(TMS_BITS, 1, 0x01);
+    // when capturing, the byte shift only reads and TDI stays low
+    push(TMS_BITS, 3, 0x03);
+    push(SHIFT_BYTES | MPSSE_DO_READ, 1, 0);
+    push(SHIFT_BITS | MPSSE_DO_WRITE | MPSSE_DO_READ, 2, 0);
+    push(TMS_BITS | MPSSE_DO_READ, 0, 0x01);
+    push(TMS_BITS, 1, 0x01);
+    check_queued(expected);
+}
+
+BOOST_AUTO_TEST_CASE(RejectsInvalid)
+{
+    unsigned char out = 0;
+
+    open();
+    BOOST_CHECK_EQUAL(ftdi_jtag_get_state(NULL), -1);
+    BOOST_CHECK(ftdi_jtag_get_queue(NULL) == NULL);
+    BOOST_CHECK_EQUAL(ftdi_jtag_scan_dr(NULL, 8, &out, NULL, FTDI_JTAG_IDLE), -1);
+    BOOST_CHECK_EQUAL(ftdi_jtag_scan_dr(jtag, 0, &out, NULL, FTDI_JTAG_IDLE), -1);
+    BOOST_CHECK_EQUAL(ftdi_jtag_scan_dr(jtag, 8, &out, NULL, FTDI_JTAG_DRSHIFT), -1);
+    BOOST_CHECK_EQUAL(ftdi_jtag_get_state(jtag), FTDI_JTAG_IDLE);
+    check_queued(expected);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,206 @@
+/**@file
+@brief Test the MPSSE command queue and clock planner
+
+@author libftdi developers
+*/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation;             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <ftdi.h>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <vector>
+
+using namespace std;
+
+class QueueFixture
+{
+public:
+    QueueFixture()
+        : ftdi(ftdi_new()), queue(ftdi_mpsse_queue_new(ftdi))
+    {
+        BOOST_REQUIRE(queue != NULL);
+    }
+
+    ~QueueFixture()
+    {
+        ftdi_mpsse_queue_free(queue);
+        ftdi_free(ftdi);
+    }
+
+    vector<unsigned char> commands()
+    {
+        const unsigned char *buf;
+        int n = ftdi_mpsse_queue_commands(queue, &buf);
+        return vector<unsigned char>(buf, buf + n);
+    }
+
+    struct ftdi_context *ftdi;
+    struct ftdi_mpsse_queue *queue;
+};
+
+BOOST_FIXTURE_TEST_SUITE(MpsseQueue, QueueFixture)
+
+BOOST_AUTO_TEST_CASE(EncodesCommands)
+{
+    unsigned char pins, bits, out = 0xa5;
+
+    BOOST_CHECK_EQUAL(ftdi_mpsse_set_bits_low(queue, 0x08, 0x0b), 0);
+    BOOST_CHECK_EQUAL(ftdi_mpsse_set_divisor(queue, 0x1234), 0);
+    BOOST_CHECK_EQUAL(ftdi_mpsse_get_bits_high(queue, &pins), 0);
+    BOOST_CHECK_EQUAL(ftdi_mpsse_shift_bits(queue, MPSSE_WRITE_NEG, &out, &bits, 3), 0);
+    BOOST_CHECK_EQUAL(ftdi_mpsse_write_tms(queue, MPSSE_WRITE_NEG, 0x03, 5, 1, NULL), 0);
+
+    const unsigned char expected[] =
+    {
+        SET_BITS_LOW, 0x08, 0x0b,
+        TCK_DIVISOR, 0x34, 0x12,
+        GET_BITS_HIGH,
+        MPSSE_WRITE_NEG | MPSSE_BITMODE | MPSSE_DO_WRITE | MPSSE_DO_READ, 2, 0xa5,
+        MPSSE_WRITE_NEG | MPSSE_WRITE_TMS | MPSSE_BITMODE | MPSSE_LSB, 4, 0x83
+    };
+    vector<unsigned char> queued = commands();
+    BOOST_CHECK_EQUAL_COLLECTIONS(queued.begin(), queued.end(),
+                                  expected, expected + sizeof(expected));
+    BOOST_CHECK_EQUAL(ftdi_mpsse_queue_reply_length(queue), 2);
+
+    ftdi_mpsse_queue_clear(queue);
+    BOOST_CHECK(commands().empty());
+    BOOST_CHECK_EQUAL(ftdi_mpsse_queue_reply_length(queue), 0);
+}
+
+BOOST_AUTO_TEST_CASE(SplitsLongShifts)
+{
+    const int length = 65536 + 100;
+    vector<unsigned char> out(length), in(length);
+
+    BOOST_CHECK_EQUAL(ftdi_mpsse_shift_bytes(queue, 0, &out[0], &in[0], length), 0);
+    vector<unsigned char> queued = commands();
+    BOOST_REQUIRE_EQUAL(queued.size(), (size_t)(length + 6));
+    BOOST_CHECK_EQUAL(queued[0], MPSSE_DO_WRITE | MPSSE_DO_READ);
+    BOOST_CHECK_EQUAL(queued[1], 0xff);
+    BOOST_CHECK_EQUAL(queued[2], 0xff);
+    BOOST_CHECK_EQUAL(queued[3 + 65536], MPSSE_DO_WRITE | MPSSE_DO_READ);
+    BOOST_CHECK_EQUAL(queued[4 + 65536], 99);
+    BOOST_CHECK_EQUAL(queued[5 + 65536], 0);
+    BOOST_CHECK_EQUAL(ftdi_mpsse_queue_reply_length(queue), length);
+
+    // read only shifts carry no data
+    ftdi_mpsse_queue_clear(queue);
+    BOOST_CHECK_EQUAL(ftdi_mpsse_shift_bytes(queue, MPSSE_LSB, NULL, &in[0], 10), 0);
+    BOOST_CHECK_EQUAL(commands().size(), 3U);
+}
+
+BOOST_AUTO_TEST_CASE(RejectsInvalid)
+{
+    unsigned char out = 0;
+
+    BOOST_CHECK_EQUAL(ftdi_mpsse_shift_bytes(queue, 0, NULL, NULL, 1), -1);
+    BOOST_CHECK_EQUAL(ftdi_mpsse_shift_bytes(queue, MPSSE_DO_READ, &out, NULL, 1), -1);
+    BOOST_CHECK_EQUAL(ftdi_mpsse_shift_bits(queue, 0, &out, NULL, 9), -1);
+    BOOST_CHECK_EQUAL(ftdi_mpsse_write_tms(queue, 0, 0, 8, 0, NULL), -1);
+    BOOST_CHECK(commands().empty());
+
+    const unsigned char *buf;
+    BOOST_CHECK_EQUAL(ftdi_mpsse_queue_commands(NULL, &buf), -1);
+    BOOST_CHECK_EQUAL(ftdi_mpsse_queue_commands(queue, NULL), -1);
+    BOOST_CHECK_EQUAL(ftdi_mpsse_queue_reply_length(NULL), -1);
+    ftdi_mpsse_queue_clear(NULL);
+
+    // no device opened
+    BOOST_CHECK_EQUAL(ftdi_mpsse_set_bits_low(queue, 0, 0), 0);
+    BOOST_CHECK_EQUAL(ftdi_mpsse_queue_flush(queue), -666);
+}
+
+BOOST_AUTO_TEST_CASE(QueuesClock)
+{
+    struct ftdi_mpsse_clock clock;
+    const unsigned char expected[] = { DIS_DIV_5, DIS_3_PHASE, TCK_DIVISOR, 0x04, 0x00 };
+
+    ftdi->type = TYPE_2232H;
+    BOOST_CHECK_EQUAL(ftdi_mpsse_set_clock(queue, 6000000, 0, &clock), 0);
+    BOOST_CHECK_EQUAL(clock.frequency, 6000000.0);
+    vector<unsigned char> queued = commands();
+    BOOST_CHECK_EQUAL_COLLECTIONS(queued.begin(), queued.end(), expected, expected + sizeof(expected));
+
+    ftdi->type = TYPE_R;
+    ftdi_mpsse_queue_clear(queue);
+    BOOST_CHECK_EQUAL(ftdi_mpsse_set_clock(queue, 6000000, 0, &clock), -2);
+    BOOST_CHECK(commands().empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(MpsseClock)
+
+BOOST_AUTO_TEST_CASE(HTypeFastestNotAbove)
+{
+    struct ftdi_mpsse_clock clock;
+
+    BOOST_CHECK_EQUAL(ftdi_mpsse_plan_clock(TYPE_232H, 30000000, 0, &clock), 0);
+    BOOST_CHECK_EQUAL(clock.divisor, 0);
+    BOOST_CHECK_EQUAL(clock.div5, 0);
+    BOOST_CHECK_EQUAL(clock.frequency, 30000000.0);
+
+    // above the maximum gives the maximum
+    BOOST_CHECK_EQUAL(ftdi_mpsse_plan_clock(TYPE_232H, 50000000, 0, &clock), 0);
+    BOOST_CHECK_EQUAL(clock.frequency, 30000000.0);
+
+    // 7 MHz is not possible, 6 MHz is the next one below
+    BOOST_CHECK_EQUAL(ftdi_mpsse_plan_clock(TYPE_2232H, 7000000, 0, &clock), 0);
+    BOOST_CHECK_EQUAL(clock.divisor, 4);
+    BOOST_CHECK_EQUAL(clock.frequency, 6000000.0);
+
+    BOOST_CHECK_EQUAL(ftdi_mpsse_plan_clock(TYPE_4232H, 100000, 1, &clock), 0);
+    BOOST_CHECK_EQUAL(clock.divisor, 199);
+    BOOST_CHECK_EQUAL(clock.three_phase, 1);
+    BOOST_CHECK_EQUAL(clock.frequency, 100000.0);
+    BOOST_CHECK_EQUAL(clock.num_commands, 5);
+    BOOST_CHECK_EQUAL(clock.commands[0], DIS_DIV_5);
+    BOOST_CHECK_EQUAL(clock.commands[1], EN_3_PHASE);
+    BOOST_CHECK_EQUAL(clock.commands[2], TCK_DIVISOR);
+    BOOST_CHECK_EQUAL(clock.commands[3], 199);
+    BOOST_CHECK_EQUAL(clock.commands[4], 0);
+}
+
+BOOST_AUTO_TEST_CASE(SlowClocksUseDivideBy5)
+{
+    struct ftdi_mpsse_clock clock;
+
+    BOOST_CHECK_EQUAL(ftdi_mpsse_plan_clock(TYPE_2232H, 100, 0, &clock), 0);
+    BOOST_CHECK_EQUAL(clock.div5, 1);
+    BOOST_CHECK_EQUAL(clock.divisor, 59999);
+    BOOST_CHECK_EQUAL(clock.frequency, 100.0);
+    BOOST_CHECK_EQUAL(clock.commands[0], EN_DIV_5);
+
+    // below the slowest clock
+    BOOST_CHECK_EQUAL(ftdi_mpsse_plan_clock(TYPE_232H, 1, 0, &clock), 0);
+    BOOST_CHECK_EQUAL(clock.divisor, 0xffff);
+    BOOST_CHECK_CLOSE(clock.frequency, 12000000.0 / 131072, 1e-9);
+}
+
+BOOST_AUTO_TEST_CASE(OlderChips)
+{
+    struct ftdi_mpsse_clock clock;
+
+    // 12 MHz base only, no three phase and no prescaler commands
+    BOOST_CHECK_EQUAL(ftdi_mpsse_plan_clock(TYPE_2232C, 1000000, 1, &clock), 0);
+    BOOST_CHECK_EQUAL(clock.divisor, 5);
+    BOOST_CHECK_EQUAL(clock.three_phase, 0);
+    BOOST_CHECK_EQUAL(clock.div5, 0);
+    BOOST_CHECK_EQUAL(clock.frequency, 1000000.0);
+    BOOST_CHECK_EQUAL(clock.num_commands, 3);
+    BOOST_CHECK_EQUAL(clock.commands[0], TCK_DIVISOR);
+
+    BOOST_CHECK_EQUAL(ftdi_mpsse_plan_clock(TYPE_R, 1000000, 0, &clock), -2);
+    BOOST_CHECK_EQUAL(ftdi_mpsse_plan_clock(TYPE_2232H, 0, 0, &clock), -1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
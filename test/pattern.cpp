@@ -0,0 +1,90 @@
+/**@file
+@brief Test the test pattern checker of the streaming functions
+
+@author libftdi developers
+*/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation;             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <ftdi.h>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <vector>
+
+using namespace std;
+
+/// Check a filled stream in odd sized pieces, optionally with a hole
+static struct ftdi_pattern_stats check_stream(int pattern, int hole_at, int hole_size)
+{
+    const int total = 40000;
+    vector<uint8_t> data(total);
+    uint32_t value = (pattern == FTDI_PATTERN_LFSR) ? 0x5a : 0xfff0;
+    BOOST_REQUIRE_EQUAL(ftdi_pattern_fill(pattern, &data[0], total, &value), 0);
+    if (hole_size)
+        data.erase(data.begin() + hole_at, data.begin() + hole_at + hole_size);
+
+    struct ftdi_pattern_checker *checker = ftdi_pattern_checker_new(pattern);
+    BOOST_REQUIRE(checker != NULL);
+    size_t pos = 0, piece = 1;
+    while (pos < data.size())
+    {
+        size_t n = min(piece, data.size() - pos);
+        ftdi_pattern_check(checker, &data[pos], n);
+        pos += n;
+        piece = piece * 7 % 1021 + 1;
+    }
+
+    struct ftdi_pattern_stats stats;
+    ftdi_pattern_get_stats(checker, &stats);
+    ftdi_pattern_checker_free(checker);
+    BOOST_CHECK_EQUAL(stats.bytes, (uint64_t)data.size());
+    return stats;
+}
+
+BOOST_AUTO_TEST_SUITE(Pattern)
+
+BOOST_AUTO_TEST_CASE(CleanStreams)
+{
+    for (int pattern = FTDI_PATTERN_COUNT8; pattern <= FTDI_PATTERN_LFSR; pattern++)
+    {
+        struct ftdi_pattern_stats stats = check_stream(pattern, 0, 0);
+        BOOST_CHECK_EQUAL(stats.errors, 0U);
+        BOOST_CHECK_EQUAL(stats.first_error, -1);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(LostBlockIsOneError)
+{
+    for (int pattern = FTDI_PATTERN_COUNT8; pattern <= FTDI_PATTERN_LFSR; pattern++)
+    {
+        // 508 bytes are a whole number of words and not a period of the byte patterns
+        struct ftdi_pattern_stats stats = check_stream(pattern, 12000, 508);
+        BOOST_CHECK_EQUAL(stats.errors, 1U);
+        BOOST_CHECK_EQUAL(stats.first_error, 12000);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(LfsrPeriod)
+{
+    uint8_t value = 1;
+    int period = 0;
+    do
+    {
+        value = ftdi_pattern_next_byte(FTDI_PATTERN_LFSR, value);
+        period++;
+        BOOST_REQUIRE(value != 0);
+    }
+    while (value != 1);
+    BOOST_CHECK_EQUAL(period, 255);
+
+    BOOST_CHECK(ftdi_pattern_checker_new(FTDI_PATTERN_NONE) == NULL);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,149 @@
+/**@file
+@brief Test the progress and rolling window rate helpers of the stream engine
+
+@author libftdi developers
+*/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation;             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <ftdi.h>
+#include <ftdi_i.h>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <cstring>
+
+static struct timeval at(double seconds)
+{
+    struct timeval tv;
+
+    tv.tv_sec = (time_t)seconds;
+    tv.tv_usec = (suseconds_t)((seconds - tv.tv_sec) * 1e6 + 0.5);
+    return tv;
+}
+
+struct RateFixture
+{
+    RateFixture()
+    {
+        memset(&w, 0, sizeof(w));
+        memset(&progress, 0, sizeof(progress));
+    }
+
+    // bytes arrive at a constant rate, sampled every step seconds
+    void feed(double from, double to, double step, double rate)
+    {
+        for (double t = from; t <= to + 1e-9; t += step)
+        {
+            struct timeval now = at(t);
+
+            progress.current.totalBytes = (uint64_t)(rate * t);
+            ftdi_stream_sample_rate(&w, &progress, &now, 0.1);
+        }
+    }
+
+    FTDIRateWindow w;
+    FTDIProgressInfo progress;
+};
+
+BOOST_FIXTURE_TEST_SUITE(RateWindow, RateFixture)
+
+BOOST_AUTO_TEST_CASE(EmptyWindow)
+{
+    struct timeval now = at(5);
+
+    BOOST_CHECK_EQUAL(ftdi_stream_window_rate(&w, &progress, &now, 0.1), 0.0);
+}
+
+BOOST_AUTO_TEST_CASE(SamplesAreSpreadOverTheWindow)
+{
+    struct timeval now = at(1);
+
+    // samples closer than window / FTDI_STREAM_RATE_SAMPLES are dropped
+    ftdi_stream_sample_rate(&w, &progress, &now, 0.1);
+    ftdi_stream_sample_rate(&w, &progress, &now, 0.1);
+    BOOST_CHECK_EQUAL(w.count, 1);
+
+    now = at(1.001);
+    ftdi_stream_sample_rate(&w, &progress, &now, 0.1);
+    BOOST_CHECK_EQUAL(w.count, 1);
+
+    now = at(1.007);
+    ftdi_stream_sample_rate(&w, &progress, &now, 0.1);
+    BOOST_CHECK_EQUAL(w.count, 2);
+}
+
+BOOST_AUTO_TEST_CASE(ConstantRate)
+{
+    feed(10, 11, 0.01, 1e6);
+
+    struct timeval now = at(11);
+    BOOST_CHECK_EQUAL(w.count, FTDI_STREAM_RATE_SAMPLES);
+    BOOST_CHECK_CLOSE(ftdi_stream_window_rate(&w, &progress, &now, 0.1), 1e6, 1);
+}
+
+BOOST_AUTO_TEST_CASE(FollowsRateChange)
+{
+    // 1 MB/s for a second, then 4 MB/s: the window only sees the latter
+    feed(10, 11, 0.01, 1e6);
+    for (double t = 11.01; t <= 11.5; t += 0.01)
+    {
+        struct timeval now = at(t);
+
+        progress.current.totalBytes += 40000;
+        ftdi_stream_sample_rate(&w, &progress, &now, 0.1);
+    }
+
+    struct timeval now = at(11.5);
+    BOOST_CHECK_CLOSE(ftdi_stream_window_rate(&w, &progress, &now, 0.1), 4e6, 2);
+}
+
+BOOST_AUTO_TEST_CASE(StaleSamplesUseNewest)
+{
+    // all samples older than the window: rate since the newest one
+    feed(10, 10.2, 0.01, 1e6);
+    progress.current.totalBytes += 500000;
+
+    struct timeval now = at(11.2);
+    BOOST_CHECK_CLOSE(ftdi_stream_window_rate(&w, &progress, &now, 0.1), 5e5, 1);
+}
+
+BOOST_AUTO_TEST_CASE(UpdateProgress)
+{
+    progress.first.time = at(100);
+    progress.prev.totalBytes = 1000000;
+    progress.prev.time = at(101);
+    feed(101, 102, 0.01, 0);
+    progress.current.totalBytes = 3000000;
+
+    struct timeval now = at(102);
+    ftdi_stream_update_progress(&progress, &w, &now, 0.1);
+
+    BOOST_CHECK_EQUAL(progress.current.time.tv_sec, 102);
+    BOOST_CHECK_CLOSE(progress.totalTime, 2.0, 1e-6);
+    BOOST_CHECK_CLOSE(progress.totalRate, 1.5e6, 1e-6);
+    BOOST_CHECK_CLOSE(progress.currentRate, 2e6, 1e-6);
+    BOOST_CHECK(progress.windowRate > 0);
+}
+
+BOOST_AUTO_TEST_CASE(FirstReportHasNoRates)
+{
+    progress.first.time = at(100);
+    progress.current.totalBytes = 1000;
+
+    struct timeval now = at(101);
+    ftdi_stream_update_progress(&progress, &w, &now, 0.1);
+
+    BOOST_CHECK_CLOSE(progress.totalTime, 1.0, 1e-6);
+    BOOST_CHECK_EQUAL(progress.totalRate, 0.0);
+    BOOST_CHECK_EQUAL(progress.currentRate, 0.0);
+    BOOST_CHECK_EQUAL(progress.windowRate, 0.0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
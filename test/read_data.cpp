@@ -0,0 +1,135 @@
+/**@file
+@brief Test ftdi_read_data() against a fake device
+
+@author libftdi developers
+*/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation;             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "fake_usb.h"
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+// Read total payload bytes with requests of the given sizes (cycled)
+static vector<unsigned char> read_all(struct ftdi_context *ftdi, const vector<int> &sizes, int total)
+{
+    vector<unsigned char> got;
+    vector<unsigned char> buf(64 * 1024);
+    int empty = 0;
+
+    for (unsigned int i = 0; (int)got.size() < total; i++)
+    {
+        int want = sizes[i % sizes.size()];
+        int ret = ftdi_read_data(ftdi, &buf[0], want);
+
+        BOOST_REQUIRE(ret >= 0);
+        BOOST_REQUIRE(ret <= want);
+        got.insert(got.end(), buf.begin(), buf.begin() + ret);
+        // empty packets return early, but never forever
+        empty = ret ? 0 : empty + 1;
+        BOOST_REQUIRE(empty < 10);
+    }
+    return got;
+}
+
+static void check_read(int packet_size, unsigned int chunksize, const vector<int> &plan,
+                       const vector<int> &sizes)
+{
+    struct ftdi_context *ftdi = ftdi_new();
+    FakeDevice dev(packet_size);
+    const int total = 100000;
+
+    BOOST_REQUIRE(ftdi != NULL);
+    dev.attach(ftdi);
+    dev.in_plan = plan;
+    BOOST_REQUIRE_EQUAL(ftdi_read_data_set_chunksize(ftdi, chunksize), 0);
+
+    vector<unsigned char> got = read_all(ftdi, sizes, total);
+
+    // whatever was read so far, byte for byte what the device sent
+    BOOST_REQUIRE(got.size() <= dev.sent.size());
+    BOOST_CHECK(equal(got.begin(), got.end(), dev.sent.begin()));
+
+    FakeDevice::detach(ftdi);
+    ftdi_free(ftdi);
+}
+
+BOOST_AUTO_TEST_SUITE(ReadData)
+
+BOOST_AUTO_TEST_CASE(DirectAndBufferedPathsAgree)
+{
+    const int packet_sizes[] = { 64, 512 };
+    const unsigned int chunksizes[] = { 512, 4096, 4100 };
+    vector<vector<int> > plans;
+
+    plans.push_back(vector<int>());
+    // short packets end a transfer early, empty ones carry status bytes only
+    int mixed[] = { -1, -1, -1, 17, -1, 0, 5, -1, -1, 1 };
+    plans.push_back(vector<int>(mixed, mixed + sizeof(mixed) / sizeof(mixed[0])));
+    int partial[] = { 3, 0, 40 };
+    plans.push_back(vector<int>(partial, partial + sizeof(partial) / sizeof(partial[0])));
+
+    for (unsigned int p = 0; p < sizeof(packet_sizes) / sizeof(packet_sizes[0]); p++)
+        for (unsigned int c = 0; c < sizeof(chunksizes) / sizeof(chunksizes[0]); c++)
+            for (unsigned int i = 0; i < plans.size(); i++)
+            {
+                int chunk = chunksizes[c];
+                BOOST_TEST_MESSAGE("packet " << packet_sizes[p] << " chunk " << chunk << " plan " << i);
+
+                // only the readbuffer path
+                check_read(packet_sizes[p], chunk, plans[i], vector<int>(1, 7));
+                check_read(packet_sizes[p], chunk, plans[i], vector<int>(1, chunk - 1));
+                // only the direct path
+                check_read(packet_sizes[p], chunk, plans[i], vector<int>(1, chunk));
+                check_read(packet_sizes[p], chunk, plans[i], vector<int>(1, 3 * chunk + 5));
+
+                // both, including leftovers in the readbuffer ahead of a direct read
+                int mix[] = { 1, chunk + 1, chunk / 2, 2 * chunk, 3, chunk - 2 };
+                check_read(packet_sizes[p], chunk, plans[i],
+                           vector<int>(mix, mix + sizeof(mix) / sizeof(mix[0])));
+            }
+}
+
+BOOST_AUTO_TEST_CASE(SameStreamBothWays)
+{
+    vector<int> plan;
+    plan.push_back(-1);
+    plan.push_back(100);
+    plan.push_back(-1);
+    plan.push_back(0);
+
+    // Two devices with the same seed hand out the same stream
+    struct ftdi_context *small = ftdi_new();
+    struct ftdi_context *large = ftdi_new();
+    FakeDevice dev_small(512), dev_large(512);
+
+    dev_small.attach(small);
+    dev_small.in_plan = plan;
+    dev_large.attach(large);
+    dev_large.in_plan = plan;
+
+    vector<unsigned char> a = read_all(small, vector<int>(1, 13), 50000);
+    vector<unsigned char> b = read_all(large, vector<int>(1, 16384), 50000);
+
+    a.resize(50000);
+    b.resize(50000);
+    BOOST_CHECK(a == b);
+
+    FakeDevice::detach(small);
+    FakeDevice::detach(large);
+    ftdi_free(small);
+    ftdi_free(large);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,170 @@
+/**@file
+@brief Test the read-ahead engine against a fake device
+
+@author libftdi developers
+*/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation;             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "fake_usb.h"
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+struct ReadaheadFixture : FakeFixture
+{
+    ReadaheadFixture() : FakeFixture(64)
+    {
+        // 8 full packets of 62 payload bytes per transfer
+        ftdi_read_data_set_chunksize(ftdi, 512);
+    }
+
+    ~ReadaheadFixture()
+    {
+        ftdi_readahead_stop(ftdi);
+    }
+
+    vector<unsigned char> read(int size)
+    {
+        vector<unsigned char> buf(size);
+        int ret = ftdi_read_data(ftdi, &buf[0], size);
+
+        BOOST_REQUIRE(ret >= 0);
+        buf.resize(ret);
+        return buf;
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(Readahead, ReadaheadFixture)
+
+BOOST_AUTO_TEST_CASE(RingWrapsAround)
+{
+    vector<unsigned char> got;
+
+    // 1500 is no multiple of the 496 payload bytes of a transfer
+    BOOST_REQUIRE_EQUAL(ftdi_readahead_start(ftdi, 2, 1500), 0);
+    BOOST_CHECK_EQUAL(fake_usb.pending(), 2);
+
+    for (int i = 0; got.size() < 20000; i++)
+    {
+        vector<unsigned char> part = read(1 + (i * 37) % 700);
+        got.insert(got.end(), part.begin(), part.end());
+    }
+
+    BOOST_REQUIRE(got.size() <= dev.sent.size());
+    BOOST_CHECK(equal(got.begin(), got.end(), dev.sent.begin()));
+}
+
+BOOST_AUTO_TEST_CASE(TimedOutTransferKeepsPayload)
+{
+    vector<unsigned char> got;
+
+    BOOST_REQUIRE_EQUAL(ftdi_readahead_start(ftdi, 2, 0), 0);
+    for (int i = 0; got.size() < 5000; i++)
+    {
+        if (i % 3 == 0)
+            dev.next_in_status = LIBUSB_TRANSFER_TIMED_OUT;
+        vector<unsigned char> part = read(300);
+        got.insert(got.end(), part.begin(), part.end());
+    }
+
+    BOOST_CHECK(equal(got.begin(), got.end(), dev.sent.begin()));
+}
+
+BOOST_AUTO_TEST_CASE(PurgeDropsTransfersInFlight)
+{
+    BOOST_REQUIRE_EQUAL(ftdi_readahead_start(ftdi, 2, 0), 0);
+
+    // fill the ring, leave data in it and transfers in flight
+    vector<unsigned char> before = read(100);
+    BOOST_CHECK(equal(before.begin(), before.end(), dev.sent.begin()));
+    int in_flight = fake_usb.pending();
+    size_t purged_at = dev.sent.size();
+    BOOST_REQUIRE(in_flight > 0);
+
+    BOOST_REQUIRE_EQUAL(ftdi_usb_purge_rx_buffer(ftdi), 0);
+
+    // everything read afterwards was produced after the transfers in
+    // flight during the purge completed
+    vector<unsigned char> got;
+    while (got.size() < 3000)
+    {
+        vector<unsigned char> part = read(500);
+        got.insert(got.end(), part.begin(), part.end());
+    }
+
+    size_t first = purged_at + in_flight * 8 * 62;
+    BOOST_REQUIRE(first + got.size() <= dev.sent.size());
+    BOOST_CHECK(equal(got.begin(), got.end(), dev.sent.begin() + first));
+}
+
+BOOST_AUTO_TEST_CASE(SubmittedReadFailsOnTransferError)
+{
+    vector<unsigned char> buf(5000);
+
+    BOOST_REQUIRE_EQUAL(ftdi_readahead_start(ftdi, 2, 0), 0);
+    struct ftdi_transfer_control *tc = ftdi_read_data_submit(ftdi, &buf[0], buf.size());
+    BOOST_REQUIRE(tc != NULL);
+
+    // the read ends early, which is no partial success
+    dev.next_in_status = LIBUSB_TRANSFER_ERROR;
+    BOOST_CHECK_EQUAL(ftdi_transfer_data_done(tc), -1);
+}
+
+BOOST_AUTO_TEST_CASE(StopFailsSubmittedRead)
+{
+    vector<unsigned char> buf(5000);
+
+    BOOST_REQUIRE_EQUAL(ftdi_readahead_start(ftdi, 2, 0), 0);
+    struct ftdi_transfer_control *tc = ftdi_read_data_submit(ftdi, &buf[0], buf.size());
+    BOOST_REQUIRE(tc != NULL);
+
+    BOOST_CHECK_EQUAL(ftdi_readahead_stop(ftdi), 0);
+    BOOST_CHECK_EQUAL(ftdi_transfer_data_done(tc), -1);
+}
+
+BOOST_AUTO_TEST_CASE(SubmittedReadTimesOut)
+{
+    vector<unsigned char> buf(5000);
+
+    ftdi->usb_read_timeout = 50;
+    BOOST_REQUIRE_EQUAL(ftdi_readahead_start(ftdi, 2, 0), 0);
+    struct ftdi_transfer_control *tc = ftdi_read_data_submit(ftdi, &buf[0], buf.size());
+    BOOST_REQUIRE(tc != NULL);
+
+    // the device stops sending, the read ends after usb_read_timeout
+    fake_usb.stalled = true;
+    BOOST_CHECK_EQUAL(ftdi_transfer_data_done(tc), -1);
+    fake_usb.stalled = false;
+}
+
+BOOST_AUTO_TEST_CASE(StopLeavesTransfersInFlightAlone)
+{
+    int live = fake_usb.live;
+
+    BOOST_REQUIRE_EQUAL(ftdi_readahead_start(ftdi, 2, 0), 0);
+    BOOST_CHECK_EQUAL(fake_usb.live, live + 2);
+
+    // cancelled, but libusb still owns them
+    fake_usb.event_failures = 1;
+    BOOST_CHECK_EQUAL(ftdi_readahead_stop(ftdi), 0);
+    BOOST_CHECK_EQUAL(fake_usb.pending(), 2);
+    BOOST_CHECK_EQUAL(fake_usb.live, live + 2);
+
+    // the last one to finish frees the engine
+    BOOST_CHECK_EQUAL(libusb_handle_events(NULL), 0);
+    BOOST_CHECK_EQUAL(fake_usb.pending(), 0);
+    BOOST_CHECK_EQUAL(fake_usb.live, live);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,101 @@
+/**@file
+@brief Test the ring buffer sink of the streaming functions
+
+@author libftdi developers
+*/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation;             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <ftdi.h>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <vector>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(Ring)
+
+BOOST_AUTO_TEST_CASE(RoundsUpToPowerOfTwo)
+{
+    struct ftdi_stream_ring *ring = ftdi_stream_ring_new(1000);
+
+    BOOST_REQUIRE(ring != NULL);
+    BOOST_CHECK_EQUAL(ftdi_stream_ring_size(ring), 1024U);
+    ftdi_stream_ring_free(ring);
+
+    BOOST_CHECK(ftdi_stream_ring_new(0) == NULL);
+}
+
+BOOST_AUTO_TEST_CASE(Wraparound)
+{
+    struct ftdi_stream_ring *ring = ftdi_stream_ring_new(256);
+    unsigned char counter_in = 0, counter_out = 0;
+
+    // Synthetic producer with a block size that does not divide the ring size
+    for (int round = 0; round < 100; round++)
+    {
+        vector<unsigned char> block(62 + round % 5);
+        for (unsigned int i = 0; i < block.size(); i++)
+            block[i] = counter_in++;
+        BOOST_REQUIRE_EQUAL(ftdi_stream_ring_write(ring, &block[0], block.size()), block.size());
+
+        vector<unsigned char> out(block.size());
+        BOOST_REQUIRE_EQUAL(ftdi_stream_ring_read(ring, &out[0], out.size()), out.size());
+        for (unsigned int i = 0; i < out.size(); i++)
+            BOOST_REQUIRE_EQUAL(out[i], counter_out++);
+    }
+
+    BOOST_CHECK_EQUAL(ftdi_stream_ring_fill(ring), 0U);
+    ftdi_stream_ring_free(ring);
+}
+
+BOOST_AUTO_TEST_CASE(OverflowDropsWholeBlocks)
+{
+    struct ftdi_stream_ring *ring = ftdi_stream_ring_new(128);
+    struct ftdi_stream_ring_stats stats;
+    unsigned char block[50] = { 0 };
+
+    BOOST_CHECK_EQUAL(ftdi_stream_ring_write(ring, block, sizeof(block)), sizeof(block));
+    BOOST_CHECK_EQUAL(ftdi_stream_ring_write(ring, block, sizeof(block)), sizeof(block));
+    BOOST_CHECK_EQUAL(ftdi_stream_ring_write(ring, block, sizeof(block)), 0U);
+
+    ftdi_stream_ring_get_stats(ring, &stats);
+    BOOST_CHECK_EQUAL(stats.bytes_written, 100U);
+    BOOST_CHECK_EQUAL(stats.bytes_dropped, 50U);
+    BOOST_CHECK_EQUAL(stats.overflows, 1U);
+    BOOST_CHECK_EQUAL(stats.high_water, 100U);
+
+    // Draining makes room again, the high-water mark stays
+    const unsigned char *data;
+    size_t n = ftdi_stream_ring_peek(ring, &data);
+    BOOST_CHECK_EQUAL(n, 100U);
+    ftdi_stream_ring_consume(ring, n);
+    BOOST_CHECK_EQUAL(ftdi_stream_ring_write(ring, block, sizeof(block)), sizeof(block));
+
+    ftdi_stream_ring_get_stats(ring, &stats);
+    BOOST_CHECK_EQUAL(stats.high_water, 100U);
+    ftdi_stream_ring_free(ring);
+}
+
+BOOST_AUTO_TEST_CASE(SinkStop)
+{
+    struct ftdi_stream_ring *ring = ftdi_stream_ring_new(64);
+    uint8_t block[10] = { 0 };
+
+    BOOST_CHECK_EQUAL(ftdi_stream_ring_sink(block, sizeof(block), NULL, ring), 0);
+    BOOST_CHECK_EQUAL(ftdi_stream_ring_sink(NULL, 0, NULL, ring), 0);
+    BOOST_CHECK_EQUAL(ftdi_stream_ring_fill(ring), sizeof(block));
+
+    ftdi_stream_ring_stop(ring);
+    BOOST_CHECK_EQUAL(ftdi_stream_ring_sink(block, sizeof(block), NULL, ring), 1);
+    ftdi_stream_ring_free(ring);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,260 @@
+/**@file
+@brief Test the SPI master against a fake device
+
+@author libftdi developers
+*/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation;             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "fake_usb.h"
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct SpiFixture : FakeFixture
+{
+    SpiFixture() : spi(NULL)
+    {
+        ftdi_spi_config_init(&config);
+        // no read-ahead, it would keep reading from the device
+        config.num_reads = 1;
+    }
+
+    ~SpiFixture()
+    {
+        ftdi_spi_free(spi);
+    }
+
+    void open()
+    {
+        spi = ftdi_spi_new(ftdi, &config);
+        BOOST_REQUIRE(spi != NULL);
+        queue = ftdi_spi_get_queue(spi);
+        dev.written.clear();
+    }
+
+    struct ftdi_spi_config config;
+    struct ftdi_spi *spi;
+};
+
+#define CHECK_BYTES(actual, expected) \
+    BOOST_CHECK_EQUAL_COLLECTIONS((actual).begin(), (actual).end(), \
+                                  (expected).begin(), (expected).end())
+
+BOOST_FIXTURE_TEST_SUITE(Spi, SpiFixture)
+
+BOOST_AUTO_TEST_CASE(SetsUpTheChip)
+{
+    spi = ftdi_spi_new(ftdi, &config);
+    BOOST_REQUIRE(spi != NULL);
+    queue = ftdi_spi_get_queue(spi);
+
+    // SK, DO and the chip select are outputs, chip select released
+    const unsigned char setup[] =
+    {
+        DIS_ADAPTIVE, DIS_DIV_5, DIS_3_PHASE, LOOPBACK_END,
+        TCK_DIVISOR, 0x00, 0x00,
+        SET_BITS_LOW, 0x08, 0x0b
+    };
+    vector<unsigned char> expected(setup, setup + sizeof(setup));
+    CHECK_BYTES(dev.written, expected);
+    BOOST_CHECK(queued().empty());
+}
+
+BOOST_AUTO_TEST_CASE(SetsUpTheClock)
+{
+    config.frequency = 1000000;
+    spi = ftdi_spi_new(ftdi, &config);
+    BOOST_REQUIRE(spi != NULL);
+
+    // the clock commands alone pick the prescaler and clocking
+    const unsigned char setup[] =
+    {
+        DIS_ADAPTIVE, LOOPBACK_END,
+        DIS_DIV_5, DIS_3_PHASE, TCK_DIVISOR, 29, 0,
+        SET_BITS_LOW, 0x08, 0x0b
+    };
+    vector<unsigned char> expected(setup, setup + sizeof(setup));
+    CHECK_BYTES(dev.written, expected);
+}
+
+BOOST_AUTO_TEST_CASE(NoClockWithoutMpsse)
+{
+    ftdi->type = TYPE_R;
+    config.frequency = 1000000;
+    BOOST_CHECK(ftdi_spi_new(ftdi, &config) == NULL);
+    BOOST_CHECK_EQUAL(string(ftdi_get_error_string(ftdi)), "SPI clock needs an MPSSE capable chip");
+}
+
+BOOST_AUTO_TEST_CASE(QueuesMode0)
+{
+    const unsigned char out[] = { 0x9f, 0x12, 0x34 };
+    unsigned char in[3];
+
+    open();
+    BOOST_CHECK_EQUAL(ftdi_spi_queue(spi, 0x08, out, in, 3, FTDI_SPI_WHOLE), 0);
+
+    // data changes on the falling edge, chip select asserted around it
+    const unsigned char commands[] =
+    {
+        SET_BITS_LOW, 0x00, 0x0b,
+        MPSSE_WRITE_NEG | MPSSE_DO_WRITE | MPSSE_DO_READ, 2, 0, 0x9f, 0x12, 0x34,
+        SET_BITS_LOW, 0x08, 0x0b
+    };
+    vector<unsigned char> expected(commands, commands + sizeof(commands));
+    vector<unsigned char> actual = queued();
+    CHECK_BYTES(actual, expected);
+    BOOST_CHECK_EQUAL(ftdi_mpsse_queue_reply_length(ftdi_spi_get_queue(spi)), 3);
+
+    BOOST_CHECK_EQUAL(ftdi_spi_flush(spi), 0);
+    expected.push_back(SEND_IMMEDIATE);
+    CHECK_BYTES(dev.written, expected);
+    BOOST_CHECK(equal(in, in + 3, dev.sent.begin()));
+    BOOST_CHECK(queued().empty());
+}
+
+BOOST_AUTO_TEST_CASE(QueuesMode3LsbFirst)
+{
+    unsigned char in[4];
+
+    config.mode = 3;
+    config.lsb_first = 1;
+    open();
+    // command and read under one chip select, in two calls
+    BOOST_CHECK_EQUAL(ftdi_spi_queue(spi, 0x08, NULL, in, 4, FTDI_SPI_START), 0);
+    BOOST_CHECK_EQUAL(ftdi_spi_queue(spi, 0x08, NULL, NULL, 0, FTDI_SPI_END), 0);
+
+    // SK idles high, reads carry no data bytes
+    const unsigned char commands[] =
+    {
+        SET_BITS_LOW, 0x01, 0x0b,
+        MPSSE_WRITE_NEG | MPSSE_LSB | MPSSE_DO_READ, 3, 0,
+        SET_BITS_LOW, 0x09, 0x0b
+    };
+    vector<unsigned char> expected(commands, commands + sizeof(commands));
+    vector<unsigned char> actual = queued();
+    CHECK_BYTES(actual, expected);
+}
+
+BOOST_AUTO_TEST_CASE(ClocksZerosWithoutData)
+{
+    config.mode = 1;
+    open();
+    BOOST_CHECK_EQUAL(ftdi_spi_queue(spi, 0, NULL, NULL, 300, 0), 0);
+
+    // data changes on the rising edge, zeros in blocks of 256
+    vector<unsigned char> commands = queued();
+    BOOST_REQUIRE_EQUAL(commands.size(), 3U + 256 + 3 + 44);
+    BOOST_CHECK_EQUAL(commands[0], MPSSE_READ_NEG | MPSSE_DO_WRITE);
+    BOOST_CHECK_EQUAL(commands[1], 255);
+    BOOST_CHECK_EQUAL(commands[2], 0);
+    BOOST_CHECK_EQUAL(commands[3 + 256], MPSSE_READ_NEG | MPSSE_DO_WRITE);
+    BOOST_CHECK_EQUAL(commands[4 + 256], 43);
+    BOOST_CHECK(count(commands.begin(), commands.end(), 0) >= 300);
+    BOOST_CHECK_EQUAL(ftdi_mpsse_queue_reply_length(ftdi_spi_get_queue(spi)), 0);
+}
+
+BOOST_AUTO_TEST_CASE(RejectsInvalid)
+{
+    unsigned char out = 0;
+
+    open();
+    BOOST_CHECK(ftdi_spi_get_queue(NULL) == NULL);
+    BOOST_CHECK_EQUAL(ftdi_spi_queue(NULL, 0, &out, NULL, 1, 0), -1);
+    // chip select outside config.cs_pins
+    BOOST_CHECK_EQUAL(ftdi_spi_queue(spi, 0x10, &out, NULL, 1, FTDI_SPI_WHOLE), -1);
+    BOOST_CHECK_EQUAL(ftdi_spi_queue(spi, 0x08, &out, NULL, -1, FTDI_SPI_WHOLE), -1);
+    BOOST_CHECK(queued().empty());
+}
+
+BOOST_AUTO_TEST_CASE(FlushDropsReplyOfFailedWrite)
+{
+    const unsigned char out[] = { 0x9f };
+    unsigned char in[4];
+
+    // the default configuration keeps reading ahead
+    ftdi_spi_config_init(&config);
+    open();
+    BOOST_CHECK_EQUAL(ftdi_spi_queue(spi, 0x08, out, NULL, 1, FTDI_SPI_START), 0);
+    BOOST_CHECK_EQUAL(ftdi_spi_queue(spi, 0x08, NULL, in, 4, FTDI_SPI_END), 0);
+
+    // the device has nothing to send without the commands
+    dev.in_limit = 0;
+    BOOST_REQUIRE_EQUAL(ftdi_usb_purge_rx_buffer(ftdi), 0);
+
+    // the reply never comes, the flush must not wait for it
+    int rounds = fake_usb.event_rounds;
+    dev.fail_out_at = dev.out_transfers;
+    BOOST_CHECK_EQUAL(ftdi_spi_flush(spi), -2);
+    BOOST_CHECK(fake_usb.event_rounds - rounds <= 1);
+    BOOST_CHECK(queued().empty());
+
+    // the next flush works again
+    dev.in_limit = -1;
+    BOOST_CHECK_EQUAL(ftdi_spi_queue(spi, 0x08, NULL, in, 4, FTDI_SPI_WHOLE), 0);
+    BOOST_CHECK_EQUAL(ftdi_spi_flush(spi), 0);
+}
+
+BOOST_AUTO_TEST_CASE(TransferStreamsChunks)
+{
+    vector<unsigned char> out(250), in(250);
+
+    for (size_t i = 0; i < out.size(); i++)
+        out[i] = i * 7;
+    config.chunk_size = 100;
+    open();
+    BOOST_CHECK_EQUAL(ftdi_spi_transfer(spi, 0x08, &out[0], &in[0], out.size(), FTDI_SPI_WHOLE), 0);
+
+    // one write per chunk, chip select and SEND_IMMEDIATE in the first and last
+    const unsigned char opcode = MPSSE_WRITE_NEG | MPSSE_DO_WRITE | MPSSE_DO_READ;
+    vector<unsigned char> expected;
+    const unsigned char start[] = { SET_BITS_LOW, 0x00, 0x0b };
+    expected.insert(expected.end(), start, start + 3);
+    for (int pos = 0; pos < 250; pos += 100)
+    {
+        int n = min(100, 250 - pos);
+        expected.push_back(opcode);
+        expected.push_back(n - 1);
+        expected.push_back(0);
+        expected.insert(expected.end(), out.begin() + pos, out.begin() + pos + n);
+    }
+    const unsigned char end[] = { SET_BITS_LOW, 0x08, 0x0b, SEND_IMMEDIATE };
+    expected.insert(expected.end(), end, end + 4);
+    CHECK_BYTES(dev.written, expected);
+    BOOST_CHECK(equal(in.begin(), in.end(), dev.sent.begin()));
+}
+
+BOOST_AUTO_TEST_CASE(TransferDropsReadOfFailedWrite)
+{
+    vector<unsigned char> out(250, 0x5a), in(250);
+
+    // the default configuration keeps reading ahead
+    ftdi_spi_config_init(&config);
+    config.chunk_size = 100;
+    open();
+    dev.in_limit = 0;
+    BOOST_REQUIRE_EQUAL(ftdi_usb_purge_rx_buffer(ftdi), 0);
+
+    // the second chunk fails, the data for the rest never comes
+    int rounds = fake_usb.event_rounds;
+    dev.fail_out_at = dev.out_transfers + 1;
+    BOOST_CHECK_EQUAL(ftdi_spi_transfer(spi, 0x08, &out[0], &in[0], out.size(), FTDI_SPI_WHOLE), -2);
+    BOOST_CHECK(fake_usb.event_rounds - rounds <= config.num_writes + 1);
+
+    // the next transfer works again
+    dev.in_limit = -1;
+    BOOST_CHECK_EQUAL(ftdi_spi_transfer(spi, 0x08, &out[0], &in[0], 10, FTDI_SPI_WHOLE), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
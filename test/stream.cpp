@@ -0,0 +1,606 @@
+/**@file
+@brief Test the streaming functions against a fake device
+
+@author libftdi developers
+*/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation;             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "fake_usb.h"
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+struct StreamFixture : FakeFixture
+{
+    StreamFixture() : to_send(0), produced(0), chunk(1000), produce_error(0),
+                      read_limit(0), progress_reports(0)
+    {
+    }
+
+    // what the producer hands out: a counter, in blocks of at most chunk bytes
+    vector<unsigned char> expected_output() const
+    {
+        vector<unsigned char> out(to_send);
+
+        for (int i = 0; i < to_send; i++)
+            out[i] = i * 13;
+        return out;
+    }
+
+    int to_send;
+    int produced;
+    int chunk;
+    int produce_error;
+
+    vector<unsigned char> received;
+    size_t read_limit;
+    int progress_reports;
+};
+
+static int producer(uint8_t *buffer, int length, FTDIProgressInfo *progress, void *userdata)
+{
+    StreamFixture *f = static_cast<StreamFixture *>(userdata);
+    int n = min(min(length, f->chunk), f->to_send - f->produced);
+
+    if (buffer == NULL)
+    {
+        f->progress_reports++;
+        return 0;
+    }
+    if (f->produce_error && f->produced >= f->to_send / 2)
+        return f->produce_error;
+    for (int i = 0; i < n; i++)
+        buffer[i] = (f->produced + i) * 13;
+    f->produced += n;
+    return n;
+}
+
+static int consumer(uint8_t *buffer, int length, FTDIProgressInfo *progress, void *userdata)
+{
+    StreamFixture *f = static_cast<StreamFixture *>(userdata);
+
+    if (buffer == NULL)
+    {
+        f->progress_reports++;
+        return 0;
+    }
+    // transfers completing in the same round may still be delivered
+    if (f->received.size() >= f->read_limit)
+        return 5;
+    f->received.insert(f->received.end(), buffer, buffer + length);
+    return f->received.size() >= f->read_limit ? 5 : 0;
+}
+
+BOOST_FIXTURE_TEST_SUITE(Stream, StreamFixture)
+
+BOOST_AUTO_TEST_CASE(WriteStreamSendsEverything)
+{
+    to_send = 100000;
+
+    BOOST_CHECK_EQUAL(ftdi_writestream(ftdi, producer, this, 8, 4), 0);
+    BOOST_CHECK_EQUAL(produced, to_send);
+    BOOST_CHECK(dev.written == expected_output());
+    // chip reset, purged and switched to synchronous FIFO mode
+    BOOST_CHECK(find(dev.control_requests.begin(), dev.control_requests.end(),
+                     SIO_SET_BITMODE_REQUEST) != dev.control_requests.end());
+}
+
+BOOST_AUTO_TEST_CASE(WriteStreamProducerError)
+{
+    to_send = 100000;
+    produce_error = -42;
+
+    BOOST_CHECK_EQUAL(ftdi_writestream(ftdi, producer, this, 8, 4), -42);
+    BOOST_CHECK(produced < to_send);
+    // what went out is a prefix of the data
+    vector<unsigned char> out = expected_output();
+    BOOST_CHECK(equal(dev.written.begin(), dev.written.end(), out.begin()));
+}
+
+BOOST_AUTO_TEST_CASE(WriteStreamOverlongBlock)
+{
+    to_send = 100000;
+    chunk = 100000;
+
+    // blocks as large as requested
+    BOOST_CHECK_EQUAL(ftdi_writestream(ftdi, producer, this, 1, 2), 0);
+    BOOST_CHECK(dev.written == expected_output());
+
+    // a block larger than requested is rejected, not sent
+    struct Overlong
+    {
+        static int produce(uint8_t *buffer, int length, FTDIProgressInfo *progress, void *userdata)
+        {
+            return buffer ? length + 1 : 0;
+        }
+    };
+    dev.written.clear();
+    BOOST_CHECK_EQUAL(ftdi_writestream(ftdi, Overlong::produce, this, 1, 2), LIBUSB_ERROR_OVERFLOW);
+    BOOST_CHECK(dev.written.empty());
+}
+
+BOOST_AUTO_TEST_CASE(WriteStreamTransferError)
+{
+    to_send = 100000;
+    dev.fail_out_at = 5;
+
+    BOOST_CHECK_EQUAL(ftdi_writestream(ftdi, producer, this, 8, 4), LIBUSB_ERROR_IO);
+    BOOST_CHECK(dev.written.size() < (size_t)to_send);
+}
+
+BOOST_AUTO_TEST_CASE(ReadWriteStreamBothDirections)
+{
+    to_send = 30000;
+    read_limit = 200000;
+
+    // the callback ends the stream, writing stopped long before
+    BOOST_CHECK_EQUAL(ftdi_readwritestream(ftdi, consumer, producer, this, 8, 4), 5);
+    BOOST_CHECK_EQUAL(produced, to_send);
+    BOOST_CHECK(dev.written == expected_output());
+
+    BOOST_CHECK(received.size() >= read_limit);
+    BOOST_REQUIRE(received.size() <= dev.sent.size());
+    BOOST_CHECK(equal(received.begin(), received.end(), dev.sent.begin()));
+}
+
+BOOST_AUTO_TEST_CASE(ReadWriteStreamWriteErrorEndsStream)
+{
+    to_send = 1000000;
+    read_limit = 100000000;
+    dev.fail_out_at = 3;
+
+    BOOST_CHECK_EQUAL(ftdi_readwritestream(ftdi, consumer, producer, this, 8, 4), LIBUSB_ERROR_IO);
+    BOOST_CHECK(equal(received.begin(), received.end(), dev.sent.begin()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+// Counts packets handed to the callback, stops after a number of them
+struct PacketCounter
+{
+    PacketCounter(int limit) : packets(0), limit(limit) {}
+
+    static int callback(uint8_t *buffer, int length, FTDIProgressInfo *progress, void *userdata)
+    {
+        PacketCounter *c = static_cast<PacketCounter *>(userdata);
+
+        if (buffer == NULL)
+            return 0;
+        return ++c->packets >= c->limit;
+    }
+
+    int packets;
+    int limit;
+};
+
+BOOST_FIXTURE_TEST_SUITE(StreamStats, StreamFixture)
+
+BOOST_AUTO_TEST_CASE(LineStatusErrors)
+{
+    // overrun, break, overrun with framing error, data ready only
+    const unsigned char lsr[] = { 0x60, 0x62, 0x60, 0x70, 0x6a, 0x61 };
+    struct ftdi_stream_config config;
+    struct ftdi_stream_stats stats;
+    PacketCounter counter(1000);
+
+    dev.lsr_plan.assign(lsr, lsr + sizeof(lsr));
+    ftdi_stream_config_init(&config);
+    config.num_transfers = 4;
+    config.stats = &stats;
+    BOOST_CHECK_EQUAL(ftdi_stream_run(ftdi, &config, PacketCounter::callback, NULL, &counter), 1);
+
+    // every packet of every completed transfer is accounted, even after
+    // the callback asked to stop
+    uint64_t overruns = 0, errors = 0;
+    for (size_t i = 0; i < dev.lsr_plan_pos; i++)
+    {
+        overruns += (lsr[i % 6] & 0x02) != 0;
+        errors += (lsr[i % 6] & 0x9c) != 0;
+    }
+    BOOST_CHECK_EQUAL(stats.transfers * 8, dev.lsr_plan_pos);
+    BOOST_CHECK_EQUAL(stats.overruns, overruns);
+    BOOST_CHECK_EQUAL(stats.line_errors, errors);
+    BOOST_CHECK(stats.overruns > 0 && stats.line_errors > 0);
+    BOOST_CHECK_EQUAL(stats.short_transfers, 0U);
+    BOOST_CHECK_EQUAL(stats.empty_transfers, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(ShortAndEmptyTransfers)
+{
+    struct ftdi_stream_config config;
+    struct ftdi_stream_stats stats;
+    PacketCounter counter(500);
+
+    // per three transfers: a full one, a short one, one with status bytes only
+    int plan[] = { -1, -1, -1, -1, -1, -1, -1, -1, 100, 0 };
+    dev.in_plan.assign(plan, plan + 10);
+    ftdi_stream_config_init(&config);
+    config.num_transfers = 4;
+    config.stats = &stats;
+    BOOST_CHECK_EQUAL(ftdi_stream_run(ftdi, &config, PacketCounter::callback, NULL, &counter), 1);
+
+    uint64_t short_transfers = 0, empty_transfers = 0;
+    for (uint64_t i = 0; i < stats.transfers; i++)
+    {
+        short_transfers += i % 3 != 0;
+        empty_transfers += i % 3 == 2;
+    }
+    BOOST_CHECK(stats.transfers >= 3);
+    BOOST_CHECK_EQUAL(stats.short_transfers, short_transfers);
+    BOOST_CHECK_EQUAL(stats.empty_transfers, empty_transfers);
+    BOOST_CHECK_EQUAL(stats.overruns, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(Timing)
+{
+    struct ftdi_stream_config config;
+    struct ftdi_stream_stats stats;
+    PacketCounter counter(200);
+
+    ftdi_stream_config_init(&config);
+    config.num_transfers = 2;
+    config.stats = &stats;
+    // stale values are cleared when the stream starts
+    stats.overruns = 99;
+    stats.max_gap = 99;
+    BOOST_CHECK_EQUAL(ftdi_stream_run(ftdi, &config, PacketCounter::callback, NULL, &counter), 1);
+
+    BOOST_CHECK(stats.transfers >= 25);
+    BOOST_CHECK_EQUAL(stats.overruns, 0U);
+    BOOST_CHECK(stats.max_gap >= 0 && stats.max_gap < 10);
+    BOOST_CHECK(stats.mean_gap >= 0 && stats.mean_gap <= stats.max_gap);
+    BOOST_CHECK(stats.max_resubmit >= 0 && stats.max_resubmit < 10);
+    BOOST_CHECK(stats.last_completion.tv_sec != 0 || stats.last_completion.tv_usec != 0);
+    BOOST_CHECK_EQUAL(stats.pattern.first_error, -1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+// Pauses, resumes and stops a stream from its callback
+struct Controller
+{
+    Controller() : control(ftdi_stream_control_new()), pause_at(0), stop_at(0), fail_at(0),
+                   resume_after(3), paused_reports(0), pending_while_paused(0)
+    {
+    }
+
+    ~Controller()
+    {
+        ftdi_stream_control_free(control);
+    }
+
+    static int callback(uint8_t *buffer, int length, FTDIProgressInfo *progress, void *userdata)
+    {
+        Controller *c = static_cast<Controller *>(userdata);
+
+        if (buffer == NULL)
+        {
+            // progress is still reported while paused, resume after a while
+            if (c->paused && c->paused_reports >= 0 && c->paused_reports < c->resume_after)
+            {
+                c->pending_while_paused = max(c->pending_while_paused, fake_usb.pending());
+                if (++c->paused_reports == c->resume_after)
+                {
+                    c->paused = false;
+                    ftdi_stream_resume(c->control);
+                }
+            }
+            return 0;
+        }
+        if (c->paused)
+            c->data_while_paused += length;
+        c->data.insert(c->data.end(), buffer, buffer + length);
+        if (c->pause_at && c->data.size() >= c->pause_at)
+        {
+            c->pause_at = 0;
+            c->paused = true;
+            ftdi_stream_pause(c->control);
+        }
+        if (c->stop_at && c->data.size() >= c->stop_at)
+        {
+            c->stop_at = 0;
+            ftdi_stream_stop(c->control);
+        }
+        if (c->fail_at && c->data.size() >= c->fail_at)
+            return 7;
+        return 0;
+    }
+
+    struct ftdi_stream_control *control;
+    vector<unsigned char> data;
+    size_t pause_at;
+    size_t stop_at;
+    size_t fail_at;
+    bool paused;
+    int resume_after;
+    int paused_reports;
+    int pending_while_paused;
+    size_t data_while_paused;
+};
+
+struct ControlFixture : StreamFixture
+{
+    ControlFixture()
+    {
+        c.paused = false;
+        c.data_while_paused = 0;
+        ftdi_stream_config_init(&config);
+        config.num_transfers = 4;
+        config.progress_interval = 0.0001;
+        config.control = c.control;
+    }
+
+    // the device data up to what the callback got
+    bool data_is_contiguous() const
+    {
+        return c.data.size() <= dev.sent.size() &&
+               equal(c.data.begin(), c.data.end(), dev.sent.begin());
+    }
+
+    Controller c;
+    struct ftdi_stream_config config;
+};
+
+BOOST_FIXTURE_TEST_SUITE(StreamControl, ControlFixture)
+
+BOOST_AUTO_TEST_CASE(StopDrainsTransfersInFlight)
+{
+    c.stop_at = 100000;
+
+    BOOST_CHECK_EQUAL(ftdi_stream_run(ftdi, &config, Controller::callback, NULL, &c), 0);
+    // the transfers in flight at the stop are delivered, nothing is lost
+    BOOST_CHECK(c.data.size() > 100000);
+    BOOST_CHECK(c.data.size() == dev.sent.size());
+    BOOST_CHECK(data_is_contiguous());
+
+    // the stop is used up, the control runs another stream
+    c.fail_at = c.data.size() + 50000;
+    BOOST_CHECK_EQUAL(ftdi_stream_run(ftdi, &config, Controller::callback, NULL, &c), 7);
+}
+
+BOOST_AUTO_TEST_CASE(StopBeforeStart)
+{
+    BOOST_REQUIRE_EQUAL(ftdi_stream_stop(c.control), 0);
+
+    BOOST_CHECK_EQUAL(ftdi_stream_run(ftdi, &config, Controller::callback, NULL, &c), 0);
+    // only the first transfers went out, and were delivered
+    BOOST_CHECK(c.data.size() <= 4 * 8 * 510U);
+    BOOST_CHECK(c.data.size() == dev.sent.size());
+    BOOST_CHECK(data_is_contiguous());
+
+    c.fail_at = c.data.size() + 50000;
+    BOOST_CHECK_EQUAL(ftdi_stream_run(ftdi, &config, Controller::callback, NULL, &c), 7);
+}
+
+BOOST_AUTO_TEST_CASE(PauseAndResume)
+{
+    c.pause_at = 50000;
+    c.stop_at = 200000;
+
+    BOOST_CHECK_EQUAL(ftdi_stream_run(ftdi, &config, Controller::callback, NULL, &c), 0);
+    BOOST_CHECK_EQUAL(c.paused_reports, c.resume_after);
+    // the transfers are parked, not resubmitted, while paused
+    BOOST_CHECK_EQUAL(c.pending_while_paused, 0);
+    BOOST_CHECK(c.data.size() > 200000);
+    BOOST_CHECK(c.data.size() == dev.sent.size());
+    BOOST_CHECK(data_is_contiguous());
+}
+
+BOOST_AUTO_TEST_CASE(StartPaused)
+{
+    BOOST_REQUIRE_EQUAL(ftdi_stream_pause(c.control), 0);
+    c.paused = true;
+    c.stop_at = 100000;
+
+    BOOST_CHECK_EQUAL(ftdi_stream_run(ftdi, &config, Controller::callback, NULL, &c), 0);
+    // nothing was submitted before the resume
+    BOOST_CHECK_EQUAL(c.paused_reports, c.resume_after);
+    BOOST_CHECK_EQUAL(c.pending_while_paused, 0);
+    BOOST_CHECK_EQUAL(c.data_while_paused, 0U);
+    BOOST_CHECK(c.data.size() > 100000);
+    BOOST_CHECK(data_is_contiguous());
+}
+
+BOOST_AUTO_TEST_CASE(StopWhilePaused)
+{
+    BOOST_REQUIRE_EQUAL(ftdi_stream_pause(c.control), 0);
+    BOOST_REQUIRE_EQUAL(ftdi_stream_stop(c.control), 0);
+    c.paused_reports = -1;
+
+    // the parked transfers are dropped, nothing went out
+    BOOST_CHECK_EQUAL(ftdi_stream_run(ftdi, &config, Controller::callback, NULL, &c), 0);
+    BOOST_CHECK(dev.sent.empty());
+    BOOST_CHECK(c.data.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+// Collects the data of one stream of a group, stops after a limit
+struct GroupSink
+{
+    GroupSink(size_t limit) : limit(limit), reports(0) {}
+
+    static int callback(uint8_t *buffer, int length, FTDIProgressInfo *progress, void *userdata)
+    {
+        GroupSink *s = static_cast<GroupSink *>(userdata);
+
+        if (buffer == NULL)
+        {
+            s->reports++;
+            return 0;
+        }
+        // transfers completing in the same round may still be delivered
+        if (s->data.size() >= s->limit)
+            return 5;
+        s->data.insert(s->data.end(), buffer, buffer + length);
+        return s->data.size() >= s->limit ? 5 : 0;
+    }
+
+    bool matches(const FakeDevice &dev) const
+    {
+        return data.size() <= dev.sent.size() &&
+               equal(data.begin(), data.end(), dev.sent.begin());
+    }
+
+    vector<unsigned char> data;
+    size_t limit;
+    int reports;
+};
+
+// Combined progress reports of ftdi_stream_group_run()
+static int group_report(uint8_t *buffer, int length, FTDIProgressInfo *progress, void *userdata)
+{
+    uint64_t *total = static_cast<uint64_t *>(userdata);
+
+    BOOST_CHECK(buffer == NULL);
+    BOOST_CHECK(progress->current.totalBytes >= *total);
+    *total = progress->current.totalBytes;
+    return 0;
+}
+
+struct GroupFixture : StreamFixture
+{
+    GroupFixture() : group(ftdi_stream_group_new()), total(0)
+    {
+        other = ftdi_new();
+        other_dev.attach(other);
+        ftdi_stream_config_init(&config);
+        config.num_transfers = 4;
+        config.progress_interval = 0.0001;
+    }
+
+    ~GroupFixture()
+    {
+        ftdi_stream_group_free(group);
+        FakeDevice::detach(other);
+        ftdi_free(other);
+    }
+
+    struct ftdi_stream_group *group;
+    struct ftdi_context *other;
+    FakeDevice other_dev;
+    struct ftdi_stream_config config;
+    uint64_t total;
+};
+
+BOOST_FIXTURE_TEST_SUITE(StreamGroup, GroupFixture)
+
+BOOST_AUTO_TEST_CASE(InvalidArguments)
+{
+    BOOST_CHECK_EQUAL(ftdi_stream_group_run(group, NULL, 0, NULL), LIBUSB_ERROR_INVALID_PARAM);
+    BOOST_CHECK_EQUAL(ftdi_stream_group_run(NULL, NULL, 0, NULL), LIBUSB_ERROR_INVALID_PARAM);
+    BOOST_CHECK_EQUAL(ftdi_stream_group_add(NULL, ftdi, &config, consumer, NULL, this), -1);
+    BOOST_CHECK_EQUAL(ftdi_stream_group_add(group, ftdi, &config, NULL, NULL, this), -1);
+
+    BOOST_CHECK_EQUAL(ftdi_stream_group_add(group, ftdi, &config, consumer, NULL, this), 0);
+    // a device is in a group at most once
+    BOOST_CHECK_EQUAL(ftdi_stream_group_add(group, ftdi, &config, consumer, NULL, this), -1);
+    BOOST_CHECK_EQUAL(ftdi_stream_group_result(group, 1), LIBUSB_ERROR_INVALID_PARAM);
+    BOOST_CHECK_EQUAL(ftdi_stream_group_result(group, -1), LIBUSB_ERROR_INVALID_PARAM);
+    BOOST_CHECK_EQUAL(ftdi_stream_group_result(NULL, 0), LIBUSB_ERROR_INVALID_PARAM);
+}
+
+BOOST_AUTO_TEST_CASE(StreamsEndOnTheirOwn)
+{
+    GroupSink a(50000), b(200000);
+
+    BOOST_REQUIRE_EQUAL(ftdi_stream_group_add(group, ftdi, &config, GroupSink::callback, NULL, &a), 0);
+    BOOST_REQUIRE_EQUAL(ftdi_stream_group_add(group, other, &config, GroupSink::callback, NULL, &b), 1);
+    BOOST_CHECK_EQUAL(ftdi_stream_group_run(group, group_report, 0.0001, &total), 0);
+
+    // the first stream ending doesn't end the second one
+    BOOST_CHECK_EQUAL(ftdi_stream_group_result(group, 0), 5);
+    BOOST_CHECK_EQUAL(ftdi_stream_group_result(group, 1), 5);
+    BOOST_CHECK(a.data.size() >= 50000 && a.data.size() < 200000);
+    BOOST_CHECK(b.data.size() >= 200000);
+    BOOST_CHECK(a.matches(dev));
+    BOOST_CHECK(b.matches(other_dev));
+    // each stream reports its own progress, the group the sum
+    BOOST_CHECK(a.reports > 0 && b.reports > 0);
+    BOOST_CHECK(total > 0 && total <= dev.sent.size() + other_dev.sent.size());
+}
+
+BOOST_AUTO_TEST_CASE(ReadAndWriteStreams)
+{
+    GroupSink a(100000);
+
+    to_send = 100000;
+    BOOST_REQUIRE_EQUAL(ftdi_stream_group_add(group, ftdi, &config, GroupSink::callback, NULL, &a), 0);
+    BOOST_REQUIRE_EQUAL(ftdi_stream_group_add(group, other, &config, NULL, producer, this), 1);
+    BOOST_CHECK_EQUAL(ftdi_stream_group_run(group, NULL, 0, NULL), 0);
+
+    BOOST_CHECK_EQUAL(ftdi_stream_group_result(group, 0), 5);
+    BOOST_CHECK_EQUAL(ftdi_stream_group_result(group, 1), 0);
+    BOOST_CHECK(a.matches(dev));
+    BOOST_CHECK(other_dev.written == expected_output());
+    BOOST_CHECK(dev.written.empty());
+}
+
+BOOST_AUTO_TEST_CASE(SharedContext)
+{
+    struct ftdi_context *shared[2];
+    FakeDevice shared_dev[2];
+    GroupSink a(30000), b(30000);
+
+    shared[0] = ftdi_new_shared(NULL);
+    shared[1] = ftdi_new_shared(NULL);
+    BOOST_REQUIRE(shared[0] != NULL && shared[1] != NULL);
+    BOOST_REQUIRE(shared[0]->usb_ctx == shared[1]->usb_ctx);
+    shared_dev[0].attach(shared[0]);
+    shared_dev[1].attach(shared[1]);
+
+    BOOST_REQUIRE_EQUAL(ftdi_stream_group_add(group, shared[0], &config, GroupSink::callback, NULL, &a), 0);
+    BOOST_REQUIRE_EQUAL(ftdi_stream_group_add(group, shared[1], &config, GroupSink::callback, NULL, &b), 1);
+    BOOST_CHECK_EQUAL(ftdi_stream_group_run(group, NULL, 0, NULL), 0);
+
+    // one round of events serves both streams
+    BOOST_CHECK_EQUAL(ftdi_stream_group_result(group, 0), 5);
+    BOOST_CHECK_EQUAL(ftdi_stream_group_result(group, 1), 5);
+    BOOST_CHECK(a.matches(shared_dev[0]));
+    BOOST_CHECK(b.matches(shared_dev[1]));
+
+    ftdi_stream_group_free(group);
+    group = NULL;
+    for (int i = 0; i < 2; i++)
+    {
+        FakeDevice::detach(shared[i]);
+        ftdi_free(shared[i]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(SetupFailureRunsNothing)
+{
+    GroupSink a(30000), b(30000);
+
+    BOOST_REQUIRE_EQUAL(ftdi_stream_group_add(group, ftdi, &config, GroupSink::callback, NULL, &a), 0);
+    BOOST_REQUIRE_EQUAL(ftdi_stream_group_add(group, other, &config, GroupSink::callback, NULL, &b), 1);
+
+    // the second stream cannot submit its transfers
+    fake_usb.submits_left = 4;
+    BOOST_CHECK_EQUAL(ftdi_stream_group_run(group, NULL, 0, NULL), LIBUSB_ERROR_IO);
+    BOOST_CHECK_EQUAL(ftdi_stream_group_result(group, 0), 0);
+    BOOST_CHECK_EQUAL(ftdi_stream_group_result(group, 1), LIBUSB_ERROR_IO);
+    BOOST_CHECK(a.data.empty() && b.data.empty());
+    BOOST_CHECK_EQUAL(fake_usb.pending(), 0);
+
+    // the group runs again once the device works
+    fake_usb.submits_left = -1;
+    BOOST_CHECK_EQUAL(ftdi_stream_group_run(group, NULL, 0, NULL), 0);
+    BOOST_CHECK_EQUAL(ftdi_stream_group_result(group, 0), 5);
+    BOOST_CHECK_EQUAL(ftdi_stream_group_result(group, 1), 5);
+    BOOST_CHECK(a.matches(dev));
+    BOOST_CHECK(b.matches(other_dev));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,131 @@
+/**@file
+@brief Test the transfer pool of the asynchronous API
+
+@author libftdi developers
+*/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation;             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "fake_usb.h"
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+struct PoolFixture : FakeFixture
+{
+    PoolFixture() : data(256, 0x55)
+    {
+    }
+
+    struct ftdi_transfer_pool_stats stats()
+    {
+        struct ftdi_transfer_pool_stats s;
+
+        BOOST_REQUIRE_EQUAL(ftdi_transfer_pool_get_stats(ftdi, &s), 0);
+        return s;
+    }
+
+    vector<unsigned char> data;
+};
+
+BOOST_FIXTURE_TEST_SUITE(TransferPool, PoolFixture)
+
+BOOST_AUTO_TEST_CASE(HitsAndMisses)
+{
+    struct ftdi_transfer_control *tcs[3];
+
+    // three at once: nothing to recycle yet
+    for (int i = 0; i < 3; i++)
+        BOOST_REQUIRE((tcs[i] = ftdi_write_data_submit(ftdi, &data[0], data.size())) != NULL);
+    for (int i = 0; i < 3; i++)
+        BOOST_CHECK_EQUAL(ftdi_transfer_data_done(tcs[i]), (int)data.size());
+
+    struct ftdi_transfer_pool_stats s = stats();
+    BOOST_CHECK_EQUAL(s.tc_hits, 0UL);
+    BOOST_CHECK_EQUAL(s.tc_misses, 3UL);
+    BOOST_CHECK_EQUAL(s.transfer_hits, 0UL);
+    BOOST_CHECK_EQUAL(s.transfer_misses, 3UL);
+
+    // one at a time: everything comes from the pool
+    for (int i = 0; i < 10; i++)
+    {
+        struct ftdi_transfer_control *tc = ftdi_write_data_submit(ftdi, &data[0], data.size());
+        BOOST_REQUIRE(tc != NULL);
+        BOOST_CHECK_EQUAL(ftdi_transfer_data_done(tc), (int)data.size());
+    }
+
+    s = stats();
+    BOOST_CHECK_EQUAL(s.tc_hits, 10UL);
+    BOOST_CHECK_EQUAL(s.tc_misses, 3UL);
+    BOOST_CHECK_EQUAL(s.transfer_hits, 10UL);
+    BOOST_CHECK_EQUAL(s.transfer_misses, 3UL);
+}
+
+BOOST_AUTO_TEST_CASE(DisabledPoolOnlyMisses)
+{
+    BOOST_REQUIRE_EQUAL(ftdi_transfer_pool_set_size(ftdi, 0), 0);
+
+    for (int i = 0; i < 4; i++)
+    {
+        struct ftdi_transfer_control *tc = ftdi_write_data_submit(ftdi, &data[0], data.size());
+        BOOST_REQUIRE(tc != NULL);
+        BOOST_CHECK_EQUAL(ftdi_transfer_data_done(tc), (int)data.size());
+    }
+
+    struct ftdi_transfer_pool_stats s = stats();
+    BOOST_CHECK_EQUAL(s.tc_hits, 0UL);
+    BOOST_CHECK_EQUAL(s.tc_misses, 4UL);
+    BOOST_CHECK_EQUAL(s.transfer_hits, 0UL);
+    BOOST_CHECK_EQUAL(s.transfer_misses, 4UL);
+    BOOST_CHECK_EQUAL(fake_usb.live, live);
+}
+
+BOOST_AUTO_TEST_CASE(UncancellableTransferNotRecycled)
+{
+    struct ftdi_transfer_control *tc;
+
+    // warm up the pool
+    tc = ftdi_write_data_submit(ftdi, &data[0], data.size());
+    BOOST_CHECK_EQUAL(ftdi_transfer_data_done(tc), (int)data.size());
+
+    // event handling fails and the transfer can't be cancelled
+    tc = ftdi_write_data_submit(ftdi, &data[0], data.size());
+    BOOST_REQUIRE(tc != NULL);
+    fake_usb.event_failures = 2;
+    fake_usb.cancel_fails = true;
+    BOOST_CHECK(ftdi_transfer_data_done(tc) < 0);
+    BOOST_CHECK_EQUAL(fake_usb.pending(), 1);
+    fake_usb.cancel_fails = false;
+
+    // the next transfer must not reuse the one still in flight
+    vector<unsigned char> other(100, 0xaa);
+    struct ftdi_transfer_pool_stats before = stats();
+    tc = ftdi_write_data_submit(ftdi, &other[0], other.size());
+    BOOST_REQUIRE(tc != NULL);
+    BOOST_CHECK_EQUAL(stats().tc_misses, before.tc_misses + 1);
+    BOOST_CHECK_EQUAL(stats().transfer_misses, before.transfer_misses + 1);
+    BOOST_CHECK_EQUAL(fake_usb.pending(), 2);
+
+    // both complete, the abandoned one goes back to the pool
+    dev.written.clear();
+    BOOST_CHECK_EQUAL(ftdi_transfer_data_done(tc), (int)other.size());
+    BOOST_CHECK_EQUAL(dev.written.size(), data.size() + other.size());
+    BOOST_CHECK(equal(other.begin(), other.end(), dev.written.begin() + data.size()));
+    BOOST_CHECK_EQUAL(fake_usb.pending(), 0);
+
+    tc = ftdi_write_data_submit(ftdi, &data[0], data.size());
+    BOOST_CHECK_EQUAL(stats().tc_hits, before.tc_hits + 1);
+    BOOST_CHECK_EQUAL(ftdi_transfer_data_done(tc), (int)data.size());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
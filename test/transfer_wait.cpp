@@ -0,0 +1,120 @@
+/**@file
+@brief Test waiting for several asynchronous transfers
+
+@author libftdi developers
+*/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation;             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "fake_usb.h"
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(TransferWait)
+
+BOOST_AUTO_TEST_CASE(AnyAndAllOnSharedContext)
+{
+    struct ftdi_context *a = ftdi_new_shared(NULL);
+    struct ftdi_context *b = ftdi_new_shared(NULL);
+    FakeDevice dev_a, dev_b;
+    vector<unsigned char> out(100, 0x11), in(50);
+    struct ftdi_transfer_control *tcs[3];
+
+    fake_usb.reset();
+    BOOST_REQUIRE(a != NULL && b != NULL);
+    BOOST_REQUIRE(a->usb_ctx == b->usb_ctx);
+    dev_a.attach(a);
+    dev_b.attach(b);
+
+    tcs[0] = ftdi_write_data_submit(a, &out[0], out.size());
+    tcs[1] = ftdi_read_data_submit(b, &in[0], in.size());
+    tcs[2] = NULL;
+    BOOST_REQUIRE(tcs[0] != NULL && tcs[1] != NULL);
+
+    int first = ftdi_transfer_data_done_any(tcs, 3, 1000);
+    BOOST_REQUIRE(first == 0 || first == 1);
+    BOOST_CHECK_EQUAL(ftdi_transfer_data_done_all(tcs, 3, 1000), 0);
+    BOOST_CHECK_EQUAL(fake_usb.event_rounds, 1);
+
+    BOOST_CHECK_EQUAL(ftdi_transfer_data_done(tcs[0]), (int)out.size());
+    BOOST_CHECK_EQUAL(ftdi_transfer_data_done(tcs[1]), (int)in.size());
+    BOOST_CHECK(dev_a.written == out);
+    BOOST_CHECK(equal(in.begin(), in.end(), dev_b.sent.begin()));
+
+    FakeDevice::detach(a);
+    FakeDevice::detach(b);
+    ftdi_free(a);
+    ftdi_free(b);
+}
+
+BOOST_AUTO_TEST_CASE(TimeoutAndInvalidInput)
+{
+    struct ftdi_context *ftdi = ftdi_new();
+    FakeDevice dev;
+    vector<unsigned char> out(10);
+    struct ftdi_transfer_control *tcs[2] = { NULL, NULL };
+
+    fake_usb.reset();
+    dev.attach(ftdi);
+
+    BOOST_CHECK_EQUAL(ftdi_transfer_data_done_any(NULL, 1, 0), -3);
+    BOOST_CHECK_EQUAL(ftdi_transfer_data_done_any(tcs, 2, 0), -3);
+
+    tcs[0] = ftdi_write_data_submit(ftdi, &out[0], out.size());
+    BOOST_REQUIRE(tcs[0] != NULL);
+    fake_usb.stalled = true;
+    BOOST_CHECK_EQUAL(ftdi_transfer_data_done_all(tcs, 2, 10), -1);
+    BOOST_CHECK_EQUAL(ftdi_transfer_data_done_any(tcs, 2, 0), -1);
+    fake_usb.stalled = false;
+    BOOST_CHECK_EQUAL(ftdi_transfer_data_done_any(tcs, 2, 10), 0);
+    BOOST_CHECK_EQUAL(ftdi_transfer_data_done(tcs[0]), (int)out.size());
+
+    FakeDevice::detach(ftdi);
+    ftdi_free(ftdi);
+}
+
+BOOST_AUTO_TEST_CASE(DifferentContextsRejected)
+{
+    struct ftdi_context *a = ftdi_new();
+    struct ftdi_context *b = ftdi_new();
+    FakeDevice dev_a, dev_b;
+    vector<unsigned char> out(10);
+    struct ftdi_transfer_control *tcs[2];
+
+    fake_usb.reset();
+    dev_a.attach(a);
+    dev_b.attach(b);
+    if (a->usb_ctx == b->usb_ctx)
+    {
+        // the libusb in use hands out the same context twice
+        FakeDevice::detach(a);
+        FakeDevice::detach(b);
+        ftdi_free(a);
+        ftdi_free(b);
+        return;
+    }
+
+    tcs[0] = ftdi_write_data_submit(a, &out[0], out.size());
+    tcs[1] = ftdi_write_data_submit(b, &out[0], out.size());
+    BOOST_CHECK_EQUAL(ftdi_transfer_data_done_all(tcs, 2, 1000), -4);
+    BOOST_CHECK_EQUAL(ftdi_transfer_data_done(tcs[0]), (int)out.size());
+    BOOST_CHECK_EQUAL(ftdi_transfer_data_done(tcs[1]), (int)out.size());
+
+    FakeDevice::detach(a);
+    FakeDevice::detach(b);
+    ftdi_free(a);
+    ftdi_free(b);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,85 @@
+/**@file
+@brief Test ftdi_write_data() against a fake device
+
+@author libftdi developers
+*/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation;             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "fake_usb.h"
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+struct WriteFixture : FakeFixture
+{
+    WriteFixture() : data(1000)
+    {
+        ftdi_write_data_set_chunksize(ftdi, 64);
+        for (unsigned int i = 0; i < data.size(); i++)
+            data[i] = i * 7;
+    }
+
+    vector<unsigned char> data;
+};
+
+BOOST_FIXTURE_TEST_SUITE(WriteData, WriteFixture)
+
+BOOST_AUTO_TEST_CASE(SynchronousChunks)
+{
+    BOOST_CHECK_EQUAL(ftdi_write_data(ftdi, &data[0], data.size()), (int)data.size());
+    BOOST_CHECK_EQUAL(dev.out_transfers, 16);
+    BOOST_CHECK(dev.written == data);
+}
+
+BOOST_AUTO_TEST_CASE(PipelinedChunks)
+{
+    BOOST_REQUIRE_EQUAL(ftdi_write_data_set_pipeline(ftdi, 4), 0);
+
+    BOOST_CHECK_EQUAL(ftdi_write_data(ftdi, &data[0], data.size()), (int)data.size());
+    BOOST_CHECK_EQUAL(dev.out_transfers, 16);
+    BOOST_CHECK(dev.written == data);
+    BOOST_CHECK_EQUAL(fake_usb.pending(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(PipelinedErrorDrainsChunks)
+{
+    BOOST_REQUIRE_EQUAL(ftdi_write_data_set_pipeline(ftdi, 4), 0);
+
+    // the fourth chunk fails while the following ones are already queued
+    dev.fail_out_at = 3;
+    BOOST_CHECK(ftdi_write_data(ftdi, &data[0], data.size()) < 0);
+
+    // nothing is left in flight pointing into the caller's buffer
+    BOOST_CHECK_EQUAL(fake_usb.pending(), 0);
+    // no new chunks went out after the failure was seen
+    BOOST_CHECK(dev.out_transfers < 16);
+    BOOST_CHECK(equal(dev.written.begin(), dev.written.begin() + 3 * 64, data.begin()));
+
+    // the context stays usable
+    dev.written.clear();
+    BOOST_CHECK_EQUAL(ftdi_write_data(ftdi, &data[0], data.size()), (int)data.size());
+    BOOST_CHECK(dev.written == data);
+}
+
+BOOST_AUTO_TEST_CASE(PipelinedSubmitFailure)
+{
+    BOOST_REQUIRE_EQUAL(ftdi_write_data_set_pipeline(ftdi, 4), 0);
+
+    fake_usb.submits_left = 2;
+    BOOST_CHECK(ftdi_write_data(ftdi, &data[0], data.size()) < 0);
+    BOOST_CHECK_EQUAL(fake_usb.pending(), 0);
+    BOOST_CHECK_EQUAL(dev.out_transfers, 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()